@@ -0,0 +1,76 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "css/computed_style.h"
+
+class NODE;
+class CSSOM;
+struct LAYOUT_TREE;
+
+// One step of a @keyframes rule; only opacity and transform are animated
+struct KEYFRAME
+{
+    float offset = 0; // 0 = from, 1 = to
+    bool has_opacity = false;
+    float opacity = 1;
+    bool has_transform = false;
+    TRANSFORM transform;
+};
+
+struct KEYFRAMES
+{
+    std::string name;
+    std::vector<KEYFRAME> frames; // by offset
+};
+
+// The animated values of an element for one frame; unset values come from its style
+struct ANIMATED_VALUES
+{
+    bool has_opacity = false;
+    float opacity = 1;
+    bool has_transform = false;
+    TRANSFORM transform;
+};
+
+// Running transitions and CSS animations of opacity and transform. Other
+// properties are not animated; they change with the restyle that sets them.
+class ANIMATION_TIMELINE
+{
+private:
+    struct ANIMATION
+    {
+        std::weak_ptr<NODE> node;
+        const NODE *key = nullptr;
+        std::vector<KEYFRAME> frames;
+        double start = 0; // ms on the caller's clock
+        ANIMATION_SPEC spec;
+        bool is_transition = false;
+    };
+
+    // The values of an element at the last update, to detect changes
+    struct NODE_STATE
+    {
+        std::weak_ptr<NODE> node;
+        float opacity = 1;
+        TRANSFORM transform;
+        std::vector<ANIMATION_SPEC> animations;
+        uint64_t generation = 0;
+    };
+
+    std::vector<ANIMATION> m_animations;
+    std::unordered_map<const NODE *, NODE_STATE> m_states;
+    uint64_t m_generation = 0;
+
+    static bool sample(const ANIMATION &animation, double now, ANIMATED_VALUES &values);
+    ANIMATED_VALUES current_values(const NODE *node, double now) const;
+    void start_transition(NODE &node, const TRANSITION &transition, const KEYFRAME &from, const KEYFRAME &to, double now);
+    void start_animations(NODE &node, const COMPUTED_STYLE &style, const CSSOM &cssom, double now);
+
+public:
+    void update(const LAYOUT_TREE &tree, const CSSOM &cssom, double now);
+    bool sample(double now, std::unordered_map<const NODE *, ANIMATED_VALUES> &values);
+    bool running() const { return !m_animations.empty(); }
+    void clear();
+};
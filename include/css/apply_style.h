@@ -3,4 +3,7 @@
 #include "css/css_rule.h"
 #include "css/cssom.h"
 
-void apply_style(std::shared_ptr<NODE> node,CSSOM& cssom);
+void apply_style(std::shared_ptr<NODE> node, const CSSOM& cssom);
+void update_style(std::shared_ptr<NODE> root, const CSSOM& cssom);
+void invalidate_media_rules(std::shared_ptr<NODE> root, const CSSOM& cssom, const std::vector<size_t>& rules);
+void compute_node_style(NODE& node, const COMPUTED_STYLE* parent_style, const CSSOM& cssom);
@@ -2,8 +2,10 @@
 #include <QColor>
 #include <QFont>
 #include <QFontMetrics>
+#include "css/font_cache.h"
 #include <functional>
 #include <unordered_map>
+#include <vector>
 
 enum class BOX_SIZING
 {
@@ -41,6 +43,129 @@ enum class POSITION_TYPE
     Fixed
 };
 
+enum class STYLE_CHANGE
+{
+    None,
+    Paint,
+    Layout
+};
+
+enum class LENGTH_UNIT
+{
+    Px,
+    Em,
+    Rem,
+    Percent,
+    Vw,
+    Vh
+};
+
+// Box properties that keep a relative specified value until layout
+enum class LENGTH_PROPERTY
+{
+    Width,
+    Height,
+    MarginTop,
+    MarginRight,
+    MarginBottom,
+    MarginLeft,
+    PaddingTop,
+    PaddingRight,
+    PaddingBottom,
+    PaddingLeft,
+    Top,
+    Right,
+    Bottom,
+    Left
+};
+
+struct LENGTH
+{
+    float value = 0;
+    LENGTH_UNIT unit = LENGTH_UNIT::Px;
+
+    bool operator==(const LENGTH &other) const { return value == other.value && unit == other.unit; }
+};
+
+struct RELATIVE_LENGTH
+{
+    LENGTH_PROPERTY property;
+    LENGTH length;
+
+    bool operator==(const RELATIVE_LENGTH &other) const { return property == other.property && length == other.length; }
+};
+
+// What relative lengths are resolved against at layout time
+struct LENGTH_BASIS
+{
+    float containing_width = 0;
+    float containing_height = -1; // -1 = unknown, percentages of it resolve to auto
+    float root_font_size = 16;
+    float viewport_width = 0;
+    float viewport_height = 0;
+};
+
+// Cubic Bezier easing curve from (0, 0) to (1, 1); the default is "ease"
+struct TIMING_FUNCTION
+{
+    float x1 = 0.25f;
+    float y1 = 0.1f;
+    float x2 = 0.25f;
+    float y2 = 1;
+
+    float progress(float t) const;
+    bool operator==(const TIMING_FUNCTION &other) const { return x1 == other.x1 && y1 == other.y1 && x2 == other.x2 && y2 == other.y2; }
+};
+
+// A 2D transform, kept as translate, rotate and scale about the box's center
+struct TRANSFORM
+{
+    float translate_x = 0;
+    float translate_y = 0;
+    float scale_x = 1;
+    float scale_y = 1;
+    float rotate = 0; // degrees, clockwise
+
+    bool is_identity() const { return *this == TRANSFORM{}; }
+    bool operator==(const TRANSFORM &other) const
+    {
+        return translate_x == other.translate_x && translate_y == other.translate_y && scale_x == other.scale_x &&
+               scale_y == other.scale_y && rotate == other.rotate;
+    }
+    bool operator!=(const TRANSFORM &other) const { return !(*this == other); }
+
+    static TRANSFORM interpolate(const TRANSFORM &from, const TRANSFORM &to, float t);
+};
+
+struct TRANSITION
+{
+    std::string property; // a property name, or "all"
+    float duration = 0;   // ms
+    float delay = 0;      // ms
+    TIMING_FUNCTION timing;
+
+    bool operator==(const TRANSITION &other) const
+    {
+        return property == other.property && duration == other.duration && delay == other.delay && timing == other.timing;
+    }
+};
+
+struct ANIMATION_SPEC
+{
+    std::string name; // of the @keyframes rule
+    float duration = 0; // ms
+    float delay = 0;    // ms
+    TIMING_FUNCTION timing;
+    float iterations = 1; // < 0 = infinite
+    bool alternate = false;
+
+    bool operator==(const ANIMATION_SPEC &other) const
+    {
+        return name == other.name && duration == other.duration && delay == other.delay && timing == other.timing &&
+               iterations == other.iterations && alternate == other.alternate;
+    }
+};
+
 struct COMPUTED_STYLE
 {
     QColor color = QColor("#000000");          // default: black
@@ -90,29 +215,35 @@ struct COMPUTED_STYLE
 
     bool visibility = true;
 
-    QFont to_font() const
-    {
-        QFont font;
-        font.setPixelSize(font_size);
-        font.setWeight(font_weight);
-        font.setFamily(font_family);
-        if (font_style == "italic")
-        {
-            font.setItalic(true);
-        }
-        return font;
-    }
-    QFontMetrics font_metrics() const
-    {
-        return QFontMetrics(to_font());
-    }
+    TRANSFORM transform;
+    std::vector<TRANSITION> transitions;
+    std::vector<ANIMATION_SPEC> animations;
+
+    int font_id = -1; // entry in FONT_CACHE::shared(), set by resolve_font()
+
+    // Specified em/rem/%/vw/vh values; layout writes the resolved pixels into the fields above
+    std::vector<RELATIVE_LENGTH> relative_lengths;
+
+    void resolve_font();
+    const FONT_ENTRY &font() const;
+
+    float &length_field(LENGTH_PROPERTY property);
+    float length_field(LENGTH_PROPERTY property) const;
+    void set_length(LENGTH_PROPERTY property, const std::string &value, float default_value);
+    bool resolve_lengths(const LENGTH_BASIS &basis);
+    void keep_resolved_lengths(const COMPUTED_STYLE &old_style);
+    bool has_relative_length(LENGTH_PROPERTY property) const;
+
+    const TRANSITION *transition_for(const std::string &property) const;
+    bool is_composited() const;
 
     using Setter = std::function<void(COMPUTED_STYLE &, const std::string &)>;
     static std::unordered_map<std::string, Setter> setters;
 
     static QColor parse_color(const std::string &color_value);
-    static int parse_font_size(const std::string &value);
+    static int parse_font_size(const std::string &value, int parent_font_size = 16);
     static float parse_string_to_float(const std::string &value, const float default_value = 0);
+    static bool parse_length(const std::string &value, LENGTH &length);
     
     // Enum parsers
     static DISPLAY_TYPE parse_display_type(const std::string &value);
@@ -120,14 +251,24 @@ struct COMPUTED_STYLE
     static BOX_SIZING parse_box_sizing(const std::string &value);
     static TEXT_DECORATION parse_text_decoration(const std::string &value);
     static POSITION_TYPE parse_position_type(const std::string &value);
+
+    // Animation parsers; times are in milliseconds
+    static bool parse_time(const std::string &value, float &milliseconds);
+    static bool parse_timing_function(const std::string &value, TIMING_FUNCTION &timing);
+    static TRANSFORM parse_transform(const std::string &value);
+    static std::vector<TRANSITION> parse_transitions(const std::string &value);
+    static std::vector<ANIMATION_SPEC> parse_animations(const std::string &value);
     
-    // Spacing shorthand parser (margin/padding: 1-4 values)
+    // Spacing shorthand parser (margin/padding: 1-4 values), unparsed so each side keeps its unit
     struct SPACING_VALUES {
-        float top, right, bottom, left;
+        std::string top, right, bottom, left;
     };
     static SPACING_VALUES parse_spacing_shorthand(const std::string &value);
 
+    static STYLE_CHANGE diff(const COMPUTED_STYLE &old_style, const COMPUTED_STYLE &new_style);
+
     static void init_setters();
+    static void register_setters();
 
     std::string inherit_color() const;
     std::string inherit_font_size() const;
@@ -12,6 +12,8 @@ struct CSS_RULE
 {
     std::string selector;
     std::vector<DECLARATION> declarations;
+    std::string media; // prelude of the enclosing @media rule, empty = all media
+    std::string keyframes; // name of the enclosing @keyframes rule; the selector is then the keyframe offsets
 
     CSS_RULE(std::string& s):selector(s){}
 };
@@ -1,23 +1,58 @@
 #pragma once
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include "css/animation.h"
 #include "css/css_rule.h"
+#include "css/media_query.h"
+#include "css/selector.h"
 #include "html/node.h"
 
+enum INVALIDATION_FLAGS
+{
+    INVALIDATE_NONE = 0,
+    INVALIDATE_SELF = 1 << 0,
+    INVALIDATE_DESCENDANTS = 1 << 1,
+    INVALIDATE_SIBLINGS = 1 << 2
+};
+
 class CSSOM{
     private:
         std::vector<CSS_RULE> m_rules;
+        std::vector<std::vector<COMPLEX_SELECTOR>> m_selector_lists;
+
+        std::unordered_map<std::string, int> m_class_invalidation;
+        std::unordered_map<std::string, int> m_id_invalidation;
+        std::unordered_map<std::string, int> m_attribute_invalidation;
+        bool m_has_sibling_selectors = false;
+
+        std::vector<MEDIA_CONDITION> m_media_conditions;
+        std::vector<bool> m_media_active;
+        std::vector<int> m_rule_media; // index into m_media_conditions per rule, -1 = all media
+        float m_media_width = 0;
+        float m_media_height = 0;
+
+        std::unordered_map<std::string, KEYFRAMES> m_keyframes;
 
-        bool matches(const std::string& selector, std::shared_ptr<NODE> node);
+        void build_invalidation_sets(const COMPLEX_SELECTOR& selector);
+        void add_keyframe(const CSS_RULE& rule);
 
     public:
-        void add_rule(CSS_RULE rule){
-            m_rules.push_back(rule);
-        }
+        void add_rule(CSS_RULE rule);
 
         std::vector<CSS_RULE> get_rules() const {
             return m_rules;
         }
 
-        std::vector<CSS_RULE> matching_rules(std::shared_ptr<NODE> node);
-};
\ No newline at end of file
+        std::vector<const CSS_RULE*> matching_rules(const NODE& node) const;
+        const std::vector<COMPLEX_SELECTOR>& selector_list(size_t rule) const;
+
+        std::vector<size_t> update_media(float viewport_width, float viewport_height);
+
+        const KEYFRAMES* keyframes(const std::string& name) const;
+
+        int class_invalidation(const std::string& class_name) const;
+        int id_invalidation(const std::string& id) const;
+        int attribute_invalidation(const std::string& name) const;
+        bool has_sibling_selectors() const;
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <functional>
+#include <unordered_set>
+#include <vector>
+#include <QRectF>
+#include <QImage>
+#include <QPainter>
+#include "css/layout_tree.h"
+
+enum class DISPLAY_ITEM_TYPE
+{
+    Background,
+    Border,
+    Image,
+    Text,
+    Bullet
+};
+
+struct DISPLAY_ITEM
+{
+    DISPLAY_ITEM_TYPE type = DISPLAY_ITEM_TYPE::Background;
+    int box = -1;        // the LAYOUT_BOX painted
+    size_t fragment = 0; // for Text, index into LAYOUT_TREE::fragments
+
+    // Paint properties copied from the box's style, so items can be painted
+    // off the GUI thread while the DOM changes
+    QColor color; // background, border or text color
+    Qt::PenStyle border_style = Qt::SolidLine;
+    float border_width = 0;
+    const FONT_ENTRY *font = nullptr; // for Text and Bullet
+    TEXT_DECORATION decoration = TEXT_DECORATION::None;
+    QString text; // for Text without glyph runs
+
+    float x = 0; // drawing origin, text alignment applied
+    float y = 0;
+    QRectF bounds;    // everything the item paints, for culling
+    int layer = -1;    // innermost DISPLAY_LAYER the item is in, or -1
+    int composited_layer = -1; // innermost composited DISPLAY_LAYER, or -1 for items drawn into tiles
+
+    int fixed_root = -1; // fixed-position box the item moves with; x, y and bounds are relative to it
+};
+
+// Uniform grid over the document; each cell lists the entries crossing it, in insertion order
+struct SPATIAL_GRID
+{
+    int columns = 1; // entries right of the last column are kept in it
+    std::vector<std::vector<size_t>> cells; // row-major; rows are added as entries reach them
+
+    void reset(float document_width);
+    void insert(size_t index, const QRectF &bounds);
+    void query(const QRectF &rect, std::vector<size_t> &result) const;
+    const std::vector<size_t> *cell_at(const QPointF &point) const;
+};
+
+static constexpr float SPATIAL_CELL_SIZE = 256;
+
+// A subtree painted offscreen and composited as a whole: a fixed-position box,
+// an element with opacity below 1, or an element whose opacity or transform
+// animates or may animate. Fixed and animated layers are composited: they
+// keep an image of their own and are drawn over the tiles, so that scrolling
+// or animating them only redraws that image.
+struct DISPLAY_LAYER
+{
+    int box = -1;
+    int parent = -1;     // enclosing layer; -1 for fixed layers, which composite over the document
+    float opacity = 1;   // the element's own opacity, applied to the layer
+    int fixed_root = -1; // as in DISPLAY_ITEM
+    size_t first_item = 0; // the layer's items, nested layers' included
+    size_t end_item = 0;
+    QRectF bounds; // union of the items' bounds
+
+    bool composited = false;
+    int composite_parent = -1; // enclosing composited layer, or -1
+    float outer_opacity = 1;   // of the layers between this one and composite_parent
+    TRANSFORM transform;       // the element's transform
+    QRectF box_rect;           // the element's border box; transforms apply around its center
+};
+
+// Composited layers with more pixels are rasterized only around the visible area
+static constexpr int64_t MAX_LAYER_PIXELS = 2048 * 2048;
+
+// The area a box or text fragment occupies, for hit testing
+struct HIT_ENTRY
+{
+    int box = -1;
+    QRectF bounds;
+    int fixed_root = -1; // as in DISPLAY_ITEM
+};
+
+struct DISPLAY_LIST
+{
+    std::vector<DISPLAY_ITEM> items; // in paint order
+    SPATIAL_GRID grid;               // the scrolling items
+    std::vector<size_t> fixed_items; // items positioned against the viewport
+
+    std::vector<DISPLAY_LAYER> layers; // in paint order, parents first
+    std::vector<size_t> composited_layers; // in paint order
+
+    std::vector<HIT_ENTRY> hits; // in paint order
+    SPATIAL_GRID hit_grid;
+    std::vector<size_t> fixed_hits;
+
+    void clear();
+    void query(const QRectF &rect, std::vector<size_t> &result) const;
+    int hit_test(const QPointF &point, const std::function<QPointF(int)> &fixed_origin) const;
+};
+
+void build_display_list(const LAYOUT_TREE &tree, DISPLAY_LIST &list,
+                        const std::unordered_set<const NODE *> *animated_nodes = nullptr);
+void paint_display_item(QPainter &painter, const DISPLAY_ITEM &item, const LAYOUT_TREE &tree, const QPointF &origin);
+void paint_items(QPainter &painter, const DISPLAY_LIST &list, const LAYOUT_TREE &tree,
+                 const std::vector<size_t> &items, int layer, const QRectF &area);
+QImage render_tile(const DISPLAY_LIST &list, const LAYOUT_TREE &tree, const QRect &tile_rect);
+QRect layer_image_rect(const DISPLAY_LAYER &layer, const QRect &clip);
+QImage render_layer(const DISPLAY_LIST &list, const LAYOUT_TREE &tree, size_t layer, const QRect &clip = QRect());
+bool fill_loaded_images(LAYOUT_TREE &tree, const DISPLAY_LIST &list, IMAGE_CACHE_MANAGER &cache,
+                        const QString &base_url, const std::unordered_set<QString> &urls,
+                        std::vector<size_t> &repaint_items, const std::function<void()> &before_fill = nullptr);
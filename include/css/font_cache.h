@@ -0,0 +1,104 @@
+#pragma once
+#include <QFont>
+#include <QFontMetrics>
+#include <QRawFont>
+#include <QString>
+#include <QStringView>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct FONT_KEY
+{
+    QString family;
+    int pixel_size;
+    QFont::Weight weight;
+    bool italic;
+
+    bool operator==(const FONT_KEY &other) const
+    {
+        return pixel_size == other.pixel_size && weight == other.weight &&
+               italic == other.italic && family == other.family;
+    }
+
+    QFont to_font() const; // a new font, sharing no data with the interned one
+};
+
+struct FONT_KEY_HASH
+{
+    size_t operator()(const FONT_KEY &key) const;
+};
+
+// A font opened by one thread for its own use; a QRawFont may only be used
+// on the thread that opened it
+struct THREAD_FONT
+{
+    QFont font;
+    QRawFont raw;
+};
+
+// Measures a word from glyph advances; layout and its prepass both use it
+int measure_word(QStringView word, const THREAD_FONT &font);
+
+struct WORD_WIDTH_STATS
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t entries = 0;
+};
+
+class WORD_WIDTH_CACHE
+{
+private:
+    mutable std::mutex m_mutex;
+    std::deque<std::u16string> m_words;
+    std::unordered_map<std::u16string_view, int> m_widths;
+    size_t m_capacity;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 8192;
+
+    explicit WORD_WIDTH_CACHE(size_t capacity = DEFAULT_CAPACITY);
+
+    int width(QStringView word, const THREAD_FONT &font);
+    WORD_WIDTH_STATS stats() const;
+    void clear();
+};
+
+struct FONT_ENTRY
+{
+    FONT_KEY key;
+    QFont font;
+    int ascent;
+    int line_height;
+    mutable WORD_WIDTH_CACHE word_widths;
+
+    explicit FONT_ENTRY(const FONT_KEY &key);
+
+    int word_width(QStringView word) const;
+    const THREAD_FONT &thread_font() const;
+};
+
+class FONT_CACHE
+{
+private:
+    mutable std::mutex m_mutex;
+    std::deque<FONT_ENTRY> m_entries;
+    std::unordered_map<FONT_KEY, int, FONT_KEY_HASH> m_ids;
+
+public:
+    FONT_CACHE() = default;
+    FONT_CACHE(const FONT_CACHE &) = delete;
+    FONT_CACHE &operator=(const FONT_CACHE &) = delete;
+
+    int intern(const QString &family, int pixel_size, QFont::Weight weight, bool italic);
+    const FONT_ENTRY &get(int id) const;
+    size_t size() const;
+    WORD_WIDTH_STATS word_width_stats() const;
+
+    static FONT_CACHE &shared();
+};
@@ -1,11 +1,15 @@
 #pragma once
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <QFont>
 #include <QFontMetrics>
+#include <QGlyphRun>
+#include <QList>
 #include "html/node.h"
 #include "css/computed_style.h"
-#include <QPixmap>
+#include <QImage>
+#include <QRectF>
 #include "gui/image_cache_manager.h"
 
 struct LINE_STATE
@@ -19,53 +23,159 @@ struct LINE_STATE
     LINE_STATE(float width = 0) : max_width(width) {}
 };
 
+struct TEXT_FRAGMENT
+{
+    size_t offset = 0; // UTF-16 range in the node's text
+    size_t length = 0;
+
+    float x = 0; // in the coordinates of the text box's parent
+    float y = 0;
+    float width = 0;
+    float height = 0;
+
+    QList<QGlyphRun> glyph_runs; // shaped once at layout, origin at the fragment's top-left
+    std::vector<const FONT_ENTRY *> glyph_run_fonts; // the font of each run, for paint threads to open
+};
+
 struct LAYOUT_BOX
 {
-    std::shared_ptr<NODE> node;
-    COMPUTED_STYLE style;
+    NODE *node = nullptr;
+    const COMPUTED_STYLE *style = nullptr; // the node's computed style, not a copy
 
     float x = 0;
     float y = 0;
     float width = 0;
     float height = 0;
+    QRectF overflow; // box and all in-flow/absolute descendants, relative to (x, y)
 
-    std::vector<LAYOUT_BOX> children;
-    std::string text;
+    // Indices into LAYOUT_TREE::boxes, -1 if absent
+    int parent = -1;
+    int first_child = -1;
+    int last_child = -1;
+    int first_absolute_child = -1;
+    int last_absolute_child = -1;
+    int next_sibling = -1;
 
+    // Range in LAYOUT_TREE::fragments, for text boxes
+    size_t first_fragment = 0;
+    size_t fragment_count = 0;
+
+    int image = -1; // index into LAYOUT_TREE::images
     bool is_positioned = false;
-    std::vector<LAYOUT_BOX> absolute_children;
-    QPixmap image;
+    int estimated_count = 0; // > 0 for a placeholder standing in for that many blocks, starting at node
+};
+
+struct LAYOUT_TREE
+{
+    std::vector<LAYOUT_BOX> boxes; // boxes[0] is the root, parents precede children
+    std::vector<TEXT_FRAGMENT> fragments;
+    std::vector<QImage> images;
+
+    void clear();
+    bool empty() const;
+    int add_box(NODE *node);
+    void append_child(int parent, int child);
+    void append_absolute_child(int parent, int child);
+};
+
+// Where a block's subtree was laid out, and under which constraints
+struct LAYOUT_CACHE_ENTRY
+{
+    float width = 0; // the block's resolved width, before a positioned parent adjusts it
+    int first_box = 0; // the subtree is a contiguous range of every array
+    int end_box = 0;
+    size_t first_fragment = 0;
+    size_t end_fragment = 0;
+    size_t first_image = 0;
+    size_t end_image = 0;
+    LINE_STATE line_after; // the line state the block left for its parent
+    bool has_estimates = false; // depends on the viewport, never reused
+
+    // Set if a length inside was resolved against the viewport or root font size
+    bool uses_viewport = false;
+    float viewport_width = 0;
+    float viewport_height = 0;
+    float root_font_size = 0;
+};
+
+using LAYOUT_CACHE = std::unordered_map<const NODE *, LAYOUT_CACHE_ENTRY>;
+
+// Word widths of text nodes, measured before line breaking
+struct TEXT_MEASUREMENTS
+{
+    std::unordered_map<const NODE *, std::vector<int>> word_widths; // one width per token, in text order
+    float width = -1; // the layout width measured for, kept across clear()
+
+    void clear();
+};
+
+// Vertical range laid out exactly by virtualized layout, in document coordinates
+struct LAYOUT_VIEWPORT
+{
+    float top = 0;
+    float bottom = 0;
+};
+
+using BLOCK_HEIGHTS = std::unordered_map<const NODE *, float>; // exact height with margins, per block
+
+struct LAYOUT_CONTEXT
+{
+    LAYOUT_TREE &tree;
+    QString base_url;
+    IMAGE_CACHE_MANAGER *image_cache_manager = nullptr;
+
+    // Optional incremental layout: clean blocks are copied from the previous pass
+    const LAYOUT_TREE *previous_tree = nullptr;
+    const LAYOUT_CACHE *previous_cache = nullptr;
+    LAYOUT_CACHE *cache = nullptr;
+    size_t reused_boxes = 0;
+
+    const TEXT_MEASUREMENTS *measurements = nullptr; // optional, filled by measure_text
+
+    // Optional virtualization: blocks outside the viewport get estimated heights
+    const LAYOUT_VIEWPORT *viewport = nullptr;
+    BLOCK_HEIGHTS *block_heights = nullptr; // refined as blocks are laid out exactly
+    float origin_y = 0; // document y of the block being laid out
+    size_t estimated_boxes = 0;
+
+    // Bases of vw, vh and rem lengths
+    float viewport_width = 0;
+    float viewport_height = 0;
+    float root_font_size = 16;
+    size_t viewport_lengths = 0; // boxes whose lengths depended on them
 };
 
 // Helper functions for create_layout_tree
-LAYOUT_BOX layout_image_element(
-    std::shared_ptr<NODE> node,
-    const QString &base_url,
-    IMAGE_CACHE_MANAGER *image_cache_manager,
-    LINE_STATE &line);
-
-LAYOUT_BOX layout_block_element(
-    std::shared_ptr<NODE> root,
+int layout_image_element(
+    NODE *node,
+    LINE_STATE &line,
+    LAYOUT_CONTEXT &context);
+
+int layout_block_element(
+    NODE *root,
     float parent_width,
     LINE_STATE &line,
-    const QString &base_url,
-    IMAGE_CACHE_MANAGER *image_cache_manager);
+    LAYOUT_CONTEXT &context);
 
-LAYOUT_BOX layout_text_element(
-    std::shared_ptr<NODE> root,
-    const COMPUTED_STYLE &style,
-    LINE_STATE &line);
+int layout_text_element(
+    NODE *root,
+    LINE_STATE &line,
+    LAYOUT_CONTEXT &context);
 
-LAYOUT_BOX layout_inline_element(
-    std::shared_ptr<NODE> root,
+int layout_inline_element(
+    NODE *root,
     float parent_width,
     LINE_STATE &line,
-    const QString &base_url,
-    IMAGE_CACHE_MANAGER *image_cache_manager);
+    LAYOUT_CONTEXT &context);
+
+void measure_text(
+    NODE *root,
+    float width,
+    const LAYOUT_CACHE *previous_cache,
+    TEXT_MEASUREMENTS &measurements);
 
-LAYOUT_BOX create_layout_tree(
-    std::shared_ptr<NODE> root,
+int create_layout_tree(
+    NODE *root,
     float parent_width,
     LINE_STATE &line,
-    const QString &base_url,
-    IMAGE_CACHE_MANAGER *image_cache_manager);
\ No newline at end of file
+    LAYOUT_CONTEXT &context);
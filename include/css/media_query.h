@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+
+enum class MEDIA_FEATURE_TYPE
+{
+    MinWidth,
+    MaxWidth,
+    MinHeight,
+    MaxHeight,
+    Orientation
+};
+
+struct MEDIA_FEATURE
+{
+    MEDIA_FEATURE_TYPE type = MEDIA_FEATURE_TYPE::MinWidth;
+    float value = 0;        // in px, for the width and height features
+    bool landscape = false; // for orientation
+};
+
+struct MEDIA_QUERY
+{
+    bool negated = false;     // "not" in front of the query
+    bool matches_type = true; // false for media types other than screen and all
+    std::vector<MEDIA_FEATURE> features; // all must hold
+};
+
+// A comma-separated @media prelude; it holds if any query does
+struct MEDIA_CONDITION
+{
+    std::string text;
+    std::vector<MEDIA_QUERY> queries;
+};
+
+MEDIA_CONDITION parse_media_condition(const std::string &prelude);
+bool media_condition_matches(const MEDIA_CONDITION &condition, float viewport_width, float viewport_height);
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "html/node.h"
+
+enum class COMBINATOR
+{
+    Descendant,
+    Child,
+    Adjacent,
+    Sibling
+};
+
+struct ATTRIBUTE_SELECTOR
+{
+    std::string name;
+    std::string value;
+    bool has_value = false;
+};
+
+struct COMPOUND_SELECTOR
+{
+    std::string tag; // empty = any element
+    std::string id;
+    std::vector<std::string> classes;
+    std::vector<ATTRIBUTE_SELECTOR> attributes;
+};
+
+struct COMPLEX_SELECTOR
+{
+    std::vector<COMPOUND_SELECTOR> compounds; // left to right, last one is the subject
+    std::vector<COMBINATOR> combinators;      // combinators[i] joins compounds[i] and compounds[i + 1]
+    bool is_valid = true;
+};
+
+COMPLEX_SELECTOR parse_selector(const std::string &selector);
+std::vector<COMPLEX_SELECTOR> parse_selector_list(const std::string &selector_list);
+bool selector_matches(const COMPLEX_SELECTOR &selector, const NODE &node);
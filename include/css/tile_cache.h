@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+
+static constexpr int TILE_SIZE = 256;
+
+struct TILE
+{
+    QImage image;                  // last rendered content; kept while stale so it can still be shown
+    uint64_t version = 0;          // bumped whenever damage touches the tile
+    uint64_t rendered_version = 0; // the version the image shows
+    bool pending = false;          // a worker is rendering it
+    std::list<uint64_t>::iterator lru;
+
+    bool is_ready() const { return !image.isNull() && rendered_version == version; }
+};
+
+// Rasterized tiles of the document, touched only from the GUI thread
+class TILE_CACHE
+{
+private:
+    std::unordered_map<uint64_t, TILE> m_tiles;
+    std::list<uint64_t> m_lru; // most recently used first
+    size_t m_bytes = 0;
+    size_t m_budget;
+    uint64_t m_next_version = 1;
+
+    static uint64_t key(int column, int row);
+    void touch(TILE &tile);
+    void evict();
+
+public:
+    explicit TILE_CACHE(size_t budget = 64 * 1024 * 1024);
+
+    TILE *find(int column, int row);
+    uint64_t schedule(int column, int row);
+    bool store(int column, int row, uint64_t version, const QImage &image);
+
+    void invalidate(const QRectF &rect);
+    void invalidate_all();
+    void clear();
+
+    size_t bytes() const { return m_bytes; }
+    size_t size() const { return m_tiles.size(); }
+
+    static QRect tile_rect(int column, int row);
+};
@@ -1,10 +1,46 @@
 #pragma once
 #include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QImage>
+#include <list>
 #include <unordered_map>
 
-struct IMAGE_CACHE_MANAGER
+// Decoded images by absolute URL. Each URL is downloaded once, however many
+// layouts ask for it; loaded images are evicted least recently used first
+// once their decoded size exceeds the budget.
+class IMAGE_CACHE_MANAGER
 {
-    QNetworkAccessManager *image_network_manager;
-    std::unordered_map<QString, QPixmap> image_cacher;
-    QString src;
-};
\ No newline at end of file
+private:
+    struct ENTRY
+    {
+        QImage image;         // null while pending or if the download failed
+        bool pending = false; // a request is in flight
+        std::list<QString>::iterator lru; // valid for loaded images only
+    };
+
+    QNetworkAccessManager *m_network_manager = nullptr;
+    std::unordered_map<QString, ENTRY> m_entries;
+    std::unordered_map<QNetworkReply *, QString> m_replies; // in-flight requests
+    std::list<QString> m_lru; // loaded images, most recently used first
+    size_t m_bytes = 0;
+    size_t m_budget;
+
+    void evict();
+
+public:
+    explicit IMAGE_CACHE_MANAGER(size_t budget = 128 * 1024 * 1024);
+
+    void set_network_manager(QNetworkAccessManager *network_manager);
+    QNetworkAccessManager *network_manager() const { return m_network_manager; }
+
+    const QImage *find(const QString &url);
+    bool request(const QString &url);
+    QString take_reply(QNetworkReply *reply);
+    bool store(const QString &url, const QImage &image);
+    void forget_failed();
+
+    void set_budget(size_t budget);
+    size_t bytes() const { return m_bytes; }
+    size_t size() const { return m_entries.size(); }
+    bool is_pending(const QString &url) const;
+};
@@ -7,6 +7,7 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <unordered_map>
+#include <unordered_set>
 #include "gui/image_cache_manager.h"
 #include <QTimer>
 
@@ -88,6 +89,7 @@ private:
     QNetworkAccessManager *m_network_manager;
     IMAGE_CACHE_MANAGER m_image_cache_manager;
     QTimer *m_reflow_timer;
+    std::unordered_set<QString> m_loaded_images; // URLs downloaded since the last reflow
     std::shared_ptr<NODE> m_cached_tree;
     QString m_cached_base_url;
 
@@ -2,10 +2,18 @@
 #include <QWidget>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QScrollArea>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <memory>
+#include <unordered_set>
 #include "html/node.h"
 #include "css/cssom.h"
 #include "css/layout_tree.h"
+#include "css/display_list.h"
+#include "css/tile_cache.h"
+#include "css/animation.h"
+#include "work_stealing_pool.h"
 #include "gui/image_cache_manager.h"
 
 struct PAGE
@@ -23,22 +31,59 @@ private:
     CSSOM m_cssom;
     int m_viewport_width, m_viewport_height;
 
-    void paint_layout(QPainter &painter, const LAYOUT_BOX &box, float offset_x, float offset_y, const LAYOUT_BOX *parent_box = nullptr);
-    void paint_fixed(QPainter &painter, const LAYOUT_BOX &box);
-    
-    // Helper functions for paint_layout
-    void draw_element_box(QPainter &painter, const LAYOUT_BOX &box, float abs_x, float abs_y);
-    void draw_text_node(QPainter &painter, const LAYOUT_BOX &box, float offset_x, float offset_y, const LAYOUT_BOX *parent_box);
-    
+    QPointF fixed_origin(int index);
+
+    // Helper functions for paintEvent
+    void schedule_tile(int column, int row);
+    void tile_rendered(int column, int row, uint64_t version, const QImage &image);
+    void wait_for_tiles();
+    const QImage &checkerboard();
+    QRect visible_rect();
+    QTransform layer_transform(size_t layer);
+    float layer_opacity(size_t layer);
+    QRectF layer_rect(size_t layer);
+    void update_animations();
+    void composite_animated_nodes();
+
     void recalculate_layout();
-    LAYOUT_BOX m_layout_tree;
+    void update_viewport_size();
+    bool viewport_resized();
+    bool layout_covers_viewport();
+    void refresh_paint_styles(QRectF &dirty_rect, bool &fixed_dirty);
+    LAYOUT_TREE m_layout_tree;
+    LAYOUT_TREE m_previous_layout_tree;
+    LAYOUT_CACHE m_layout_cache;
+    LAYOUT_CACHE m_previous_layout_cache;
+    TEXT_MEASUREMENTS m_text_measurements;
+    DISPLAY_LIST m_display_list;
+    TILE_CACHE m_tile_cache;
+    TASK_GROUP m_tile_group; // tiles being rendered; they read the display list and layout tree
+    QImage m_checkerboard;
+    std::vector<QImage> m_layer_images; // per display list layer; rendered for composited layers when first shown
+    std::vector<QRect> m_layer_image_rects; // the part of each layer its image covers
+    std::vector<QRectF> m_layer_rects;  // where each composited layer was last drawn
+    ANIMATION_TIMELINE m_timeline;
+    std::unordered_map<const NODE *, ANIMATED_VALUES> m_animated_values; // of the current frame
+    std::unordered_set<const NODE *> m_animated_nodes; // composited by the display list while they animate
+    QTimer *m_frame_timer;
+    QElapsedTimer m_clock;
+    BLOCK_HEIGHTS m_block_heights;
+    bool m_virtualized_layout = true;
+    bool m_layout_has_estimates = false;
+    bool m_layout_uses_viewport = false;
+    bool m_adjusting_scroll = false;
+    LAYOUT_VIEWPORT m_layout_viewport;
+    QScrollArea *m_scroll_area = nullptr;
+
+    QScrollArea *scroll_area();
+    float document_top(int index) const;
+    int find_scroll_anchor(float scroll_y) const;
     bool m_has_layout = false;
     IMAGE_CACHE_MANAGER *m_image_cache_manager;
 
     QString m_base_url;
 
     std::shared_ptr<NODE> find_node_at(float x, float y);
-    std::shared_ptr<NODE> find_node_in_box(const LAYOUT_BOX& box, float x, float y, float offset_x, float offset_y);
     std::string bubble_for_link(std::shared_ptr<NODE> node);
 
     std::list<PAGE> m_history_list;
@@ -52,14 +97,21 @@ signals:
 protected:
     void paintEvent(QPaintEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
 
 
 public slots:
     void go_back();
     void go_forward();
+    void update_document();
+    void viewport_scrolled(int value);
+    void animation_frame();
 
 public:
     explicit Renderer(QWidget *parent = nullptr);
+    ~Renderer();
     void set_document(std::shared_ptr<NODE> root, IMAGE_CACHE_MANAGER &image_cache_manager, const QString &base_url = "");
+    void set_virtualized_layout(bool enabled);
+    void resources_loaded(const std::unordered_set<QString> &urls);
 };
\ No newline at end of file
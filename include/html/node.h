@@ -4,39 +4,93 @@
 #include <memory>
 #include <map>
 #include <QRectF>
+#include <QString>
 #include "css/computed_style.h"
 
 enum class NODE_TYPE{
     ELEMENT,TEXT
 };
 
+struct ATTRIBUTE_CHANGE{
+    std::string name;
+    std::string old_value;
+    std::string new_value;
+};
+
 class NODE: public std::enable_shared_from_this<NODE>{
     private:
         NODE_TYPE m_type;
         std::string m_tag_name;
-        std::string m_text;
+        QString m_text;
 
         std::vector<std::shared_ptr<NODE>> m_children;
         std::map<std::string, std::string> m_attributes;
         COMPUTED_STYLE m_computed_style;
+        bool m_style_resolved = false;
+
+        bool m_style_dirty = true;
+        bool m_self_style_dirty = false;
+        bool m_descendant_style_dirty = false;
+        bool m_children_changed = false;
+        std::vector<ATTRIBUTE_CHANGE> m_pending_attribute_changes;
+        bool m_layout_dirty = true;
+        bool m_descendant_layout_dirty = false;
+        bool m_paint_dirty = false;
+        bool m_descendant_paint_dirty = false;
 
         std::weak_ptr<NODE> m_parent;
 
+        void flag_ancestors_style_dirty();
+        void schedule_attribute_invalidation(const std::string& name, const std::string& old_value, const std::string& new_value);
 
     public:
         NODE(NODE_TYPE t, const std::string& content);
+        ~NODE();
 
         void add_child(std::shared_ptr<NODE> child);
+        void insert_child(std::shared_ptr<NODE> child, size_t index);
+        void remove_child(std::shared_ptr<NODE> child);
         void set_attribute(const std::string& name, const std::string& value);
+        void remove_attribute(const std::string& name);
         std::string get_attribute(const std::string& name) const;
+        bool has_attribute(const std::string& name) const;
+        void set_text_content(const std::string& text);
 
         void set_parent(std::weak_ptr<NODE> parent);
 
         void set_style(const std::string& name, const std::string& value);
         COMPUTED_STYLE get_all_styles() const;
+        const COMPUTED_STYLE& get_computed_style() const;
+        bool is_style_resolved() const;
+        void set_style_resolved(bool resolved);
+        void reset_style();
+        void resolve_font();
+        bool resolve_lengths(const LENGTH_BASIS& basis);
+        void keep_resolved_lengths(const COMPUTED_STYLE& old_style);
+
+        void mark_style_dirty();
+        void mark_self_style_dirty();
+        void mark_children_style_dirty();
+        void mark_layout_dirty();
+        void mark_paint_dirty();
+        void clear_style_dirty();
+        void clear_layout_dirty();
+        void clear_paint_dirty();
+        bool is_style_dirty() const;
+        bool is_self_style_dirty() const;
+        bool has_style_dirty_descendant() const;
+        bool needs_style_update() const;
+        bool have_children_changed() const;
+        const std::vector<ATTRIBUTE_CHANGE>& get_pending_attribute_changes() const;
+        void clear_pending_invalidations();
+        bool is_layout_dirty() const;
+        bool has_layout_dirty_descendant() const;
+        bool is_paint_dirty() const;
+        bool has_paint_dirty_descendant() const;
 
         const std::string get_tag_name() const;
         const std::string get_text_content() const;
+        const QString &get_text_utf16() const;
         const NODE_TYPE get_type() const;
         const DISPLAY_TYPE get_display_type() const;
 
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TASK_GROUP
+{
+    std::atomic<size_t> pending{0};
+};
+
+class WORK_STEALING_POOL
+{
+private:
+    struct TASK
+    {
+        std::function<void()> run;
+        TASK_GROUP *group = nullptr;
+    };
+
+    struct WORKER_QUEUE
+    {
+        std::mutex mutex;
+        std::deque<TASK> tasks;
+    };
+
+    std::vector<std::unique_ptr<WORKER_QUEUE>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_state_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_group_done;
+    std::atomic<size_t> m_queued{0};
+    std::atomic<size_t> m_idle{0};
+    std::atomic<size_t> m_next_queue{0};
+    bool m_stopping = false;
+
+    bool try_pop(size_t index, TASK &task);
+    bool try_steal(size_t thief_index, TASK &task);
+    void execute(TASK &task);
+    void worker_loop(size_t index);
+
+public:
+    explicit WORK_STEALING_POOL(size_t thread_count = std::thread::hardware_concurrency());
+    ~WORK_STEALING_POOL();
+
+    WORK_STEALING_POOL(const WORK_STEALING_POOL &) = delete;
+    WORK_STEALING_POOL &operator=(const WORK_STEALING_POOL &) = delete;
+
+    void submit(std::function<void()> task, TASK_GROUP *group = nullptr);
+    void wait(TASK_GROUP &group);
+
+    bool wants_work() const;
+    size_t thread_count() const;
+
+    static WORK_STEALING_POOL &shared();
+};
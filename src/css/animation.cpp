@@ -0,0 +1,367 @@
+#include "css/animation.h"
+#include "css/cssom.h"
+#include "css/layout_tree.h"
+#include "html/node.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    /**
+     * Interpolates one property between the keyframes that set it.
+     * Before the first or after the last such keyframe its value is held.
+     */
+    template <typename HAS, typename GET, typename BLEND, typename VALUE>
+    bool interpolate_frames(const std::vector<KEYFRAME> &frames, float progress, const TIMING_FUNCTION &timing,
+                            HAS has, GET get, BLEND blend, VALUE &value)
+    {
+        const KEYFRAME *before = nullptr;
+        const KEYFRAME *after = nullptr;
+        for (const auto &frame : frames)
+        {
+            if (!has(frame))
+            {
+                continue;
+            }
+            if (frame.offset <= progress)
+            {
+                before = &frame;
+            }
+            else
+            {
+                after = &frame;
+                break;
+            }
+        }
+
+        if (!before && !after)
+        {
+            return false;
+        }
+        if (!before || !after)
+        {
+            value = get(before ? *before : *after);
+            return true;
+        }
+
+        float t = (progress - before->offset) / (after->offset - before->offset);
+        value = blend(get(*before), get(*after), timing.progress(t));
+        return true;
+    }
+
+    /**
+     * Tells whether an element still belongs to the rendered document.
+     * Virtualized layout leaves out the blocks far from the viewport, so an
+     * element without a box may only be out of view; one that was removed
+     * or is inside display:none is not.
+     */
+    bool is_rendered(const std::shared_ptr<NODE> &node, const NODE *root)
+    {
+        for (std::shared_ptr<NODE> current = node; current; current = current->get_parent())
+        {
+            if (!current->is_style_resolved() || current->get_computed_style().display == DISPLAY_TYPE::NONE)
+            {
+                return false;
+            }
+            if (current.get() == root)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+/**
+ * \brief Computes an animation's values at a point in time.
+ *
+ * The timing function applies to each interval between keyframes, as in
+ * CSS. A transition holds its start value during its delay; a CSS animation
+ * has no effect before it starts or after it ends.
+ *
+ * \param animation The animation.
+ * \param now The current time in milliseconds.
+ * \param values Receives the values the animation sets.
+ * \return False once the animation has finished.
+ */
+bool ANIMATION_TIMELINE::sample(const ANIMATION &animation, double now, ANIMATED_VALUES &values)
+{
+    const ANIMATION_SPEC &spec = animation.spec;
+    double elapsed = now - animation.start - spec.delay;
+    if (elapsed < 0 && !animation.is_transition)
+    {
+        return true;
+    }
+
+    double local = std::max(0.0, elapsed) / spec.duration;
+    if (spec.iterations >= 0 && local >= spec.iterations)
+    {
+        return false;
+    }
+
+    double iteration = std::floor(local);
+    float progress = static_cast<float>(local - iteration);
+    if (spec.alternate && static_cast<long long>(iteration) % 2 == 1)
+    {
+        progress = 1 - progress;
+    }
+
+    float opacity = 1;
+    if (interpolate_frames(animation.frames, progress, spec.timing,
+                           [](const KEYFRAME &frame) { return frame.has_opacity; },
+                           [](const KEYFRAME &frame) { return frame.opacity; },
+                           [](float from, float to, float t) { return std::clamp(from + (to - from) * t, 0.0f, 1.0f); },
+                           opacity))
+    {
+        values.has_opacity = true;
+        values.opacity = opacity;
+    }
+
+    TRANSFORM transform;
+    if (interpolate_frames(animation.frames, progress, spec.timing,
+                           [](const KEYFRAME &frame) { return frame.has_transform; },
+                           [](const KEYFRAME &frame) { return frame.transform; },
+                           TRANSFORM::interpolate, transform))
+    {
+        values.has_transform = true;
+        values.transform = transform;
+    }
+    return true;
+}
+
+/**
+ * \brief Returns the values an element is currently shown with, where animated.
+ */
+ANIMATED_VALUES ANIMATION_TIMELINE::current_values(const NODE *node, double now) const
+{
+    ANIMATED_VALUES values;
+    for (bool transitions : {false, true})
+    {
+        for (const auto &animation : m_animations)
+        {
+            if (animation.key == node && animation.is_transition == transitions)
+            {
+                sample(animation, now, values);
+            }
+        }
+    }
+    return values;
+}
+
+/**
+ * \brief Starts a transition, replacing one already running on the same property.
+ */
+void ANIMATION_TIMELINE::start_transition(NODE &node, const TRANSITION &transition, const KEYFRAME &from,
+                                          const KEYFRAME &to, double now)
+{
+    const NODE *key = &node;
+    bool opacity = from.has_opacity;
+    m_animations.erase(std::remove_if(m_animations.begin(), m_animations.end(),
+                                      [&](const ANIMATION &animation) {
+                                          return animation.key == key && animation.is_transition &&
+                                                 animation.frames[0].has_opacity == opacity;
+                                      }),
+                       m_animations.end());
+
+    ANIMATION animation;
+    animation.node = node.shared_from_this();
+    animation.key = key;
+    animation.frames = {from, to};
+    animation.start = now;
+    animation.spec.duration = transition.duration;
+    animation.spec.delay = transition.delay;
+    animation.spec.timing = transition.timing;
+    animation.is_transition = true;
+    m_animations.push_back(std::move(animation));
+}
+
+/**
+ * \brief Replaces the CSS animations of an element with those of its style.
+ *
+ * Keyframes missing at 0% or 100% take the element's own opacity and
+ * transform. Names without a @keyframes rule are ignored.
+ */
+void ANIMATION_TIMELINE::start_animations(NODE &node, const COMPUTED_STYLE &style, const CSSOM &cssom, double now)
+{
+    const NODE *key = &node;
+    m_animations.erase(std::remove_if(m_animations.begin(), m_animations.end(),
+                                      [&](const ANIMATION &animation) {
+                                          return animation.key == key && !animation.is_transition;
+                                      }),
+                       m_animations.end());
+
+    KEYFRAME base;
+    base.has_opacity = true;
+    base.opacity = style.opacity;
+    base.has_transform = true;
+    base.transform = style.transform;
+
+    for (const auto &spec : style.animations)
+    {
+        const KEYFRAMES *keyframes = cssom.keyframes(spec.name);
+        if (!keyframes || keyframes->frames.empty())
+        {
+            continue;
+        }
+
+        ANIMATION animation;
+        animation.node = node.shared_from_this();
+        animation.key = key;
+        animation.frames = keyframes->frames;
+        animation.start = now;
+        animation.spec = spec;
+
+        if (animation.frames.front().offset > 0)
+        {
+            base.offset = 0;
+            animation.frames.insert(animation.frames.begin(), base);
+        }
+        if (animation.frames.back().offset < 1)
+        {
+            base.offset = 1;
+            animation.frames.push_back(base);
+        }
+        m_animations.push_back(std::move(animation));
+    }
+}
+
+/**
+ * \brief Starts the transitions and animations that a style change calls for.
+ *
+ * Called after each restyle or relayout with the new layout tree, not per
+ * frame. An element seen for the first time starts its CSS animations. For
+ * an element seen before, a changed opacity or transform starts a
+ * transition from the value currently shown, if its style has one for that
+ * property, and a changed animation list restarts its animations. Elements
+ * that were removed from the document or hidden with display:none lose
+ * their animations; those only left out of a virtualized layout keep them,
+ * so they do not restart when scrolled back into view.
+ *
+ * \param tree The current layout tree.
+ * \param cssom The stylesheet holding the @keyframes rules.
+ * \param now The current time in milliseconds.
+ */
+void ANIMATION_TIMELINE::update(const LAYOUT_TREE &tree, const CSSOM &cssom, double now)
+{
+    ++m_generation;
+
+    for (const LAYOUT_BOX &box : tree.boxes)
+    {
+        if (box.estimated_count > 0 || box.node->get_type() != NODE_TYPE::ELEMENT)
+        {
+            continue;
+        }
+
+        NODE &node = *box.node;
+        const COMPUTED_STYLE &style = *box.style;
+        auto [it, inserted] = m_states.try_emplace(&node);
+        NODE_STATE &state = it->second;
+
+        // A new element, possibly allocated where a removed one was
+        if (inserted || state.node.lock().get() != &node)
+        {
+            state.node = node.shared_from_this();
+            state.opacity = style.opacity;
+            state.transform = style.transform;
+            state.animations = style.animations;
+            state.generation = m_generation;
+            start_animations(node, style, cssom, now);
+            continue;
+        }
+        state.generation = m_generation;
+
+        if (style.opacity != state.opacity || style.transform != state.transform)
+        {
+            ANIMATED_VALUES shown = current_values(&node, now);
+
+            const TRANSITION *opacity_transition = style.transition_for("opacity");
+            if (style.opacity != state.opacity && opacity_transition)
+            {
+                KEYFRAME from, to;
+                from.has_opacity = to.has_opacity = true;
+                from.opacity = shown.has_opacity ? shown.opacity : state.opacity;
+                to.opacity = style.opacity;
+                to.offset = 1;
+                start_transition(node, *opacity_transition, from, to, now);
+            }
+
+            const TRANSITION *transform_transition = style.transition_for("transform");
+            if (style.transform != state.transform && transform_transition)
+            {
+                KEYFRAME from, to;
+                from.has_transform = to.has_transform = true;
+                from.transform = shown.has_transform ? shown.transform : state.transform;
+                to.transform = style.transform;
+                to.offset = 1;
+                start_transition(node, *transform_transition, from, to, now);
+            }
+
+            state.opacity = style.opacity;
+            state.transform = style.transform;
+        }
+
+        if (style.animations != state.animations)
+        {
+            start_animations(node, style, cssom, now);
+            state.animations = style.animations;
+        }
+    }
+
+    const NODE *root = tree.empty() ? nullptr : tree.boxes[0].node;
+    for (auto it = m_states.begin(); it != m_states.end();)
+    {
+        bool keep = it->second.generation == m_generation || is_rendered(it->second.node.lock(), root);
+        it = keep ? std::next(it) : m_states.erase(it);
+    }
+
+    m_animations.erase(std::remove_if(m_animations.begin(), m_animations.end(),
+                                      [&](const ANIMATION &animation) {
+                                          auto state = m_states.find(animation.key);
+                                          return state == m_states.end() || animation.node.expired();
+                                      }),
+                       m_animations.end());
+}
+
+/**
+ * \brief Computes the animated values of every element for a frame.
+ *
+ * Transitions are applied over CSS animations of the same property.
+ * Finished animations are removed; the element then shows its style's value.
+ *
+ * \param now The current time in milliseconds.
+ * \param values Receives the values per element; elements that are not
+ *               animated are left out.
+ * \return True while animations are left running.
+ */
+bool ANIMATION_TIMELINE::sample(double now, std::unordered_map<const NODE *, ANIMATED_VALUES> &values)
+{
+    values.clear();
+
+    m_animations.erase(std::remove_if(m_animations.begin(), m_animations.end(),
+                                      [&](const ANIMATION &animation) {
+                                          ANIMATED_VALUES finished;
+                                          return animation.node.expired() || !sample(animation, now, finished);
+                                      }),
+                       m_animations.end());
+
+    for (bool transitions : {false, true})
+    {
+        for (const auto &animation : m_animations)
+        {
+            if (animation.is_transition == transitions)
+            {
+                sample(animation, now, values[animation.key]);
+            }
+        }
+    }
+    return running();
+}
+
+/**
+ * \brief Stops all animations and forgets every element, as for a new document.
+ */
+void ANIMATION_TIMELINE::clear()
+{
+    m_animations.clear();
+    m_states.clear();
+}
@@ -1,63 +1,474 @@
 #include "css/apply_style.h"
 #include "css/css_parser.h"
-#include <queue>
-#include <util.h>
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+/**
+ * \brief Collects the style changes found by concurrent restyle tasks.
+ *
+ * Marking a node layout- or paint-dirty writes to its ancestors, so tasks
+ * only record what changed and the calling thread applies the bits after
+ * the pool is done.
+ */
+struct STYLE_CHANGE_LOG
+{
+    std::mutex mutex;
+    std::vector<std::pair<NODE *, STYLE_CHANGE>> entries;
+};
+
+/**
+ * \brief Marks a restyled node for relayout or repaint, depending on what changed.
+ */
+static void record_style_change(NODE &node, STYLE_CHANGE change)
+{
+    if (change == STYLE_CHANGE::Layout) {
+        node.mark_layout_dirty();
+    }
+    else if (change == STYLE_CHANGE::Paint) {
+        node.mark_paint_dirty();
+    }
+}
+
+/**
+ * \brief Computes the style of a single node from its parent's computed style.
+ *
+ * Starts from initial values, initializes inherited properties from the parent
+ * (if any), then applies the matching author rules from the CSSOM and finally
+ * the inline style attribute, and binds the result to the shared font cache.
+ * Only the node itself is written, so distinct nodes can be styled concurrently.
+ *
+ * \param node The node to style.
+ * \param parent_style The already computed style of the parent, or nullptr for the root.
+ * \param cssom The immutable CSSOM to match against.
+ */
+void compute_node_style(NODE &node, const COMPUTED_STYLE *parent_style, const CSSOM &cssom)
+{
+    node.reset_style();
+
+    if (parent_style) {
+        node.set_style("color", parent_style->inherit_color());
+        node.set_style("font-size", parent_style->inherit_font_size());
+        node.set_style("font-weight", parent_style->inherit_font_weight());
+        node.set_style("font-style", parent_style->inherit_font_style());
+        node.set_style("font-family", parent_style->inherit_font_family());
+        node.set_style("line-height", parent_style->inherit_line_height());
+        node.set_style("text-align", parent_style->inherit_text_align());
+        node.set_style("visibility", parent_style->inherit_visibility());
+        node.set_style("text-decoration", parent_style->inherit_text_decoration());
+    }
+
+    for (const CSS_RULE *rule : cssom.matching_rules(node)) {
+        for (const auto &decl : rule->declarations) {
+            node.set_style(decl.property, decl.value);
+        }
+    }
+
+    std::string inline_style = node.get_attribute("style");
+    for (const auto& [property, value] : parse_inline_style(inline_style)) {
+        node.set_style(property, value);
+    }
+
+    node.resolve_font();
+    node.set_style_resolved(true);
+}
+
+/**
+ * \brief Marks every descendant of a display:none node as unstyled.
+ *
+ * The walk stops at nodes that are already unresolved, so a subtree that
+ * has never been visible costs nothing beyond its direct children.
+ *
+ * \param node The node whose display resolved to none.
+ */
+static void discard_hidden_styles(NODE &node)
+{
+    std::vector<NODE *> stack;
+    for (const auto &child : node.get_children()) {
+        stack.push_back(child.get());
+    }
+
+    while (!stack.empty()) {
+        NODE *current = stack.back();
+        stack.pop_back();
+
+        if (!current->is_style_resolved()) {
+            continue;
+        }
+
+        current->set_style_resolved(false);
+        for (const auto &child : current->get_children()) {
+            stack.push_back(child.get());
+        }
+    }
+}
+
+/**
+ * \brief Styles a subtree depth-first, splitting work off lazily to idle workers.
+ *
+ * Nodes are processed from a local stack. Whenever the pool has an idle worker,
+ * the oldest pending entry (the shallowest, and so usually largest, subtree) is
+ * handed to the pool as a separate task. Children inherit through a pointer to
+ * their parent's computed style instead of a copied COMPUTED_STYLE.
+ *
+ * \param node The subtree root to style.
+ * \param parent_style The computed style of the subtree root's parent, or nullptr.
+ * \param cssom The immutable CSSOM to match against.
+ * \param pool The pool that receives split-off subtrees.
+ * \param group The task group the caller waits on.
+ * \param changes If set, receives every node whose style changed and how;
+ *                nullptr for a first styling pass, where everything is new.
+ */
+static void style_subtree(NODE *node, const COMPUTED_STYLE *parent_style, const CSSOM &cssom,
+                          WORK_STEALING_POOL &pool, TASK_GROUP &group, STYLE_CHANGE_LOG *changes)
+{
+    std::vector<std::pair<NODE *, STYLE_CHANGE>> local_changes;
+    std::vector<std::pair<NODE *, const COMPUTED_STYLE *>> stack;
+    stack.push_back({node, parent_style});
+    size_t bottom = 0;
+
+    while (bottom < stack.size()) {
+        if (stack.size() - bottom > 1 && pool.wants_work()) {
+            auto [split_node, split_parent_style] = stack[bottom++];
+            pool.submit([split_node, split_parent_style, &cssom, &pool, &group, changes]() {
+                style_subtree(split_node, split_parent_style, cssom, pool, group, changes);
+            }, &group);
+            continue;
+        }
+
+        auto [current_node, current_parent_style] = stack.back();
+        stack.pop_back();
+
+        if (changes) {
+            bool was_resolved = current_node->is_style_resolved();
+            COMPUTED_STYLE old_style = current_node->get_computed_style();
+            compute_node_style(*current_node, current_parent_style, cssom);
+
+            STYLE_CHANGE change = was_resolved
+                                      ? COMPUTED_STYLE::diff(old_style, current_node->get_computed_style())
+                                      : STYLE_CHANGE::Layout;
+            if (change != STYLE_CHANGE::Layout) {
+                current_node->keep_resolved_lengths(old_style);
+            }
+            if (change != STYLE_CHANGE::None) {
+                local_changes.push_back({current_node, change});
+            }
+        }
+        else {
+            compute_node_style(*current_node, current_parent_style, cssom);
+        }
+        current_node->clear_style_dirty();
+
+        const COMPUTED_STYLE &current_style = current_node->get_computed_style();
+
+        // Layout never enters a display:none subtree, so its styles are never
+        // computed: only the hidden root itself is resolved.
+        if (current_style.display == DISPLAY_TYPE::NONE) {
+            discard_hidden_styles(*current_node);
+        }
+        else {
+            const auto &children = current_node->get_children();
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                stack.push_back({child->get(), &current_style});
+            }
+        }
+
+        if (bottom == stack.size()) {
+            stack.clear();
+            bottom = 0;
+        }
+    }
+
+    if (changes && !local_changes.empty()) {
+        std::lock_guard<std::mutex> lock(changes->mutex);
+        changes->entries.insert(changes->entries.end(), local_changes.begin(), local_changes.end());
+    }
+}
 
 /**
  * \brief Applies CSS styles to a DOM tree using cascade and inheritance.
  *
- * Performs a breadth-first traversal of the DOM tree, applying CSS rules from the CSSOM
- * and inline styles to each node. Handles style inheritance from parent to child nodes,
- * initializing inherited properties for all elements. Processes author styles on top of
- * default inherited values.
+ * Styles independent subtrees concurrently on the shared work-stealing pool.
+ * Descendants of display:none elements are skipped entirely: layout never
+ * visits them, so their styles are left unresolved rather than computed.
+ * Every node is written by exactly one task and only after its parent is done,
+ * so inheritance reads a finished parent style. Matching runs against the CSSOM
+ * through const access only.
  *
  * \param node The root Node of the DOM tree to style.
  * \param cssom The CSSOM (CSS Object Model) containing parsed CSS rules and selectors.
  */
-void apply_style(std::shared_ptr<NODE> node, CSSOM &cssom) {
-    static bool setters_initialized = false;
-    if (!setters_initialized) {
-        COMPUTED_STYLE::init_setters();
-        setters_initialized = true;
-    }
-    
-    std::queue<std::pair<std::shared_ptr<NODE>, COMPUTED_STYLE>> q;
-    
-    COMPUTED_STYLE root_style; 
-    q.push({node, root_style});
-    
-    while (!q.empty()) {
-        auto [current_node, parent_style] = q.front();
-        q.pop();
-        
-        if (current_node != node) {  
-            current_node->set_style("color", parent_style.inherit_color());
-            current_node->set_style("font-size", parent_style.inherit_font_size());
-            current_node->set_style("font-weight", parent_style.inherit_font_weight());
-            current_node->set_style("font-style", parent_style.inherit_font_style());
-            current_node->set_style("font-family", parent_style.inherit_font_family());
-            current_node->set_style("line-height", parent_style.inherit_line_height());
-            current_node->set_style("text-align", parent_style.inherit_text_align());
-            current_node->set_style("visibility", parent_style.inherit_visibility());
-            current_node->set_style("text-decoration", parent_style.inherit_text_decoration());
-        }
-        
-        auto matched_rules = cssom.matching_rules(current_node);
-        for (const auto &rule : matched_rules) {
-            for (const auto &decl : rule.declarations) {
-                current_node->set_style(decl.property, decl.value);
-            }
-        }
-        
-        std::string inline_style = current_node->get_attribute("style");
-        for (const auto& [property, value] : parse_inline_style(inline_style)) {
-            current_node->set_style(property, value);
-        }
-        
-        COMPUTED_STYLE current_style = current_node->get_all_styles();
-        
-        for (auto child : current_node->get_children()) {
-            q.push({child, current_style});
-        }
-    }
-}
\ No newline at end of file
+void apply_style(std::shared_ptr<NODE> node, const CSSOM &cssom) {
+    if (!node) {
+        return;
+    }
+
+    COMPUTED_STYLE::init_setters();
+
+    WORK_STEALING_POOL &pool = WORK_STEALING_POOL::shared();
+    TASK_GROUP group;
+
+    style_subtree(node.get(), nullptr, cssom, pool, group, nullptr);
+    pool.wait(group);
+}
+
+/**
+ * \brief Reports whether any inherited property differs between two styles.
+ *
+ * When a node is restyled on its own, its children only need to be
+ * re-cascaded if one of these changed.
+ */
+static bool inherited_style_changed(const COMPUTED_STYLE &old_style, const COMPUTED_STYLE &new_style)
+{
+    return old_style.color != new_style.color ||
+           old_style.font_size != new_style.font_size ||
+           old_style.font_weight != new_style.font_weight ||
+           old_style.font_style != new_style.font_style ||
+           old_style.font_family != new_style.font_family ||
+           old_style.line_height != new_style.line_height ||
+           old_style.text_align != new_style.text_align ||
+           old_style.visibility != new_style.visibility ||
+           old_style.text_decoration != new_style.text_decoration;
+}
+
+/**
+ * \brief Marks the element siblings that follow a node as needing a restyle.
+ *
+ * \param node The node whose change can affect "+" and "~" selectors.
+ */
+static void mark_following_siblings(NODE &node)
+{
+    auto parent = node.get_parent();
+    if (!parent) {
+        return;
+    }
+
+    bool after_node = false;
+    for (const auto &sibling : parent->get_children()) {
+        if (after_node && sibling->get_type() == NODE_TYPE::ELEMENT) {
+            sibling->mark_style_dirty();
+        }
+        if (sibling.get() == &node) {
+            after_node = true;
+        }
+    }
+}
+
+/**
+ * \brief Turns queued attribute and structure changes into dirty bits.
+ *
+ * Each queued change is looked up in the CSSOM's invalidation sets: a class,
+ * id or attribute that no selector uses is dropped, one used only in subject
+ * position dirties the element alone, and one used before a combinator
+ * dirties the element's subtree and/or its following siblings. Inline style
+ * changes always dirty the element itself.
+ *
+ * \param root The root of the styled tree.
+ * \param cssom The CSSOM whose invalidation sets decide the scope.
+ */
+static void schedule_invalidations(NODE &root, const CSSOM &cssom)
+{
+    std::vector<NODE *> stack;
+    stack.push_back(&root);
+
+    while (!stack.empty()) {
+        NODE *current = stack.back();
+        stack.pop_back();
+
+        int flags = INVALIDATE_NONE;
+        for (const auto &change : current->get_pending_attribute_changes()) {
+            if (change.name == "class") {
+                std::string old_value = change.old_value;
+                std::string new_value = change.new_value;
+                std::vector<std::string> old_classes = split(old_value, ' ');
+                std::vector<std::string> new_classes = split(new_value, ' ');
+
+                for (const auto &class_name : old_classes) {
+                    if (std::find(new_classes.begin(), new_classes.end(), class_name) == new_classes.end()) {
+                        flags |= cssom.class_invalidation(class_name);
+                    }
+                }
+                for (const auto &class_name : new_classes) {
+                    if (std::find(old_classes.begin(), old_classes.end(), class_name) == old_classes.end()) {
+                        flags |= cssom.class_invalidation(class_name);
+                    }
+                }
+            }
+            else if (change.name == "id") {
+                flags |= cssom.id_invalidation(change.old_value) | cssom.id_invalidation(change.new_value);
+            }
+            else if (change.name == "style") {
+                flags |= INVALIDATE_SELF;
+            }
+            flags |= cssom.attribute_invalidation(change.name);
+        }
+
+        if (current->have_children_changed() && cssom.has_sibling_selectors()) {
+            for (const auto &child : current->get_children()) {
+                child->mark_style_dirty();
+            }
+        }
+        current->clear_pending_invalidations();
+
+        if (flags & INVALIDATE_DESCENDANTS) {
+            current->mark_style_dirty();
+        }
+        else if (flags & INVALIDATE_SELF) {
+            current->mark_self_style_dirty();
+        }
+        if (flags & INVALIDATE_SIBLINGS) {
+            mark_following_siblings(*current);
+        }
+
+        if (current->has_style_dirty_descendant()) {
+            for (const auto &child : current->get_children()) {
+                if (child->needs_style_update()) {
+                    stack.push_back(child.get());
+                }
+            }
+        }
+    }
+}
+
+/**
+ * \brief Marks the elements matched by rules whose media condition toggled.
+ *
+ * Only the subjects of the toggled rules' selectors receive their
+ * declarations, so each matched element is dirtied on its own; its children
+ * follow in update_style if an inherited value changes. Elements inside
+ * display:none subtrees are skipped like in any restyle.
+ *
+ * \param root The root of the styled tree.
+ * \param cssom The CSSOM whose media conditions were updated.
+ * \param rules The toggled rules, as returned by CSSOM::update_media.
+ */
+void invalidate_media_rules(std::shared_ptr<NODE> root, const CSSOM &cssom, const std::vector<size_t> &rules)
+{
+    if (!root || rules.empty()) {
+        return;
+    }
+
+    std::vector<NODE *> stack;
+    stack.push_back(root.get());
+
+    while (!stack.empty()) {
+        NODE *current = stack.back();
+        stack.pop_back();
+
+        if (!current->is_style_resolved()) {
+            continue;
+        }
+
+        bool matched = false;
+        for (size_t i = 0; !matched && i < rules.size(); ++i) {
+            for (const auto &selector : cssom.selector_list(rules[i])) {
+                if (selector_matches(selector, *current)) {
+                    matched = true;
+                    break;
+                }
+            }
+        }
+        if (matched) {
+            current->mark_self_style_dirty();
+        }
+
+        if (current->get_computed_style().display != DISPLAY_TYPE::NONE) {
+            for (const auto &child : current->get_children()) {
+                stack.push_back(child.get());
+            }
+        }
+    }
+}
+
+/**
+ * \brief Restyles only the parts of a styled tree that were invalidated.
+ *
+ * First converts queued attribute changes into dirty bits through the CSSOM's
+ * invalidation sets, then follows the dirty bits down from the root. A node
+ * dirty on its own is recomputed alone, and its children are re-cascaded only
+ * if its inherited values changed; a subtree-dirty node is restyled together
+ * with its subtree on the shared pool. Clean subtrees are never visited, and
+ * dirty nodes inside display:none subtrees are left for when they become
+ * visible. Each restyled node is compared with its previous style and marked
+ * layout-dirty if a box may move or resize, paint-dirty if only its
+ * appearance changed, and left alone otherwise.
+ *
+ * \param root The root Node of a tree that has been styled with apply_style.
+ * \param cssom The CSSOM the tree was styled with.
+ */
+void update_style(std::shared_ptr<NODE> root, const CSSOM &cssom)
+{
+    if (!root) {
+        return;
+    }
+
+    COMPUTED_STYLE::init_setters();
+    schedule_invalidations(*root, cssom);
+
+    WORK_STEALING_POOL &pool = WORK_STEALING_POOL::shared();
+    TASK_GROUP group;
+    STYLE_CHANGE_LOG changes;
+
+    std::vector<NODE *> stack;
+    stack.push_back(root.get());
+
+    while (!stack.empty()) {
+        NODE *current = stack.back();
+        stack.pop_back();
+
+        std::shared_ptr<NODE> parent = current->get_parent();
+        bool parent_visible = !parent || (parent->is_style_resolved() &&
+                                          parent->get_computed_style().display != DISPLAY_TYPE::NONE);
+        const COMPUTED_STYLE *parent_style = parent ? &parent->get_computed_style() : nullptr;
+
+        if (current->is_style_dirty()) {
+            if (parent_visible) {
+                pool.submit([current, parent_style, &cssom, &pool, &group, &changes]() {
+                    style_subtree(current, parent_style, cssom, pool, group, &changes);
+                }, &group);
+            }
+            continue;
+        }
+
+        if (current->is_self_style_dirty() && parent_visible) {
+            COMPUTED_STYLE old_style = current->get_computed_style();
+            bool was_hidden = old_style.display == DISPLAY_TYPE::NONE;
+
+            compute_node_style(*current, parent_style, cssom);
+
+            const COMPUTED_STYLE &new_style = current->get_computed_style();
+            bool is_hidden = new_style.display == DISPLAY_TYPE::NONE;
+            STYLE_CHANGE change = COMPUTED_STYLE::diff(old_style, new_style);
+            if (change != STYLE_CHANGE::Layout) {
+                current->keep_resolved_lengths(old_style);
+            }
+            record_style_change(*current, change);
+
+            if (is_hidden) {
+                discard_hidden_styles(*current);
+            }
+            else if (was_hidden || inherited_style_changed(old_style, new_style)) {
+                current->mark_children_style_dirty();
+            }
+        }
+
+        bool visible = current->is_style_resolved() && current->get_computed_style().display != DISPLAY_TYPE::NONE;
+        bool descend = visible && parent_visible && current->has_style_dirty_descendant();
+        current->clear_style_dirty();
+
+        if (descend) {
+            for (const auto &child : current->get_children()) {
+                if (child->needs_style_update()) {
+                    stack.push_back(child.get());
+                }
+            }
+        }
+    }
+
+    pool.wait(group);
+
+    for (const auto &[node, change] : changes.entries) {
+        record_style_change(*node, change);
+    }
+}
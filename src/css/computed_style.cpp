@@ -1,11 +1,53 @@
 #include "css/computed_style.h"
 #include "html/node.h"
+#include "util_functions.h"
 #include <QDebug>
+#include <algorithm>
+#include <cmath>
 #include <sstream>
+#include <mutex>
 
 std::unordered_map<std::string, COMPUTED_STYLE::Setter> COMPUTED_STYLE::setters;
 
-static bool initialized = false;
+static std::once_flag setters_once;
+
+/**
+ * \brief Splits a value at a separator, ignoring separators inside parentheses.
+ *
+ * \param value The value, e.g. "opacity 1s cubic-bezier(0, 0, 1, 1), transform 2s".
+ * \param separator The separator, ',' for lists or ' ' for the words of an item.
+ * \return The trimmed, non-empty parts.
+ */
+static std::vector<std::string> split_top_level(const std::string &value, char separator)
+{
+    std::vector<std::string> parts;
+    std::string part;
+    int depth = 0;
+
+    for (char c : value)
+    {
+        if (c == '(')
+            ++depth;
+        else if (c == ')')
+            --depth;
+
+        bool separates = separator == ' ' ? std::isspace(static_cast<unsigned char>(c)) != 0 : c == separator;
+        if (separates && depth == 0)
+        {
+            trim(part);
+            if (!part.empty())
+                parts.push_back(part);
+            part.clear();
+            continue;
+        }
+        part += c;
+    }
+
+    trim(part);
+    if (!part.empty())
+        parts.push_back(part);
+    return parts;
+}
 
 // ============================================================================
 // Enum Parser Helper Functions
@@ -78,6 +120,328 @@ POSITION_TYPE COMPUTED_STYLE::parse_position_type(const std::string &value)
     return POSITION_TYPE::Static;
 }
 
+/**
+ * \brief Parses a CSS time such as "0.3s" or "200ms".
+ *
+ * \param value The time value.
+ * \param milliseconds Receives the time in milliseconds.
+ * \return False if the value is not a time.
+ */
+bool COMPUTED_STYLE::parse_time(const std::string &value, float &milliseconds)
+{
+    size_t unit_start = 0;
+    float number = 0;
+    try
+    {
+        number = std::stof(value, &unit_start);
+    }
+    catch (...)
+    {
+        return false;
+    }
+
+    std::string unit = value.substr(unit_start);
+    if (unit == "ms")
+    {
+        milliseconds = number;
+        return true;
+    }
+    if (unit == "s")
+    {
+        milliseconds = number * 1000;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * \brief Parses a timing function keyword or cubic-bezier().
+ *
+ * \param value The value, e.g. "ease-in" or "cubic-bezier(0.1, 0.7, 1, 0.1)".
+ * \param timing Receives the curve.
+ * \return False if the value is not a supported timing function.
+ */
+bool COMPUTED_STYLE::parse_timing_function(const std::string &value, TIMING_FUNCTION &timing)
+{
+    if (value == "linear") { timing = {0, 0, 1, 1}; return true; }
+    if (value == "ease") { timing = {0.25f, 0.1f, 0.25f, 1}; return true; }
+    if (value == "ease-in") { timing = {0.42f, 0, 1, 1}; return true; }
+    if (value == "ease-out") { timing = {0, 0, 0.58f, 1}; return true; }
+    if (value == "ease-in-out") { timing = {0.42f, 0, 0.58f, 1}; return true; }
+
+    if (value.rfind("cubic-bezier(", 0) == 0 && value.back() == ')')
+    {
+        std::string inner = value.substr(13, value.size() - 14);
+        std::vector<std::string> points = split(inner, ',');
+        if (points.size() != 4)
+        {
+            return false;
+        }
+        timing.x1 = std::clamp(parse_string_to_float(points[0]), 0.0f, 1.0f);
+        timing.y1 = parse_string_to_float(points[1]);
+        timing.x2 = std::clamp(parse_string_to_float(points[2]), 0.0f, 1.0f);
+        timing.y2 = parse_string_to_float(points[3]);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * \brief Parses a transform list into translate, rotate and scale.
+ *
+ * Supports translate(), translateX/Y(), scale(), scaleX/Y() and rotate()
+ * in deg, rad or turn. Translations and rotations add up and scales
+ * multiply; the order of the functions is not kept, so a translation is
+ * never rotated or scaled by the functions before it.
+ *
+ * \param value The transform value, e.g. "translate(10px, 0) rotate(45deg)".
+ * \return The transform; "none" and unknown functions give the identity.
+ */
+TRANSFORM COMPUTED_STYLE::parse_transform(const std::string &value)
+{
+    TRANSFORM transform;
+
+    for (const auto &function : split_top_level(value, ' '))
+    {
+        size_t open = function.find('(');
+        if (open == std::string::npos || function.back() != ')')
+        {
+            continue;
+        }
+
+        std::string name = function.substr(0, open);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        std::string inner = function.substr(open + 1, function.size() - open - 2);
+        std::vector<std::string> arguments = split(inner, ',');
+        if (arguments.empty())
+        {
+            continue;
+        }
+        for (auto &argument : arguments)
+        {
+            trim(argument);
+        }
+
+        float first = parse_string_to_float(arguments[0]);
+        float second = arguments.size() > 1 ? parse_string_to_float(arguments[1]) : 0;
+
+        if (name == "translate")
+        {
+            transform.translate_x += first;
+            transform.translate_y += second;
+        }
+        else if (name == "translatex")
+        {
+            transform.translate_x += first;
+        }
+        else if (name == "translatey")
+        {
+            transform.translate_y += first;
+        }
+        else if (name == "scale")
+        {
+            transform.scale_x *= first;
+            transform.scale_y *= arguments.size() > 1 ? second : first;
+        }
+        else if (name == "scalex")
+        {
+            transform.scale_x *= first;
+        }
+        else if (name == "scaley")
+        {
+            transform.scale_y *= first;
+        }
+        else if (name == "rotate")
+        {
+            const std::string &angle = arguments[0];
+            if (angle.size() > 4 && angle.compare(angle.size() - 4, 4, "turn") == 0)
+                transform.rotate += first * 360;
+            else if (angle.size() > 3 && angle.compare(angle.size() - 3, 3, "rad") == 0)
+                transform.rotate += first * 180 / 3.14159265f;
+            else
+                transform.rotate += first;
+        }
+    }
+
+    return transform;
+}
+
+/**
+ * \brief Parses the transition shorthand.
+ *
+ * Each comma-separated item names a property (or "all") with a duration,
+ * an optional delay and an optional timing function, in any order; the
+ * first time is the duration and the second the delay.
+ *
+ * \param value The transition value, e.g. "opacity 0.3s ease-out, transform 1s".
+ * \return The transitions; empty for "none".
+ */
+std::vector<TRANSITION> COMPUTED_STYLE::parse_transitions(const std::string &value)
+{
+    std::vector<TRANSITION> transitions;
+
+    for (const auto &item : split_top_level(value, ','))
+    {
+        TRANSITION transition;
+        transition.property = "all";
+        int times = 0;
+
+        for (const auto &word : split_top_level(item, ' '))
+        {
+            float time = 0;
+            if (parse_time(word, time))
+            {
+                (times++ == 0 ? transition.duration : transition.delay) = time;
+            }
+            else if (!parse_timing_function(word, transition.timing))
+            {
+                transition.property = word;
+            }
+        }
+
+        if (transition.property != "none" && transition.duration > 0)
+        {
+            transitions.push_back(transition);
+        }
+    }
+
+    return transitions;
+}
+
+/**
+ * \brief Parses the animation shorthand.
+ *
+ * Each comma-separated item holds a @keyframes name, a duration, an
+ * optional delay, timing function, iteration count ("infinite" or a number)
+ * and direction ("alternate"). Fill modes and play states are accepted but
+ * ignored.
+ *
+ * \param value The animation value, e.g. "pulse 2s ease-in-out infinite alternate".
+ * \return The animations; empty for "none".
+ */
+std::vector<ANIMATION_SPEC> COMPUTED_STYLE::parse_animations(const std::string &value)
+{
+    static const std::vector<std::string> ignored = {"normal", "reverse", "alternate-reverse", "none", "forwards",
+                                                     "backwards", "both", "running", "paused"};
+    std::vector<ANIMATION_SPEC> animations;
+
+    for (const auto &item : split_top_level(value, ','))
+    {
+        ANIMATION_SPEC animation;
+        int times = 0;
+
+        for (const auto &word : split_top_level(item, ' '))
+        {
+            float time = 0;
+            if (parse_time(word, time))
+            {
+                (times++ == 0 ? animation.duration : animation.delay) = time;
+            }
+            else if (word == "infinite")
+            {
+                animation.iterations = -1;
+            }
+            else if (word == "alternate")
+            {
+                animation.alternate = true;
+            }
+            else if (std::isdigit(static_cast<unsigned char>(word[0])) || word[0] == '.')
+            {
+                animation.iterations = parse_string_to_float(word, 1);
+            }
+            else if (!parse_timing_function(word, animation.timing) &&
+                     std::find(ignored.begin(), ignored.end(), word) == ignored.end())
+            {
+                animation.name = word;
+            }
+        }
+
+        if (!animation.name.empty() && animation.duration > 0)
+        {
+            animations.push_back(animation);
+        }
+    }
+
+    return animations;
+}
+
+/**
+ * \brief Maps the elapsed fraction of an animation to its progress.
+ *
+ * Solves the curve's x(s) = t by Newton's method, falling back to
+ * bisection where the slope is too flat, and returns y(s).
+ *
+ * \param t The elapsed fraction, in [0, 1].
+ * \return The eased progress; may leave [0, 1] for overshooting curves.
+ */
+float TIMING_FUNCTION::progress(float t) const
+{
+    if (t <= 0 || t >= 1)
+    {
+        return t <= 0 ? 0.0f : 1.0f;
+    }
+
+    auto curve = [](float p1, float p2, float s)
+    {
+        return 3 * (1 - s) * (1 - s) * s * p1 + 3 * (1 - s) * s * s * p2 + s * s * s;
+    };
+    auto slope = [](float p1, float p2, float s)
+    {
+        return 3 * (1 - s) * (1 - s) * p1 + 6 * (1 - s) * s * (p2 - p1) + 3 * s * s * (1 - p2);
+    };
+
+    float s = t;
+    for (int i = 0; i < 8; ++i)
+    {
+        float error = curve(x1, x2, s) - t;
+        float derivative = slope(x1, x2, s);
+        if (std::fabs(error) < 1e-5f)
+        {
+            return curve(y1, y2, s);
+        }
+        if (std::fabs(derivative) < 1e-6f)
+        {
+            break;
+        }
+        s -= error / derivative;
+    }
+
+    float low = 0, high = 1;
+    s = t;
+    for (int i = 0; i < 32; ++i)
+    {
+        float x = curve(x1, x2, s);
+        if (std::fabs(x - t) < 1e-5f)
+        {
+            break;
+        }
+        (x < t ? low : high) = s;
+        s = (low + high) / 2;
+    }
+    return curve(y1, y2, s);
+}
+
+/**
+ * \brief Blends two transforms component by component.
+ *
+ * \param from The transform at t = 0.
+ * \param to The transform at t = 1.
+ * \param t The progress.
+ * \return The blended transform.
+ */
+TRANSFORM TRANSFORM::interpolate(const TRANSFORM &from, const TRANSFORM &to, float t)
+{
+    auto blend = [t](float a, float b) { return a + (b - a) * t; };
+
+    TRANSFORM result;
+    result.translate_x = blend(from.translate_x, to.translate_x);
+    result.translate_y = blend(from.translate_y, to.translate_y);
+    result.scale_x = blend(from.scale_x, to.scale_x);
+    result.scale_y = blend(from.scale_y, to.scale_y);
+    result.rotate = blend(from.rotate, to.rotate);
+    return result;
+}
+
 /**
  * \brief Parses CSS spacing shorthand values (margin/padding with 1-4 values).
  * 
@@ -86,9 +450,11 @@ POSITION_TYPE COMPUTED_STYLE::parse_position_type(const std::string &value)
  * - 2 values: [vertical, horizontal]
  * - 3 values: [top, horizontal, bottom]
  * - 4+ values: [top, right, bottom, left]
+ *
+ * The sides are returned unparsed, so each of them can keep a relative unit.
  * 
  * \param value CSS spacing shorthand string
- * \return SPACING_VALUES struct with top, right, bottom, left values
+ * \return SPACING_VALUES struct with top, right, bottom, left values ("0" if missing)
  */
 COMPUTED_STYLE::SPACING_VALUES COMPUTED_STYLE::parse_spacing_shorthand(const std::string &value)
 {
@@ -100,47 +466,416 @@ COMPUTED_STYLE::SPACING_VALUES COMPUTED_STYLE::parse_spacing_shorthand(const std
         parts.push_back(part);
     }
 
-    float val_top = 0, val_right = 0, val_bottom = 0, val_left = 0;
+    std::string val_top = "0", val_right = "0", val_bottom = "0", val_left = "0";
 
     if (parts.size() == 1) {
         // All sides
-        float val = parse_string_to_float(parts[0], 0);
-        val_top = val_right = val_bottom = val_left = val;
+        val_top = val_right = val_bottom = val_left = parts[0];
     }
     else if (parts.size() == 2) {
         // Vertical, Horizontal
-        float vertical = parse_string_to_float(parts[0], 0);
-        float horizontal = parse_string_to_float(parts[1], 0);
-        val_top = val_bottom = vertical;
-        val_left = val_right = horizontal;
+        val_top = val_bottom = parts[0];
+        val_left = val_right = parts[1];
     }
     else if (parts.size() == 3) {
         // Top, Horizontal, Bottom
-        val_top = parse_string_to_float(parts[0], 0);
-        float horizontal = parse_string_to_float(parts[1], 0);
-        val_bottom = parse_string_to_float(parts[2], 0);
-        val_left = val_right = horizontal;
+        val_top = parts[0];
+        val_left = val_right = parts[1];
+        val_bottom = parts[2];
     }
     else if (parts.size() >= 4) {
         // Top, Right, Bottom, Left
-        val_top = parse_string_to_float(parts[0], 0);
-        val_right = parse_string_to_float(parts[1], 0);
-        val_bottom = parse_string_to_float(parts[2], 0);
-        val_left = parse_string_to_float(parts[3], 0);
+        val_top = parts[0];
+        val_right = parts[1];
+        val_bottom = parts[2];
+        val_left = parts[3];
     }
 
     return COMPUTED_STYLE::SPACING_VALUES{val_top, val_right, val_bottom, val_left};
 }
 
+// ============================================================================
+// Relative Lengths
+// ============================================================================
+
+/**
+ * \brief Parses a CSS length into its number and unit.
+ *
+ * Absolute units other than px are kept as their number, as
+ * parse_string_to_float always did.
+ *
+ * \param value The length string (e.g., "10px", "50%", "2em", "0").
+ * \param length Receives the parsed value.
+ * \return False if the string does not start with a number.
+ */
+bool COMPUTED_STYLE::parse_length(const std::string &value, LENGTH &length)
+{
+    size_t unit_start = 0;
+    try
+    {
+        length.value = std::stof(value, &unit_start);
+    }
+    catch (...)
+    {
+        return false;
+    }
+
+    std::string unit = value.substr(unit_start);
+    if (unit == "%")
+        length.unit = LENGTH_UNIT::Percent;
+    else if (unit == "em")
+        length.unit = LENGTH_UNIT::Em;
+    else if (unit == "rem")
+        length.unit = LENGTH_UNIT::Rem;
+    else if (unit == "vw")
+        length.unit = LENGTH_UNIT::Vw;
+    else if (unit == "vh")
+        length.unit = LENGTH_UNIT::Vh;
+    else
+        length.unit = LENGTH_UNIT::Px;
+    return true;
+}
+
+/**
+ * \brief Returns the pixel field holding a box property.
+ */
+float &COMPUTED_STYLE::length_field(LENGTH_PROPERTY property)
+{
+    switch (property)
+    {
+    case LENGTH_PROPERTY::Width:
+        return width;
+    case LENGTH_PROPERTY::Height:
+        return height;
+    case LENGTH_PROPERTY::MarginTop:
+        return margin_top;
+    case LENGTH_PROPERTY::MarginRight:
+        return margin_right;
+    case LENGTH_PROPERTY::MarginBottom:
+        return margin_bottom;
+    case LENGTH_PROPERTY::MarginLeft:
+        return margin_left;
+    case LENGTH_PROPERTY::PaddingTop:
+        return padding_top;
+    case LENGTH_PROPERTY::PaddingRight:
+        return padding_right;
+    case LENGTH_PROPERTY::PaddingBottom:
+        return padding_bottom;
+    case LENGTH_PROPERTY::PaddingLeft:
+        return padding_left;
+    case LENGTH_PROPERTY::Top:
+        return top;
+    case LENGTH_PROPERTY::Right:
+        return right;
+    case LENGTH_PROPERTY::Bottom:
+        return bottom;
+    default:
+        return left;
+    }
+}
+
+float COMPUTED_STYLE::length_field(LENGTH_PROPERTY property) const
+{
+    return const_cast<COMPUTED_STYLE *>(this)->length_field(property);
+}
+
+/**
+ * \brief Sets a box property from a CSS length.
+ *
+ * Pixel values are stored directly. Relative values are remembered in
+ * relative_lengths and the field gets the default until layout resolves it,
+ * since the font size, containing block and viewport are only final then.
+ *
+ * \param property The property to set.
+ * \param value The specified value.
+ * \param default_value The value used for unparsable input and until resolution.
+ */
+void COMPUTED_STYLE::set_length(LENGTH_PROPERTY property, const std::string &value, float default_value)
+{
+    auto existing = std::find_if(relative_lengths.begin(), relative_lengths.end(),
+                                 [property](const RELATIVE_LENGTH &entry) { return entry.property == property; });
+
+    LENGTH length;
+    if (!parse_length(value, length) || length.unit == LENGTH_UNIT::Px)
+    {
+        if (existing != relative_lengths.end())
+        {
+            relative_lengths.erase(existing);
+        }
+        length_field(property) = parse_string_to_float(value, default_value);
+        return;
+    }
+
+    if (existing != relative_lengths.end())
+    {
+        existing->length = length;
+    }
+    else
+    {
+        relative_lengths.push_back({property, length});
+    }
+    length_field(property) = default_value;
+}
+
+/**
+ * \brief Reports whether a box property holds a relative value.
+ */
+bool COMPUTED_STYLE::has_relative_length(LENGTH_PROPERTY property) const
+{
+    return std::any_of(relative_lengths.begin(), relative_lengths.end(),
+                       [property](const RELATIVE_LENGTH &entry) { return entry.property == property; });
+}
+
+/**
+ * \brief Returns the transition that applies to a property, if any.
+ *
+ * \param property The property name, e.g. "opacity".
+ * \return The last transition naming the property or "all", or nullptr.
+ */
+const TRANSITION *COMPUTED_STYLE::transition_for(const std::string &property) const
+{
+    for (auto it = transitions.rbegin(); it != transitions.rend(); ++it)
+    {
+        if (it->property == property || it->property == "all")
+        {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * \brief Reports whether the element is drawn from a compositing layer of its own.
+ *
+ * That is the case when it is transformed, or when it names opacity or
+ * transform in its transitions, so their frames only recomposite the layer.
+ * transition: all does not count, as it would promote every element it
+ * matches; those elements, like the ones running @keyframes animations, are
+ * composited only while build_display_list is told they animate.
+ */
+bool COMPUTED_STYLE::is_composited() const
+{
+    if (!transform.is_identity())
+    {
+        return true;
+    }
+
+    for (const TRANSITION &transition : transitions)
+    {
+        if (transition.property == "opacity" || transition.property == "transform")
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Converts the relative box properties to pixels.
+ *
+ * Called by layout each time the box is laid out, so a resize only has to
+ * resolve the lengths again rather than rerun the cascade. Percentages refer
+ * to the containing block's width, except for height, top and bottom, which
+ * refer to its height and resolve to auto (or 0) when that is unknown.
+ *
+ * \param basis The containing block, root font size and viewport.
+ * \return True if a length depended on the viewport or the root font size,
+ *         which a layout cache keyed on width alone does not capture.
+ */
+bool COMPUTED_STYLE::resolve_lengths(const LENGTH_BASIS &basis)
+{
+    bool uses_viewport = false;
+
+    for (const RELATIVE_LENGTH &entry : relative_lengths)
+    {
+        const LENGTH &length = entry.length;
+        bool vertical = entry.property == LENGTH_PROPERTY::Height ||
+                        entry.property == LENGTH_PROPERTY::Top ||
+                        entry.property == LENGTH_PROPERTY::Bottom;
+        float resolved = 0;
+
+        switch (length.unit)
+        {
+        case LENGTH_UNIT::Em:
+            resolved = length.value * font_size;
+            break;
+        case LENGTH_UNIT::Rem:
+            resolved = length.value * basis.root_font_size;
+            uses_viewport = true;
+            break;
+        case LENGTH_UNIT::Vw:
+            resolved = length.value * basis.viewport_width / 100;
+            uses_viewport = true;
+            break;
+        case LENGTH_UNIT::Vh:
+            resolved = length.value * basis.viewport_height / 100;
+            uses_viewport = true;
+            break;
+        case LENGTH_UNIT::Percent:
+            if (!vertical)
+            {
+                resolved = length.value * basis.containing_width / 100;
+            }
+            else if (basis.containing_height >= 0)
+            {
+                resolved = length.value * basis.containing_height / 100;
+            }
+            else
+            {
+                resolved = entry.property == LENGTH_PROPERTY::Height ? -1 : 0;
+            }
+            break;
+        default:
+            resolved = length.value;
+            break;
+        }
+
+        length_field(entry.property) = resolved;
+    }
+
+    return uses_viewport;
+}
+
+/**
+ * \brief Carries the pixels layout resolved for an earlier style over to this one.
+ *
+ * A recascade leaves relative lengths unresolved until the next layout.
+ * When the restyle only needs a repaint, paint reads these fields without
+ * a layout pass in between, so they keep the values of the old style.
+ *
+ * \param old_style The style the box was last laid out with.
+ */
+void COMPUTED_STYLE::keep_resolved_lengths(const COMPUTED_STYLE &old_style)
+{
+    if (relative_lengths != old_style.relative_lengths)
+    {
+        return;
+    }
+
+    for (const RELATIVE_LENGTH &entry : relative_lengths)
+    {
+        length_field(entry.property) = old_style.length_field(entry.property);
+    }
+}
+
 // ============================================================================
 // Setter Initialization
 // ============================================================================
+
+/**
+ * \brief Interns the style's font description and remembers its cache ID.
+ *
+ * Called once the cascade has settled the font properties, so layout and
+ * paint can fetch the font and its metrics without building them.
+ */
+void COMPUTED_STYLE::resolve_font()
+{
+    font_id = FONT_CACHE::shared().intern(font_family, font_size, font_weight, font_style == "italic");
+}
+
+/**
+ * \brief Returns the cached font, metrics, ascent and line height of this style.
+ *
+ * Styles that never went through the cascade have no ID yet; their font is
+ * looked up from the current font properties instead.
+ *
+ * \return The shared FONT_ENTRY for this style's font.
+ */
+const FONT_ENTRY &COMPUTED_STYLE::font() const
+{
+    FONT_CACHE &cache = FONT_CACHE::shared();
+    if (font_id >= 0)
+    {
+        return cache.get(font_id);
+    }
+    return cache.get(cache.intern(font_family, font_size, font_weight, font_style == "italic"));
+}
+
+/**
+ * \brief Classifies how a style change has to be propagated to the screen.
+ *
+ * Properties that only change how already positioned boxes are drawn
+ * (colors, opacity, decoration, border style, visibility, transform and
+ * the transitions and animations that can start) need a repaint of
+ * the affected boxes. Anything that can move or resize a box needs a
+ * relayout. The raw margin/padding/border shorthand strings are ignored;
+ * their parsed longhands are compared instead.
+ *
+ * \param old_style The style before the cascade ran.
+ * \param new_style The style after the cascade ran.
+ * \return STYLE_CHANGE::Layout, STYLE_CHANGE::Paint or STYLE_CHANGE::None.
+ */
+STYLE_CHANGE COMPUTED_STYLE::diff(const COMPUTED_STYLE &old_style, const COMPUTED_STYLE &new_style)
+{
+    // A relative length holds its pixels from the last layout in the old
+    // style but only a placeholder in the new one, so for those the
+    // specified values are compared instead
+    auto length_changed = [&](LENGTH_PROPERTY property)
+    {
+        return old_style.length_field(property) != new_style.length_field(property) &&
+               !new_style.has_relative_length(property);
+    };
+
+    bool layout_changed =
+        old_style.display != new_style.display ||
+        old_style.position != new_style.position ||
+        old_style.font_size != new_style.font_size ||
+        old_style.font_weight != new_style.font_weight ||
+        old_style.font_style != new_style.font_style ||
+        old_style.font_family != new_style.font_family ||
+        old_style.line_height != new_style.line_height ||
+        old_style.text_align != new_style.text_align ||
+        old_style.relative_lengths != new_style.relative_lengths ||
+        length_changed(LENGTH_PROPERTY::Width) ||
+        length_changed(LENGTH_PROPERTY::Height) ||
+        old_style.box_sizing != new_style.box_sizing ||
+        length_changed(LENGTH_PROPERTY::MarginTop) ||
+        length_changed(LENGTH_PROPERTY::MarginRight) ||
+        length_changed(LENGTH_PROPERTY::MarginBottom) ||
+        length_changed(LENGTH_PROPERTY::MarginLeft) ||
+        length_changed(LENGTH_PROPERTY::PaddingTop) ||
+        length_changed(LENGTH_PROPERTY::PaddingRight) ||
+        length_changed(LENGTH_PROPERTY::PaddingBottom) ||
+        length_changed(LENGTH_PROPERTY::PaddingLeft) ||
+        old_style.border_width != new_style.border_width ||
+        length_changed(LENGTH_PROPERTY::Top) || old_style.is_top_set != new_style.is_top_set ||
+        length_changed(LENGTH_PROPERTY::Right) || old_style.is_right_set != new_style.is_right_set ||
+        length_changed(LENGTH_PROPERTY::Bottom) || old_style.is_bottom_set != new_style.is_bottom_set ||
+        length_changed(LENGTH_PROPERTY::Left) || old_style.is_left_set != new_style.is_left_set;
+
+    if (layout_changed)
+    {
+        return STYLE_CHANGE::Layout;
+    }
+
+    bool paint_changed =
+        old_style.color != new_style.color ||
+        old_style.background_color != new_style.background_color ||
+        old_style.opacity != new_style.opacity ||
+        old_style.text_decoration != new_style.text_decoration ||
+        old_style.border_color != new_style.border_color ||
+        old_style.border_style != new_style.border_style ||
+        old_style.visibility != new_style.visibility ||
+        old_style.transform != new_style.transform ||
+        old_style.transitions != new_style.transitions ||
+        old_style.animations != new_style.animations;
+
+    return paint_changed ? STYLE_CHANGE::Paint : STYLE_CHANGE::None;
+}
+
+/**
+ * \brief Fills the property setter table exactly once per process.
+ *
+ * Guarded by std::call_once so concurrent style workers can all call it;
+ * after initialization the table is only ever read.
+ */
 void COMPUTED_STYLE::init_setters()
 {
-    if (initialized)
-        return;
-    initialized = true;
+    std::call_once(setters_once, register_setters);
+}
 
+void COMPUTED_STYLE::register_setters()
+{
     setters.clear();
 
     setters["color"] = [](COMPUTED_STYLE &style, const std::string &value)
@@ -150,7 +885,7 @@ void COMPUTED_STYLE::init_setters()
 
     setters["font-size"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.font_size = parse_font_size(value);
+        style.font_size = parse_font_size(value, style.font_size);
     };
 
     setters["font-weight"] = [](COMPUTED_STYLE &style, const std::string &value)
@@ -247,70 +982,70 @@ void COMPUTED_STYLE::init_setters()
 
     setters["width"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.width = parse_string_to_float(value, -1);
+        style.set_length(LENGTH_PROPERTY::Width, value, -1);
     };
 
     setters["height"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.height = parse_string_to_float(value, -1);
+        style.set_length(LENGTH_PROPERTY::Height, value, -1);
     };
 
     setters["margin-top"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.margin_top = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::MarginTop, value, 0);
     };
 
     setters["margin-bottom"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.margin_bottom = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::MarginBottom, value, 0);
     };
 
     setters["margin-left"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.margin_left = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::MarginLeft, value, 0);
     };
 
     setters["margin-right"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.margin_right = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::MarginRight, value, 0);
     };
 
     setters["margin"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
         auto spacing = COMPUTED_STYLE::parse_spacing_shorthand(value);
-        style.margin_top = spacing.top;
-        style.margin_right = spacing.right;
-        style.margin_bottom = spacing.bottom;
-        style.margin_left = spacing.left;
+        style.set_length(LENGTH_PROPERTY::MarginTop, spacing.top, 0);
+        style.set_length(LENGTH_PROPERTY::MarginRight, spacing.right, 0);
+        style.set_length(LENGTH_PROPERTY::MarginBottom, spacing.bottom, 0);
+        style.set_length(LENGTH_PROPERTY::MarginLeft, spacing.left, 0);
     };
 
     setters["padding-top"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.padding_top = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::PaddingTop, value, 0);
     };
 
     setters["padding-bottom"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.padding_bottom = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::PaddingBottom, value, 0);
     };
 
     setters["padding-left"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.padding_left = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::PaddingLeft, value, 0);
     };
 
     setters["padding-right"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.padding_right = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::PaddingRight, value, 0);
     };
 
     setters["padding"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
         auto spacing = COMPUTED_STYLE::parse_spacing_shorthand(value);
-        style.padding_top = spacing.top;
-        style.padding_right = spacing.right;
-        style.padding_bottom = spacing.bottom;
-        style.padding_left = spacing.left;
+        style.set_length(LENGTH_PROPERTY::PaddingTop, spacing.top, 0);
+        style.set_length(LENGTH_PROPERTY::PaddingRight, spacing.right, 0);
+        style.set_length(LENGTH_PROPERTY::PaddingBottom, spacing.bottom, 0);
+        style.set_length(LENGTH_PROPERTY::PaddingLeft, spacing.left, 0);
     };
 
     setters["border-width"] = [](COMPUTED_STYLE &style, const std::string &value)
@@ -433,6 +1168,21 @@ void COMPUTED_STYLE::init_setters()
             style.opacity = 1.0;
     };
 
+    setters["transform"] = [](COMPUTED_STYLE &style, const std::string &value)
+    {
+        style.transform = COMPUTED_STYLE::parse_transform(value);
+    };
+
+    setters["transition"] = [](COMPUTED_STYLE &style, const std::string &value)
+    {
+        style.transitions = COMPUTED_STYLE::parse_transitions(value);
+    };
+
+    setters["animation"] = [](COMPUTED_STYLE &style, const std::string &value)
+    {
+        style.animations = COMPUTED_STYLE::parse_animations(value);
+    };
+
     setters["position"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
         style.position = COMPUTED_STYLE::parse_position_type(value);
@@ -440,25 +1190,25 @@ void COMPUTED_STYLE::init_setters()
 
     setters["top"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.top = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::Top, value, 0);
         style.is_top_set = true;
     };
 
     setters["right"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.right = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::Right, value, 0);
         style.is_right_set = true;
     };
 
     setters["bottom"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.bottom = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::Bottom, value, 0);
         style.is_bottom_set = true;
     };
 
     setters["left"] = [](COMPUTED_STYLE &style, const std::string &value)
     {
-        style.left = parse_string_to_float(value, 0);
+        style.set_length(LENGTH_PROPERTY::Left, value, 0);
         style.is_left_set = true;
     };
 }
@@ -520,13 +1270,16 @@ void COMPUTED_STYLE::init_setters()
  *
  * Converts font-size values from various CSS units (px, pt, cm, mm, in) and
  * CSS keywords (xx-small through xx-large) into pixel values. Uses standard
- * conversion factors (1in = 96px = 2.54cm). Returns 16px as the default/medium
- * font size if parsing fails.
+ * conversion factors (1in = 96px = 2.54cm). Unitless numbers are taken as
+ * pixels. em and % scale the parent's font size; rem scales the initial 16px,
+ * since the root's size is not at hand while a single node is styled.
+ * Returns 16px as the default/medium font size if parsing fails.
  *
- * \param value The font-size value string (e.g., "14px", "medium", "1.5cm").
+ * \param value The font-size value string (e.g., "14px", "medium", "1.5cm", "2em").
+ * \param parent_font_size The inherited font size, in pixels.
  * \return The font size in pixels as an integer.
  */
-int COMPUTED_STYLE::parse_font_size(const std::string &value)
+int COMPUTED_STYLE::parse_font_size(const std::string &value, int parent_font_size)
 /* 1in = 96px = 2.54cm = 25.4mm
     96/2.54 is about 37.8px
 */
@@ -577,12 +1330,13 @@ int COMPUTED_STYLE::parse_font_size(const std::string &value)
     }
     else
     {
-        std::string unit = value.substr(value.size() - 2);
         try
         {
-            double num_value = std::stod(value.substr(0, value.size() - 2));
+            size_t unit_start = 0;
+            double num_value = std::stod(value, &unit_start);
+            std::string unit = value.substr(unit_start);
 
-            if (unit == "px" || unit == "pt")
+            if (unit.empty() || unit == "px" || unit == "pt")
             {
                 return std::round(num_value);
             }
@@ -602,6 +1356,21 @@ int COMPUTED_STYLE::parse_font_size(const std::string &value)
                 return std::round(num_value * 96);
             }
 
+            else if (unit == "em")
+            {
+                return std::round(num_value * parent_font_size);
+            }
+
+            else if (unit == "%")
+            {
+                return std::round(num_value * parent_font_size / 100);
+            }
+
+            else if (unit == "rem")
+            {
+                return std::round(num_value * 16);
+            }
+
             else
             {
                 return 16;
@@ -658,11 +1427,11 @@ std::string COMPUTED_STYLE::inherit_color() const
  * Converts the font_size member (in pixels) to its string representation
  * for inheritance to child elements.
  *
- * \return The font size as a string (e.g., "14").
+ * \return The font size as a string (e.g., "14px").
  */
 std::string COMPUTED_STYLE::inherit_font_size() const
 {
-    return std::to_string(font_size);
+    return std::to_string(font_size) + "px";
 }
 
 /**
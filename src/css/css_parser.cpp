@@ -1,6 +1,7 @@
 #include "css/css_parser.h"
 #include "util_functions.h"
 #include <iostream>
+#include <algorithm>
 #include <cctype>
 #include <queue>
 #include <QDebug>
@@ -147,12 +148,97 @@ CSSOM create_cssom(const std::string &css)
     return cssom;
 }
 
+/**
+ * \brief Finds the brace closing the block opened at a position.
+ *
+ * \param css The CSS source.
+ * \param open The position of the opening brace.
+ * \return The position of the matching closing brace, or css.size() if unclosed.
+ */
+static size_t find_block_end(const std::string &css, size_t open)
+{
+    int depth = 0;
+    for (size_t pos = open; pos < css.size(); ++pos)
+    {
+        if (css[pos] == '{')
+        {
+            ++depth;
+        }
+        else if (css[pos] == '}' && --depth == 0)
+        {
+            return pos;
+        }
+    }
+    return css.size();
+}
+
+/**
+ * \brief Parses an at-rule starting at a position.
+ *
+ * The rules inside @media blocks are parsed as usual and tagged with the
+ * block's prelude, so the CSSOM can switch them on and off with the viewport.
+ * The keyframes of an @keyframes block are parsed like rules whose selector
+ * is the keyframe offsets, tagged with the animation name. Other at-rules
+ * are skipped, up to their semicolon or their whole block.
+ *
+ * \param css The CSS source.
+ * \param pos The position of the '@'.
+ * \param result Receives the rules found inside the at-rule.
+ * \return The position following the at-rule.
+ */
+static size_t parse_at_rule(const std::string &css, size_t pos, std::vector<CSS_RULE> &result)
+{
+    size_t name_end = pos + 1;
+    while (name_end < css.size() && (std::isalnum(static_cast<unsigned char>(css[name_end])) || css[name_end] == '-'))
+    {
+        ++name_end;
+    }
+    std::string name = css.substr(pos + 1, name_end - pos - 1);
+
+    size_t semicolon = css.find(';', name_end);
+    size_t block_start = css.find('{', name_end);
+    if (block_start == std::string::npos || (semicolon != std::string::npos && semicolon < block_start))
+    {
+        return semicolon == std::string::npos ? css.size() : semicolon + 1;
+    }
+
+    size_t block_end = find_block_end(css, block_start);
+
+    if (name == "media")
+    {
+        std::string prelude = css.substr(name_end, block_start - name_end);
+        trim(prelude);
+
+        for (auto &rule : parse_css(css.substr(block_start + 1, block_end - block_start - 1)))
+        {
+            rule.media = rule.media.empty() ? prelude : prelude + " and " + rule.media;
+            result.push_back(rule);
+        }
+    }
+    else if (name == "keyframes" || name == "-webkit-keyframes")
+    {
+        std::string keyframes_name = css.substr(name_end, block_start - name_end);
+        trim(keyframes_name);
+        std::transform(keyframes_name.begin(), keyframes_name.end(), keyframes_name.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+
+        for (auto &rule : parse_css(css.substr(block_start + 1, block_end - block_start - 1)))
+        {
+            rule.keyframes = keyframes_name;
+            result.push_back(rule);
+        }
+    }
+
+    return block_end + 1;
+}
+
 /**
  * \brief Parses CSS source text into an array of CSS rules.
  *
  * Tokenizes and parses a complete CSS stylesheet, handling comment removal
  * and rule/declaration parsing. Extracts selectors and their corresponding
- * declarations, building CSS_RULE objects for each rule block.
+ * declarations, building CSS_RULE objects for each rule block. Rules inside
+ * @media blocks carry the block's media prelude.
  *
  * \param css The CSS source code to parse.
  * \return A vector of CSS_RULE objects representing all parsed CSS rules.
@@ -193,6 +279,12 @@ std::vector<CSS_RULE> parse_css(const std::string &css)
             continue;
         }
 
+        if (pos < css.size() && css[pos] == '@')
+        {
+            pos = parse_at_rule(css, pos, result);
+            continue;
+        }
+
         size_t block_start_pos = css.find('{', pos);
         size_t block_end_pos = css.find('}', pos);
         if (block_start_pos != std::string::npos)
@@ -3,72 +3,298 @@
 #include <algorithm>
 
 /**
- * \brief Finds all CSS rules that match a given DOM node.
+ * \brief Adds a rule to the CSSOM and precompiles its selector list.
  *
- * Iterates through all CSS rules in the CSSOM and tests each selector against
- * the provided node. Handles multiple selectors per rule (comma-separated).
- * Returns all matching rules in priority order.
+ * Selectors are compiled once here, so matching never has to touch the rule
+ * text again. This keeps the CSSOM immutable during the cascade and safe to
+ * share between threads. The invalidation sets are extended at the same time.
+ * A rule from an @media block shares one compiled condition with every rule
+ * of the same prelude, evaluated for the last viewport given to update_media.
  *
- * \param node The DOM node to match against CSS selectors.
- * \return A vector of CSS_RULE objects that match the node.
+ * \param rule The CSS rule to add.
  */
-std::vector<CSS_RULE> CSSOM::matching_rules(std::shared_ptr<NODE> node)
+void CSSOM::add_rule(CSS_RULE rule)
 {
-    std::vector<CSS_RULE> matched;
+    if (!rule.keyframes.empty())
+    {
+        add_keyframe(rule);
+        return;
+    }
+
+    std::vector<COMPLEX_SELECTOR> selector_list = parse_selector_list(rule.selector);
+    for (const auto &selector : selector_list)
+    {
+        build_invalidation_sets(selector);
+    }
 
-    for (auto &rule : m_rules)
+    int media = -1;
+    if (!rule.media.empty())
     {
-        rule.selector.erase(std::remove_if(rule.selector.begin(), rule.selector.end(), [](unsigned char c){
-            return std::isspace(c);
-        }), rule.selector.end());
-        auto multiple_selectors = split(rule.selector, ',');
-        for(auto selector:multiple_selectors){
-            if(matches(selector, node)){
-                matched.push_back(rule);
+        MEDIA_CONDITION condition = parse_media_condition(rule.media);
+        for (size_t i = 0; i < m_media_conditions.size(); ++i)
+        {
+            if (m_media_conditions[i].text == condition.text)
+            {
+                media = static_cast<int>(i);
+                break;
             }
         }
+
+        if (media < 0)
+        {
+            media = static_cast<int>(m_media_conditions.size());
+            m_media_active.push_back(media_condition_matches(condition, m_media_width, m_media_height));
+            m_media_conditions.push_back(std::move(condition));
+        }
     }
 
-    return matched;
+    m_rules.push_back(rule);
+    m_selector_lists.push_back(selector_list);
+    m_rule_media.push_back(media);
+}
+
+/**
+ * \brief Adds the keyframe(s) of an @keyframes rule to its animation.
+ *
+ * The selector lists the offsets ("from", "to" or percentages). Only
+ * opacity and transform declarations are kept; they are the properties
+ * animations run on.
+ *
+ * \param rule A rule whose keyframes field names the animation.
+ */
+void CSSOM::add_keyframe(const CSS_RULE &rule)
+{
+    KEYFRAME frame;
+    for (const auto &declaration : rule.declarations)
+    {
+        if (declaration.property == "opacity")
+        {
+            frame.has_opacity = true;
+            frame.opacity = std::clamp(COMPUTED_STYLE::parse_string_to_float(declaration.value, 1), 0.0f, 1.0f);
+        }
+        else if (declaration.property == "transform")
+        {
+            frame.has_transform = true;
+            frame.transform = COMPUTED_STYLE::parse_transform(declaration.value);
+        }
+    }
+
+    KEYFRAMES &keyframes = m_keyframes[rule.keyframes];
+    keyframes.name = rule.keyframes;
+
+    std::string selector = rule.selector;
+    for (auto offset : split(selector, ','))
+    {
+        trim(offset);
+        if (offset == "from")
+            frame.offset = 0;
+        else if (offset == "to")
+            frame.offset = 1;
+        else if (!offset.empty() && offset.back() == '%')
+            frame.offset = std::clamp(COMPUTED_STYLE::parse_string_to_float(offset) / 100, 0.0f, 1.0f);
+        else
+            continue;
+
+        // Later keyframes at the same offset come after earlier ones
+        auto position = std::upper_bound(keyframes.frames.begin(), keyframes.frames.end(), frame.offset,
+                                         [](float offset, const KEYFRAME &other) { return offset < other.offset; });
+        keyframes.frames.insert(position, frame);
+    }
+}
+
+/**
+ * \brief Looks up the keyframes of an animation.
+ *
+ * \param name The name given in @keyframes, in lower case.
+ * \return The keyframes, or nullptr if no @keyframes rule has that name.
+ */
+const KEYFRAMES *CSSOM::keyframes(const std::string &name) const
+{
+    auto it = m_keyframes.find(name);
+    return it == m_keyframes.end() ? nullptr : &it->second;
 }
 
 /**
- * \brief Tests if a CSS selector matches a DOM node.
+ * \brief Records which elements a change to each class, id or attribute can restyle.
  *
- * Supports three selector types: element selectors (tag names),
- * class selectors (dot notation), and ID selectors (hash notation).
- * Performs case-sensitive matching for element and ID selectors.
+ * A feature in the subject (rightmost) compound only affects the element that
+ * carries it. A feature left of a descendant or child combinator affects that
+ * element's descendants, and one left of a sibling combinator affects its
+ * following siblings (and, through further combinators, their subtrees).
  *
- * \param selector The CSS selector to test (e.g., "div", ".classname", "#idname").
- * \param node The DOM node to test against.
- * \return True if the selector matches the node, false otherwise.
+ * \param selector A compiled selector from a newly added rule.
  */
-bool CSSOM::matches(const std::string &selector, std::shared_ptr<NODE> node)
+void CSSOM::build_invalidation_sets(const COMPLEX_SELECTOR &selector)
 {
-    
-    if (selector[0] == '.')
+    size_t subject = selector.compounds.size() - 1;
+
+    for (size_t i = 0; i < selector.compounds.size(); ++i)
     {
-        std::string class_value = node->get_attribute("class");
-        std::vector<std::string> classes = split(class_value, ' ');
+        int flags = INVALIDATE_NONE;
+        if (i == subject)
+        {
+            flags |= INVALIDATE_SELF;
+        }
 
-        for (const auto &class_name : classes)
+        for (size_t j = i; j < subject; ++j)
         {
-            if (class_name == selector.substr(1))
+            if (selector.combinators[j] == COMBINATOR::Adjacent || selector.combinators[j] == COMBINATOR::Sibling)
+            {
+                flags |= INVALIDATE_SIBLINGS;
+                m_has_sibling_selectors = true;
+            }
+            else if (j == i)
             {
-                return true;
+                flags |= INVALIDATE_DESCENDANTS;
+            }
+        }
+
+        const COMPOUND_SELECTOR &compound = selector.compounds[i];
+        for (const auto &class_name : compound.classes)
+        {
+            m_class_invalidation[class_name] |= flags;
+        }
+        if (!compound.id.empty())
+        {
+            m_id_invalidation[compound.id] |= flags;
+        }
+        for (const auto &attribute : compound.attributes)
+        {
+            m_attribute_invalidation[attribute.name] |= flags;
+        }
+    }
+}
+
+/**
+ * \brief Finds all CSS rules that match a given DOM node.
+ *
+ * Iterates through all CSS rules in the CSSOM and tests each precompiled
+ * selector against the provided node. A rule is reported once even if
+ * several selectors of its comma-separated list match. Rules whose media
+ * condition does not hold are skipped.
+ *
+ * \param node The DOM node to match against CSS selectors.
+ * \return Pointers to the matching rules in source order.
+ */
+std::vector<const CSS_RULE*> CSSOM::matching_rules(const NODE& node) const
+{
+    std::vector<const CSS_RULE*> matched;
+
+    for (size_t i = 0; i < m_rules.size(); ++i)
+    {
+        if (m_rule_media[i] >= 0 && !m_media_active[m_rule_media[i]])
+        {
+            continue;
+        }
+
+        for(const auto &selector : m_selector_lists[i]){
+            if(selector_matches(selector, node)){
+                matched.push_back(&m_rules[i]);
+                break;
             }
         }
+    }
+
+    return matched;
+}
 
-        return false;
+/**
+ * \brief Returns the compiled selector list of a rule.
+ *
+ * \param rule The rule's index, as returned by update_media.
+ */
+const std::vector<COMPLEX_SELECTOR> &CSSOM::selector_list(size_t rule) const
+{
+    return m_selector_lists[rule];
+}
+
+/**
+ * \brief Re-evaluates the media conditions for a new viewport size.
+ *
+ * Only the compiled conditions are evaluated, not the rules, so a resize
+ * that crosses no breakpoint costs one comparison per distinct condition.
+ * Must not be called while a cascade is reading the CSSOM.
+ *
+ * \param viewport_width The viewport width in pixels.
+ * \param viewport_height The viewport height in pixels.
+ * \return The indices of the rules that were switched on or off, in source order.
+ */
+std::vector<size_t> CSSOM::update_media(float viewport_width, float viewport_height)
+{
+    m_media_width = viewport_width;
+    m_media_height = viewport_height;
+
+    std::vector<bool> toggled(m_media_conditions.size(), false);
+    bool any_toggled = false;
+    for (size_t i = 0; i < m_media_conditions.size(); ++i)
+    {
+        bool active = media_condition_matches(m_media_conditions[i], viewport_width, viewport_height);
+        if (active != m_media_active[i])
+        {
+            m_media_active[i] = active;
+            toggled[i] = true;
+            any_toggled = true;
+        }
     }
 
-    else if (selector[0] == '#')
+    std::vector<size_t> rules;
+    if (!any_toggled)
     {
-        return node->get_attribute("id") == selector.substr(1);
+        return rules;
     }
 
-    else
+    for (size_t i = 0; i < m_rules.size(); ++i)
     {
-        return node->get_tag_name() == selector;
+        if (m_rule_media[i] >= 0 && toggled[m_rule_media[i]])
+        {
+            rules.push_back(i);
+        }
     }
-}
\ No newline at end of file
+    return rules;
+}
+
+/**
+ * \brief Returns the INVALIDATION_FLAGS for a change of a class name.
+ *
+ * \param class_name The class added to or removed from an element.
+ * \return INVALIDATE_NONE if no selector uses the class.
+ */
+int CSSOM::class_invalidation(const std::string &class_name) const
+{
+    auto it = m_class_invalidation.find(class_name);
+    return it == m_class_invalidation.end() ? INVALIDATE_NONE : it->second;
+}
+
+/**
+ * \brief Returns the INVALIDATION_FLAGS for a change of an element id.
+ *
+ * \param id The old or new id of an element.
+ * \return INVALIDATE_NONE if no selector uses the id.
+ */
+int CSSOM::id_invalidation(const std::string &id) const
+{
+    auto it = m_id_invalidation.find(id);
+    return it == m_id_invalidation.end() ? INVALIDATE_NONE : it->second;
+}
+
+/**
+ * \brief Returns the INVALIDATION_FLAGS for a change of any other attribute.
+ *
+ * \param name The attribute name.
+ * \return INVALIDATE_NONE if no attribute selector uses the name.
+ */
+int CSSOM::attribute_invalidation(const std::string &name) const
+{
+    auto it = m_attribute_invalidation.find(name);
+    return it == m_attribute_invalidation.end() ? INVALIDATE_NONE : it->second;
+}
+
+/**
+ * \brief Reports whether any selector uses a sibling combinator.
+ *
+ * When none does, inserting or removing children cannot restyle siblings.
+ */
+bool CSSOM::has_sibling_selectors() const
+{
+    return m_has_sibling_selectors;
+}
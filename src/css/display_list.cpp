@@ -0,0 +1,819 @@
+#include "css/display_list.h"
+#include "util_functions.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace {
+    struct BUILD_STEP
+    {
+        int index;
+        float offset_x; // the parent's position, relative to the fixed root if any
+        float offset_y;
+        int layer;      // the innermost layer of the ancestors
+        int composited_layer;
+        int fixed_root;
+        bool is_fixed_root;
+    };
+
+    /**
+     * Emits the background, border or image of an element box.
+     */
+    void add_element_items(DISPLAY_LIST &list, const LAYOUT_TREE &tree, int index, float x, float y,
+                           const BUILD_STEP &step)
+    {
+        const LAYOUT_BOX &box = tree.boxes[index];
+        const COMPUTED_STYLE &style = *box.style;
+
+        DISPLAY_ITEM item;
+        item.box = index;
+        item.x = x;
+        item.y = y;
+        item.layer = step.layer;
+        item.composited_layer = step.composited_layer;
+        item.fixed_root = step.fixed_root;
+        item.bounds = QRectF(x, y, box.width, box.height);
+
+        // Inline boxes may have no area of their own; their text is hit instead
+        if (!item.bounds.isEmpty()) {
+            list.hits.push_back({index, item.bounds, step.fixed_root});
+        }
+
+        if (box.image >= 0) {
+            item.type = DISPLAY_ITEM_TYPE::Image;
+            list.items.push_back(item);
+            return;
+        }
+
+        if (style.background_color != QColor("transparent")) {
+            item.type = DISPLAY_ITEM_TYPE::Background;
+            item.color = style.background_color;
+            list.items.push_back(item);
+        }
+
+        if (style.border_width > 0) {
+            float border_margin = style.border_width / 2 + 1;
+            item.type = DISPLAY_ITEM_TYPE::Border;
+            item.color = style.border_color;
+            item.border_style = style.border_style;
+            item.border_width = style.border_width;
+            item.bounds = item.bounds.adjusted(-border_margin, -border_margin, border_margin, border_margin);
+            list.items.push_back(item);
+        }
+    }
+
+    /**
+     * Emits one item per line fragment of a text box, plus its list bullet.
+     * Alignment is applied here, against the width of the parent box.
+     */
+    void add_text_items(DISPLAY_LIST &list, const LAYOUT_TREE &tree, const BUILD_STEP &step)
+    {
+        int index = step.index;
+        float offset_x = step.offset_x;
+        float offset_y = step.offset_y;
+        const LAYOUT_BOX &box = tree.boxes[index];
+        const LAYOUT_BOX *parent_box = box.parent >= 0 ? &tree.boxes[box.parent] : nullptr;
+        const FONT_ENTRY &font = box.style->font();
+
+        float offset_adjust = 0;
+        if (parent_box) {
+            float total_width = 0;
+            for (size_t i = 0; i < box.fragment_count; ++i) {
+                total_width += tree.fragments[box.first_fragment + i].width;
+            }
+
+            if (parent_box->style->text_align == TEXT_ALIGN::Center) {
+                offset_adjust = (parent_box->width - total_width) / 2;
+            }
+            else if (parent_box->style->text_align == TEXT_ALIGN::Right) {
+                offset_adjust = parent_box->width - total_width;
+            }
+        }
+
+        DISPLAY_ITEM item;
+        item.box = index;
+        item.layer = step.layer;
+        item.composited_layer = step.composited_layer;
+        item.fixed_root = step.fixed_root;
+        item.color = box.style->color;
+        item.font = &font;
+
+        if (parent_box && parent_box->node->get_tag_name() == "li") {
+            item.type = DISPLAY_ITEM_TYPE::Bullet;
+            item.x = offset_x + box.x + offset_adjust;
+            item.y = offset_y + box.y;
+            item.bounds = QRectF(item.x - 1, item.y - 1, 15 + 2, font.line_height + 2);
+            list.items.push_back(item);
+            offset_adjust += 15;
+        }
+
+        item.type = DISPLAY_ITEM_TYPE::Text;
+        item.decoration = box.style->text_decoration;
+        for (size_t i = 0; i < box.fragment_count; ++i) {
+            const TEXT_FRAGMENT &fragment = tree.fragments[box.first_fragment + i];
+            item.fragment = box.first_fragment + i;
+            item.x = offset_x + fragment.x + offset_adjust;
+            item.y = offset_y + fragment.y;
+            if (fragment.glyph_runs.isEmpty()) {
+                item.text = box.node->get_text_utf16().mid(static_cast<qsizetype>(fragment.offset),
+                                                           static_cast<qsizetype>(fragment.length));
+            }
+
+            QRectF line_rect(item.x, item.y, fragment.width, fragment.height);
+            list.hits.push_back({index, line_rect, step.fixed_root});
+
+            // Glyphs and decorations may reach slightly outside the line box
+            item.bounds = line_rect.adjusted(-2, -2, 2, 2);
+            list.items.push_back(item);
+        }
+    }
+
+    /**
+     * Opens the layer of a fixed-position box, of an element with opacity
+     * below 1, or of an element whose opacity or transform may animate.
+     * Composited layers are drawn on their own, over the document, so they
+     * take the opacity of the layers up to the next composited one too.
+     */
+    int start_layer(DISPLAY_LIST &list, const BUILD_STEP &step, const COMPUTED_STYLE &style, const QRectF &box_rect,
+                    bool animated)
+    {
+        DISPLAY_LAYER layer;
+        layer.box = step.index;
+        layer.opacity = style.opacity;
+        layer.fixed_root = step.fixed_root;
+        layer.first_item = list.items.size();
+        layer.end_item = list.items.size();
+        layer.composited = step.is_fixed_root || animated || style.is_composited();
+        layer.transform = style.transform;
+        layer.box_rect = box_rect;
+
+        if (!step.is_fixed_root) {
+            layer.parent = step.layer;
+        }
+
+        if (layer.composited) {
+            layer.composite_parent = step.composited_layer;
+            for (int outer = step.layer; outer >= 0 && outer != step.composited_layer;
+                 outer = list.layers[outer].parent) {
+                layer.outer_opacity *= list.layers[outer].opacity;
+            }
+            list.composited_layers.push_back(list.layers.size());
+        }
+
+        list.layers.push_back(layer);
+        return static_cast<int>(list.layers.size()) - 1;
+    }
+
+    /**
+     * Sets the item range and bounds of every layer once all items exist.
+     * A layer's items are contiguous in paint order and include those of the
+     * layers nested in it.
+     */
+    void finish_layers(DISPLAY_LIST &list)
+    {
+        for (size_t i = 0; i < list.items.size(); ++i) {
+            const DISPLAY_ITEM &item = list.items[i];
+            if (item.layer >= 0) {
+                list.layers[item.layer].bounds |= item.bounds;
+            }
+
+            // Outer layers were extended together with inner ones
+            for (int layer = item.layer; layer >= 0 && list.layers[layer].end_item <= i; layer = list.layers[layer].parent) {
+                list.layers[layer].end_item = i + 1;
+            }
+        }
+
+        // Nested layers were created after their parent
+        for (size_t layer = list.layers.size(); layer-- > 0;) {
+            int parent = list.layers[layer].parent;
+            if (parent >= 0) {
+                list.layers[parent].bounds |= list.layers[layer].bounds;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Flattens a layout tree into the items painted, in paint order.
+ *
+ * The tree is walked once after layout, in the order painting used to
+ * follow it: a box, then its in-flow children, then its positioned
+ * children. Each item records where it is drawn and the area it covers, so
+ * a repaint can skip everything outside its dirty rect without visiting the
+ * tree. The area of every box and line fragment is recorded alongside for
+ * hit testing, and both are indexed by a uniform grid over the document.
+ * Items inside a fixed-position box are recorded relative to that box,
+ * whose place depends on the scroll position at paint time.
+ *
+ * Colors, pens and fonts are copied from the box's style into the items, so
+ * painting reads only the list and the layout tree and can run on worker
+ * threads. The list is therefore rebuilt after paint-only style changes too.
+ *
+ * \param tree The laid-out tree.
+ * \param list Receives the items; its storage is reused.
+ * \param animated_nodes The elements whose opacity or transform is animating
+ *        right now; each is composited for as long as it is in the set.
+ */
+void build_display_list(const LAYOUT_TREE &tree, DISPLAY_LIST &list,
+                        const std::unordered_set<const NODE *> *animated_nodes)
+{
+    list.clear();
+    if (tree.empty()) {
+        return;
+    }
+
+    std::vector<BUILD_STEP> stack{{0, 0, 0, -1, -1, -1, false}};
+
+    while (!stack.empty()) {
+        BUILD_STEP step = stack.back();
+        stack.pop_back();
+
+        const LAYOUT_BOX &box = tree.boxes[step.index];
+
+        // Placeholders of virtualized layout hold space for blocks not laid out
+        if (box.estimated_count > 0) {
+            continue;
+        }
+
+        const COMPUTED_STYLE &style = *box.style;
+
+        if (box.node->get_type() == NODE_TYPE::TEXT) {
+            add_text_items(list, tree, step);
+            continue;
+        }
+
+        float abs_x = step.offset_x + box.x;
+        float abs_y = step.offset_y + box.y;
+
+        if (step.is_fixed_root) {
+            abs_x = 0;
+            abs_y = 0;
+        }
+        else if (style.position == POSITION_TYPE::Relative) {
+            abs_x += style.left - style.right;
+            abs_y += style.top - style.bottom;
+        }
+
+        bool animated = animated_nodes && animated_nodes->count(box.node) > 0;
+        if (step.is_fixed_root || style.opacity < 1 || animated || style.is_composited()) {
+            step.layer = start_layer(list, step, style, QRectF(abs_x, abs_y, box.width, box.height), animated);
+            if (list.layers[step.layer].composited) {
+                step.composited_layer = step.layer;
+            }
+        }
+        int layer = step.layer;
+        int composited_layer = step.composited_layer;
+
+        if (box.node->get_type() == NODE_TYPE::ELEMENT) {
+            add_element_items(list, tree, step.index, abs_x, abs_y, step);
+        }
+
+        // Children are pushed in paint order, then reversed so the first pops first
+        size_t first = stack.size();
+        for (int child = box.first_child; child >= 0; child = tree.boxes[child].next_sibling) {
+            stack.push_back({child, abs_x, abs_y, layer, composited_layer, step.fixed_root, false});
+        }
+
+        // Positioned children (absolute/fixed) paint after in-flow ones
+        if (!step.is_fixed_root) {
+            for (int abs_child = box.first_absolute_child; abs_child >= 0; abs_child = tree.boxes[abs_child].next_sibling) {
+                if (tree.boxes[abs_child].style->position == POSITION_TYPE::Fixed) {
+                    stack.push_back({abs_child, 0, 0, layer, composited_layer, abs_child, true});
+                }
+                else {
+                    stack.push_back({abs_child, abs_x, abs_y, layer, composited_layer, step.fixed_root, false});
+                }
+            }
+        }
+        std::reverse(stack.begin() + first, stack.end());
+    }
+
+    finish_layers(list);
+
+    float document_width = std::max(tree.boxes[0].width, static_cast<float>(tree.boxes[0].overflow.right()));
+    list.grid.reset(document_width);
+    list.hit_grid.reset(document_width);
+
+    for (size_t i = 0; i < list.items.size(); ++i) {
+        if (list.items[i].fixed_root >= 0) {
+            list.fixed_items.push_back(i);
+        }
+        else if (list.items[i].composited_layer < 0) {
+            list.grid.insert(i, list.items[i].bounds);
+        }
+    }
+
+    for (size_t i = 0; i < list.hits.size(); ++i) {
+        if (list.hits[i].fixed_root >= 0) {
+            list.fixed_hits.push_back(i);
+        }
+        else {
+            list.hit_grid.insert(i, list.hits[i].bounds);
+        }
+    }
+}
+
+/**
+ * \brief Empties the list, keeping the storage of its item array.
+ */
+void DISPLAY_LIST::clear()
+{
+    items.clear();
+    grid.reset(0);
+    fixed_items.clear();
+    layers.clear();
+    composited_layers.clear();
+    hits.clear();
+    hit_grid.reset(0);
+    fixed_hits.clear();
+}
+
+/**
+ * \brief Finds the scrolling items that intersect a rectangle.
+ *
+ * Only the grid cells the rectangle crosses are visited, so the cost depends
+ * on the size of the rectangle rather than of the document. Fixed items are
+ * not included; their position depends on the scroll offset. Neither are
+ * items of composited layers, which are drawn over the tiles.
+ *
+ * \param rect The area to repaint, in document coordinates.
+ * \param result Receives the indices of the items, in paint order.
+ */
+void DISPLAY_LIST::query(const QRectF &rect, std::vector<size_t> &result) const
+{
+    grid.query(rect, result);
+    result.erase(std::remove_if(result.begin(), result.end(),
+                                [&](size_t index) { return !items[index].bounds.intersects(rect); }),
+                 result.end());
+}
+
+/**
+ * \brief Finds the box drawn topmost at a point.
+ *
+ * Fixed-position boxes are drawn over the scrolling content, so they are
+ * tried first. Within each group, later entries in paint order are on top:
+ * positioned children over their in-flow siblings, children over their
+ * parent.
+ * Only the one grid cell holding the point is searched for scrolling boxes.
+ *
+ * \param point The point, in document coordinates.
+ * \param fixed_origin Returns where a fixed-position box currently is.
+ * \return The index of the box, or -1 if the point hits nothing.
+ */
+int DISPLAY_LIST::hit_test(const QPointF &point, const std::function<QPointF(int)> &fixed_origin) const
+{
+    int origin_root = -1;
+    QPointF origin;
+    for (auto it = fixed_hits.rbegin(); it != fixed_hits.rend(); ++it) {
+        const HIT_ENTRY &hit = hits[*it];
+        if (hit.fixed_root != origin_root) {
+            origin_root = hit.fixed_root;
+            origin = fixed_origin(origin_root);
+        }
+        if (hit.bounds.translated(origin).contains(point)) {
+            return hit.box;
+        }
+    }
+
+    const std::vector<size_t> *cell = hit_grid.cell_at(point);
+    if (!cell) {
+        return -1;
+    }
+
+    for (auto it = cell->rbegin(); it != cell->rend(); ++it) {
+        if (hits[*it].bounds.contains(point)) {
+            return hits[*it].box;
+        }
+    }
+    return -1;
+}
+
+/**
+ * \brief Empties the grid and sizes its rows for a document width.
+ *
+ * \param document_width The width entries are expected to span.
+ */
+void SPATIAL_GRID::reset(float document_width)
+{
+    cells.clear();
+    columns = std::max(1, static_cast<int>(std::ceil(document_width / SPATIAL_CELL_SIZE)));
+}
+
+/**
+ * \brief Adds an entry to every cell its bounds cross.
+ *
+ * \param index The entry's index; entries must be inserted in increasing order.
+ * \param bounds The area the entry covers, in document coordinates.
+ */
+void SPATIAL_GRID::insert(size_t index, const QRectF &bounds)
+{
+    int first_column = std::clamp(static_cast<int>(std::floor(bounds.left() / SPATIAL_CELL_SIZE)), 0, columns - 1);
+    int last_column = std::clamp(static_cast<int>(std::floor(bounds.right() / SPATIAL_CELL_SIZE)), 0, columns - 1);
+    size_t first_row = static_cast<size_t>(std::max(0.0, std::floor(bounds.top() / SPATIAL_CELL_SIZE)));
+    size_t last_row = static_cast<size_t>(std::max(0.0, std::floor(bounds.bottom() / SPATIAL_CELL_SIZE)));
+
+    if (cells.size() < (last_row + 1) * columns) {
+        cells.resize((last_row + 1) * columns);
+    }
+
+    for (size_t row = first_row; row <= last_row; ++row) {
+        for (int column = first_column; column <= last_column; ++column) {
+            cells[row * columns + column].push_back(index);
+        }
+    }
+}
+
+/**
+ * \brief Collects the entries of the cells a rectangle crosses.
+ *
+ * The entries only share a cell with the rectangle; callers test their
+ * bounds.
+ *
+ * \param rect The area, in document coordinates.
+ * \param result Receives the indices, in increasing order and without repeats.
+ */
+void SPATIAL_GRID::query(const QRectF &rect, std::vector<size_t> &result) const
+{
+    result.clear();
+    if (rect.isEmpty() || cells.empty()) {
+        return;
+    }
+
+    size_t rows = cells.size() / columns;
+    int first_column = std::clamp(static_cast<int>(std::floor(rect.left() / SPATIAL_CELL_SIZE)), 0, columns - 1);
+    int last_column = std::clamp(static_cast<int>(std::floor(rect.right() / SPATIAL_CELL_SIZE)), 0, columns - 1);
+    size_t first_row = static_cast<size_t>(std::max(0.0, std::floor(rect.top() / SPATIAL_CELL_SIZE)));
+    size_t last_row = std::min(rows - 1, static_cast<size_t>(std::max(0.0, std::floor(rect.bottom() / SPATIAL_CELL_SIZE))));
+
+    for (size_t row = first_row; row <= last_row; ++row) {
+        for (int column = first_column; column <= last_column; ++column) {
+            const std::vector<size_t> &cell = cells[row * columns + column];
+            result.insert(result.end(), cell.begin(), cell.end());
+        }
+    }
+
+    // Entries spanning several cells were found once per cell
+    if (last_row > first_row || last_column > first_column) {
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+}
+
+/**
+ * \brief Returns the cell holding a point.
+ *
+ * \param point The point, in document coordinates.
+ * \return The cell's entries, or nullptr if no entry reaches that row.
+ */
+const std::vector<size_t> *SPATIAL_GRID::cell_at(const QPointF &point) const
+{
+    int column = std::clamp(static_cast<int>(std::floor(point.x() / SPATIAL_CELL_SIZE)), 0, columns - 1);
+    size_t row = static_cast<size_t>(std::max(0.0, std::floor(point.y() / SPATIAL_CELL_SIZE)));
+    if ((row + 1) * columns > cells.size()) {
+        return nullptr;
+    }
+    return &cells[row * columns + column];
+}
+
+/**
+ * \brief Draws one display list item.
+ *
+ * Reads only the item and the layout tree (geometry, glyph runs, images),
+ * never the DOM. Fonts are not shared with the layout thread: text is drawn
+ * with fonts the calling thread opened itself, taking only the glyphs and
+ * positions of the runs shaped at layout, whose raw fonts belong to the
+ * layout thread. Tile workers may therefore call it, as long as neither
+ * the list nor the tree is changed meanwhile. The item's layer opacity is
+ * applied by paint_items().
+ *
+ * \param painter The QPainter to draw with.
+ * \param item The item to draw.
+ * \param tree The layout tree the list was built from.
+ * \param origin Offset of the item's coordinates: the fixed root's position, or (0, 0).
+ */
+void paint_display_item(QPainter &painter, const DISPLAY_ITEM &item, const LAYOUT_TREE &tree, const QPointF &origin)
+{
+    const LAYOUT_BOX &box = tree.boxes[item.box];
+    float x = origin.x() + item.x;
+    float y = origin.y() + item.y;
+
+    switch (item.type) {
+    case DISPLAY_ITEM_TYPE::Image:
+        painter.drawImage(QRectF(x, y, box.width, box.height), tree.images[box.image]);
+        break;
+
+    case DISPLAY_ITEM_TYPE::Background:
+        painter.fillRect(QRectF(x, y, box.width, box.height), item.color);
+        break;
+
+    case DISPLAY_ITEM_TYPE::Border: {
+        QPen pen;
+        pen.setColor(item.color);
+        pen.setStyle(item.border_style);
+        pen.setWidthF(item.border_width);
+
+        painter.setPen(pen);
+        painter.setBrush(Qt::NoBrush);
+        painter.drawRect(x, y, box.width, box.height);
+        break;
+    }
+
+    case DISPLAY_ITEM_TYPE::Bullet:
+        painter.setFont(item.font->thread_font().font);
+        painter.setPen(item.color);
+        painter.drawText(x, y + item.font->ascent, "•");
+        break;
+
+    case DISPLAY_ITEM_TYPE::Text: {
+        const TEXT_FRAGMENT &fragment = tree.fragments[item.fragment];
+        const FONT_ENTRY &font = *item.font;
+        painter.setFont(font.thread_font().font);
+        painter.setPen(item.color);
+
+        float baseline_y = y + font.ascent;
+
+        // Draw the glyphs shaped at layout time in this thread's fonts
+        if (!fragment.glyph_runs.isEmpty()) {
+            for (size_t i = 0; i < fragment.glyph_run_fonts.size(); ++i) {
+                const QGlyphRun &shaped = fragment.glyph_runs[static_cast<qsizetype>(i)];
+                QGlyphRun glyph_run;
+                glyph_run.setRawFont(fragment.glyph_run_fonts[i]->thread_font().raw);
+                glyph_run.setGlyphIndexes(shaped.glyphIndexes());
+                glyph_run.setPositions(shaped.positions());
+                glyph_run.setFlags(shaped.flags());
+                painter.drawGlyphRun(QPointF(x, y), glyph_run);
+            }
+        }
+        else {
+            painter.drawText(x, baseline_y, item.text);
+        }
+
+        // Draw text decoration (underline, strikethrough, overline)
+        if (item.decoration != TEXT_DECORATION::None) {
+            QPen decoration_pen(item.color);
+            decoration_pen.setWidth(1);
+            painter.setPen(decoration_pen);
+
+            float decoration_y = 0;
+            switch (item.decoration) {
+            case TEXT_DECORATION::UnderLine:
+                decoration_y = baseline_y + 1;
+                break;
+            case TEXT_DECORATION::LineThrough:
+                decoration_y = y + font.ascent / 2;
+                break;
+            default:
+                decoration_y = y;
+                break;
+            }
+
+            painter.drawLine(x, decoration_y, x + fragment.width, decoration_y);
+        }
+        break;
+    }
+    }
+}
+
+/**
+ * \brief Draws items, compositing the layers nested in a given layer.
+ *
+ * Items of a nested layer are drawn into an offscreen image covering the
+ * part of the layer inside the area, which is then drawn with the layer's
+ * opacity. Overlapping items of a translucent subtree therefore blend as one
+ * group rather than each on their own. Open layers are kept on an explicit
+ * stack, so nesting depth is not limited by the call stack.
+ *
+ * \param painter The painter, transformed to the items' coordinates.
+ * \param list The display list.
+ * \param tree The layout tree the list was built from.
+ * \param items Indices of the items to draw, in paint order, all inside the layer.
+ * \param layer The layer painter draws into, or -1 for the document.
+ * \param area The part of the layer being drawn, in the items' coordinates.
+ */
+void paint_items(QPainter &painter, const DISPLAY_LIST &list, const LAYOUT_TREE &tree,
+                 const std::vector<size_t> &items, int layer, const QRectF &area)
+{
+    struct GROUP
+    {
+        int layer;
+        QRect rect; // the part of the layer drawn, in the items' coordinates
+        QImage image;
+        std::unique_ptr<QPainter> painter; // null for a layer with nothing visible
+    };
+
+    std::vector<GROUP> groups;
+    std::vector<int> path;
+
+    auto close_group = [&]() {
+        GROUP &group = groups.back();
+        if (group.painter) {
+            group.painter->end();
+
+            // A group is only drawn into when the groups around it are too
+            QPainter &target = groups.size() > 1 ? *groups[groups.size() - 2].painter : painter;
+            target.save();
+            target.setOpacity(list.layers[group.layer].opacity);
+            target.drawImage(group.rect.topLeft(), group.image);
+            target.restore();
+        }
+        groups.pop_back();
+    };
+
+    for (size_t index : items) {
+        const DISPLAY_ITEM &item = list.items[index];
+
+        // Layers between the target layer and the item's, outermost first
+        path.clear();
+        for (int outer = item.layer; outer >= 0 && outer != layer; outer = list.layers[outer].parent) {
+            path.push_back(outer);
+        }
+        std::reverse(path.begin(), path.end());
+
+        size_t common = 0;
+        while (common < groups.size() && common < path.size() && groups[common].layer == path[common]) {
+            ++common;
+        }
+        while (groups.size() > common) {
+            close_group();
+        }
+
+        bool visible = groups.empty() || groups.back().painter;
+        for (size_t i = common; i < path.size(); ++i) {
+            const DISPLAY_LAYER &nested = list.layers[path[i]];
+            GROUP group{path[i], nested.bounds.intersected(area).toAlignedRect(), QImage(), nullptr};
+
+            visible = visible && nested.opacity > 0 && !group.rect.isEmpty();
+            if (visible) {
+                group.image = QImage(group.rect.size(), QImage::Format_ARGB32_Premultiplied);
+                group.image.fill(Qt::transparent);
+                group.painter = std::make_unique<QPainter>(&group.image);
+                group.painter->setRenderHint(QPainter::Antialiasing);
+                group.painter->translate(-group.rect.x(), -group.rect.y());
+            }
+            groups.push_back(std::move(group));
+        }
+
+        if (!visible) {
+            continue;
+        }
+        paint_display_item(groups.empty() ? painter : *groups.back().painter, item, tree, QPointF());
+    }
+
+    while (!groups.empty()) {
+        close_group();
+    }
+}
+
+/**
+ * \brief Rasterizes the scrolling items covering one area of the document.
+ *
+ * Painting into a QImage does not involve the windowing system, so tiles can
+ * be rendered on worker threads. Composited layers are left out; they move
+ * with the scroll offset or animate, and are drawn over the tiles.
+ *
+ * \param list The display list.
+ * \param tree The layout tree the list was built from.
+ * \param tile_rect The area to render, in document coordinates.
+ * \return An image of the tile's size, with a white background.
+ */
+QImage render_tile(const DISPLAY_LIST &list, const LAYOUT_TREE &tree, const QRect &tile_rect)
+{
+    QImage image(tile_rect.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+
+    std::vector<size_t> items;
+    list.query(QRectF(tile_rect), items);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.translate(-tile_rect.x(), -tile_rect.y());
+    paint_items(painter, list, tree, items, -1, QRectF(tile_rect));
+    painter.end();
+
+    return image;
+}
+
+/**
+ * \brief Returns the area of a layer its image covers.
+ *
+ * \param layer The composited layer.
+ * \param clip The part of the layer needed; empty for all of it.
+ * \return The layer's aligned bounds, cut down to clip when they hold more
+ *         than MAX_LAYER_PIXELS.
+ */
+QRect layer_image_rect(const DISPLAY_LAYER &layer, const QRect &clip)
+{
+    QRect rect = layer.bounds.toAlignedRect();
+    if (!clip.isEmpty() && static_cast<int64_t>(rect.width()) * rect.height() > MAX_LAYER_PIXELS) {
+        rect &= clip;
+    }
+    return rect;
+}
+
+/**
+ * \brief Rasterizes a composited layer into an image of its own.
+ *
+ * The image is drawn at the layer's bounds, offset by where the fixed box
+ * currently is, with the layer's transform and opacity. Scrolling or
+ * animating it only changes how the image is drawn. The composited layers
+ * nested in it are left out; they have images of their own. Layers larger
+ * than MAX_LAYER_PIXELS are rasterized only where they cross clip, so a
+ * page-sized layer does not allocate a page-sized image.
+ *
+ * \param list The display list.
+ * \param tree The layout tree the list was built from.
+ * \param layer The index of the layer in list.layers.
+ * \param clip The part of the layer needed, in the layer's coordinates;
+ *        empty for all of it.
+ * \return The layer's content on a transparent background, covering
+ *         layer_image_rect(list.layers[layer], clip).
+ */
+QImage render_layer(const DISPLAY_LIST &list, const LAYOUT_TREE &tree, size_t layer, const QRect &clip)
+{
+    const DISPLAY_LAYER &target = list.layers[layer];
+    QRect rect = layer_image_rect(target, clip);
+    if (rect.isEmpty()) {
+        return QImage();
+    }
+
+    QImage image(rect.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    std::vector<size_t> items;
+    for (size_t i = target.first_item; i < target.end_item; ++i) {
+        if (list.items[i].composited_layer == static_cast<int>(layer)) {
+            items.push_back(i);
+        }
+    }
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.translate(-rect.x(), -rect.y());
+    paint_items(painter, list, tree, items, static_cast<int>(layer), QRectF(rect));
+    painter.end();
+
+    return image;
+}
+
+/**
+ * \brief Shows images that finished downloading in the boxes laid out for them.
+ *
+ * An img whose style reserved its size has an empty slot in tree.images,
+ * and an Image item in the display list already; the image is put into the
+ * slot and only that item needs repainting. Any other img changes the size
+ * of its box, so its node is marked layout-dirty and a partial relayout
+ * picks the image up from the cache. Boxes of a virtualized layout that
+ * were only estimated are skipped; they find the image when laid out.
+ *
+ * \param tree The laid-out tree; its image slots are filled in.
+ * \param list The display list built from tree.
+ * \param cache The cache holding the downloaded images.
+ * \param base_url The document's URL, which src attributes are relative to.
+ * \param urls The absolute URLs of the images now in the cache.
+ * \param repaint_items Receives the indexes of the Image items now showing an image.
+ * \param before_fill Called once before the first slot is written, so the
+ *        caller can wait for workers reading tree.images.
+ * \return True if an img was marked layout-dirty.
+ */
+bool fill_loaded_images(LAYOUT_TREE &tree, const DISPLAY_LIST &list, IMAGE_CACHE_MANAGER &cache,
+                        const QString &base_url, const std::unordered_set<QString> &urls,
+                        std::vector<size_t> &repaint_items, const std::function<void()> &before_fill)
+{
+    bool needs_layout = false;
+    std::unordered_set<int> filled_boxes;
+
+    for (int i = 0; i < static_cast<int>(tree.boxes.size()); ++i) {
+        const LAYOUT_BOX &box = tree.boxes[i];
+        if (box.estimated_count > 0 || box.node->get_type() != NODE_TYPE::ELEMENT || box.node->get_tag_name() != "img") {
+            continue;
+        }
+
+        QString url = resolve_url(base_url, QString::fromStdString(box.node->get_attribute("src")));
+        const QImage *cached = urls.count(url) > 0 ? cache.find(url) : nullptr;
+        if (!cached) {
+            continue;
+        }
+
+        if (box.image < 0) {
+            box.node->mark_layout_dirty();
+            needs_layout = true;
+        }
+        else if (tree.images[box.image].isNull()) {
+            if (filled_boxes.empty() && before_fill) {
+                before_fill();
+            }
+            tree.images[box.image] = *cached;
+            filled_boxes.insert(i);
+        }
+    }
+
+    repaint_items.clear();
+    for (size_t i = 0; i < list.items.size() && !filled_boxes.empty(); ++i) {
+        const DISPLAY_ITEM &item = list.items[i];
+        if (item.type == DISPLAY_ITEM_TYPE::Image && filled_boxes.count(item.box) > 0) {
+            repaint_items.push_back(i);
+        }
+    }
+
+    return needs_layout;
+}
@@ -0,0 +1,253 @@
+#include "css/font_cache.h"
+#include <algorithm>
+
+/**
+ * \brief Hashes a font description.
+ */
+size_t FONT_KEY_HASH::operator()(const FONT_KEY &key) const
+{
+    size_t hash = qHash(key.family);
+    hash = hash * 31 + static_cast<size_t>(key.pixel_size);
+    hash = hash * 31 + static_cast<size_t>(key.weight);
+    hash = hash * 31 + static_cast<size_t>(key.italic);
+    return hash;
+}
+
+/**
+ * \brief Builds the font a key describes.
+ *
+ * The font is built from scratch rather than copied from an interned entry,
+ * so a measuring thread can open it without touching data shared with
+ * other threads.
+ */
+QFont FONT_KEY::to_font() const
+{
+    QFont font;
+    font.setPixelSize(pixel_size);
+    font.setWeight(weight);
+    font.setFamily(family);
+    font.setItalic(italic);
+    return font;
+}
+
+/**
+ * \brief Measures the advance width of a word from its glyphs.
+ *
+ * Glyph advances come straight from the raw font, without the text shaping
+ * and font database lookups of QFontMetrics, which serialize concurrent
+ * measurement on a global lock. Words with characters the font has no glyph
+ * for are measured with QFontMetrics, which picks a fallback font.
+ *
+ * \param word The word (or single whitespace character) to measure.
+ * \param font The font, opened by the calling thread.
+ * \return The horizontal advance of the word in pixels.
+ */
+int measure_word(QStringView word, const THREAD_FONT &font)
+{
+    QString text = QString::fromRawData(word.data(), word.size());
+    QList<quint32> glyphs = font.raw.isValid() ? font.raw.glyphIndexesForString(text) : QList<quint32>();
+    if (glyphs.size() != text.size() || std::find(glyphs.begin(), glyphs.end(), 0u) != glyphs.end())
+    {
+        return QFontMetrics(font.font).horizontalAdvance(text);
+    }
+
+    qreal width = 0;
+    for (const QPointF &advance : font.raw.advancesForGlyphIndexes(glyphs, QRawFont::KernedAdvances))
+    {
+        width += advance.x();
+    }
+    return qRound(width);
+}
+
+/**
+ * \brief Creates an empty word-width cache.
+ *
+ * \param capacity Number of distinct words kept before the cache starts over.
+ */
+WORD_WIDTH_CACHE::WORD_WIDTH_CACHE(size_t capacity) : m_capacity(capacity)
+{
+}
+
+/**
+ * \brief Returns the advance width of a word, measuring it only on first use.
+ *
+ * Keys are views into strings owned by the cache, so a lookup never
+ * allocates. When the cache is full it is emptied and refilled by the words
+ * in use, which keeps memory bounded without per-entry bookkeeping.
+ *
+ * \param word The word (or single whitespace character) to measure.
+ * \param font The font the cache belongs to, opened by the calling thread.
+ * \return The horizontal advance of the word in pixels.
+ */
+int WORD_WIDTH_CACHE::width(QStringView word, const THREAD_FONT &font)
+{
+    std::u16string_view key(word.utf16(), static_cast<size_t>(word.size()));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_widths.find(key);
+    if (it != m_widths.end())
+    {
+        ++m_hits;
+        return it->second;
+    }
+
+    ++m_misses;
+    int word_width = measure_word(word, font);
+
+    if (m_widths.size() >= m_capacity)
+    {
+        m_widths.clear();
+        m_words.clear();
+    }
+
+    const std::u16string &stored = m_words.emplace_back(key);
+    m_widths.emplace(std::u16string_view(stored), word_width);
+    return word_width;
+}
+
+/**
+ * \brief Returns the hit and miss counts and the number of cached words.
+ */
+WORD_WIDTH_STATS WORD_WIDTH_CACHE::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return {m_hits, m_misses, m_widths.size()};
+}
+
+/**
+ * \brief Drops every cached width and resets the statistics.
+ */
+void WORD_WIDTH_CACHE::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_widths.clear();
+    m_words.clear();
+    m_hits = 0;
+    m_misses = 0;
+}
+
+/**
+ * \brief Builds a font and measures it once.
+ *
+ * \param key The font's description.
+ */
+FONT_ENTRY::FONT_ENTRY(const FONT_KEY &key) : key(key), font(key.to_font())
+{
+    QFontMetrics metrics(font);
+    ascent = metrics.ascent();
+    line_height = metrics.height();
+}
+
+/**
+ * \brief Returns the advance width of a word in this font, through the word cache.
+ *
+ * \param word The word to measure.
+ * \return The horizontal advance in pixels.
+ */
+int FONT_ENTRY::word_width(QStringView word) const
+{
+    return word_widths.width(word, thread_font());
+}
+
+/**
+ * \brief Returns this font as opened by the calling thread.
+ *
+ * Fonts are interned by whichever thread styles an element first, while
+ * layout, its prepass and tile workers each measure or draw on threads of
+ * their own. Each thread therefore opens every font it uses once, from the
+ * key, and keeps it until the thread ends.
+ */
+const THREAD_FONT &FONT_ENTRY::thread_font() const
+{
+    thread_local std::unordered_map<const FONT_ENTRY *, THREAD_FONT> fonts;
+
+    auto [it, inserted] = fonts.try_emplace(this);
+    if (inserted)
+    {
+        it->second.font = key.to_font();
+        it->second.raw = QRawFont::fromFont(it->second.font);
+    }
+    return it->second;
+}
+
+/**
+ * \brief Returns the process-wide font cache used by style, layout and paint.
+ */
+FONT_CACHE &FONT_CACHE::shared()
+{
+    static FONT_CACHE cache;
+    return cache;
+}
+
+/**
+ * \brief Returns the ID of a font, creating the entry on first use.
+ *
+ * A page uses only a handful of distinct fonts, so entries are never evicted
+ * and an ID stays valid for the lifetime of the process. Safe to call from
+ * concurrent style workers.
+ *
+ * \param family The font family name.
+ * \param pixel_size The font size in pixels.
+ * \param weight The font weight.
+ * \param italic Whether the font is italic.
+ * \return The ID of the matching entry.
+ */
+int FONT_CACHE::intern(const QString &family, int pixel_size, QFont::Weight weight, bool italic)
+{
+    FONT_KEY key{family, pixel_size, weight, italic};
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_ids.find(key);
+    if (it != m_ids.end())
+    {
+        return it->second;
+    }
+
+    int id = static_cast<int>(m_entries.size());
+    m_entries.emplace_back(key);
+    m_ids.emplace(std::move(key), id);
+    return id;
+}
+
+/**
+ * \brief Returns the entry for an ID obtained from intern().
+ *
+ * Entries live in a deque, so references stay valid while other threads
+ * add new fonts.
+ *
+ * \param id The font ID.
+ * \return The cached font, metrics, ascent and line height.
+ */
+const FONT_ENTRY &FONT_CACHE::get(int id) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries[id];
+}
+
+/**
+ * \brief Returns the number of distinct fonts interned so far.
+ */
+size_t FONT_CACHE::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+/**
+ * \brief Sums the word-width cache statistics of every font.
+ */
+WORD_WIDTH_STATS FONT_CACHE::word_width_stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    WORD_WIDTH_STATS total;
+    for (const auto &entry : m_entries)
+    {
+        WORD_WIDTH_STATS stats = entry.word_widths.stats();
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.entries += stats.entries;
+    }
+    return total;
+}
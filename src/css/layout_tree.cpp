@@ -1,5 +1,76 @@
 #include "css/layout_tree.h"
 #include "util_functions.h"
+#include "work_stealing_pool.h"
+#include <QStringView>
+#include <QTextLayout>
+#include <algorithm>
+#include <string_view>
+
+/**
+ * \brief Reports whether a character separates words in text layout.
+ *
+ * Only ASCII whitespace breaks words; a non-breaking space stays part of its word.
+ */
+static bool is_layout_space(QChar c)
+{
+    char16_t u = c.unicode();
+    return u == ' ' || u == '\t' || u == '\n' || u == '\r' || u == '\f' || u == '\v';
+}
+
+/**
+ * \brief Finds the end of the layout token starting at a position.
+ *
+ * Every whitespace character is its own token, as is every run of
+ * non-whitespace characters. Text layout and the measurement prepass
+ * split text the same way, so their widths line up token for token.
+ */
+static qsizetype token_end(const QString &text, qsizetype position)
+{
+    qsizetype end = position + 1;
+    if (!is_layout_space(text[position])) {
+        while (end < text.size() && !is_layout_space(text[end])) {
+            ++end;
+        }
+    }
+    return end;
+}
+
+/**
+ * \brief Computes a box's overflow rectangle from its children's.
+ *
+ * Called when a box's own size and its children's positions are final, so
+ * the overflow of the whole tree is built bottom-up during layout and the
+ * root's scrollable extent is read off directly. Fixed-position children
+ * stay in the viewport and do not extend the scrollable area.
+ *
+ * \param tree The layout tree.
+ * \param index The index of the box to finish.
+ */
+static void finish_overflow(LAYOUT_TREE &tree, int index)
+{
+    LAYOUT_BOX &box = tree.boxes[index];
+    QRectF overflow(0, 0, box.width, box.height);
+
+    for (int child = box.first_child; child >= 0; child = tree.boxes[child].next_sibling) {
+        const LAYOUT_BOX &child_box = tree.boxes[child];
+        overflow |= child_box.overflow.translated(child_box.x, child_box.y);
+    }
+
+    for (int child = box.first_absolute_child; child >= 0; child = tree.boxes[child].next_sibling) {
+        const LAYOUT_BOX &child_box = tree.boxes[child];
+        if (child_box.style->position != POSITION_TYPE::Fixed) {
+            overflow |= child_box.overflow.translated(child_box.x, child_box.y);
+        }
+    }
+
+    // Fragments are positioned in the parent's coordinates, like the box itself
+    for (size_t i = 0; i < box.fragment_count; ++i) {
+        const TEXT_FRAGMENT &fragment = tree.fragments[box.first_fragment + i];
+        overflow |= QRectF(fragment.x - box.x, fragment.y - box.y, fragment.width, fragment.height);
+    }
+
+    box.overflow = overflow;
+}
 
 // ============================================================================
 // Image Layout Helper
@@ -10,46 +81,42 @@
  * 
  * Loads the image from various sources (local file, URL, or data URI),
  * calculates dimensions based on CSS width/height properties, and positions
- * the image within the layout flow.
+ * the image within the layout flow. An image still downloading whose width
+ * and height are both set gets its box and an empty image slot anyway, so
+ * it can be filled in when the image arrives without a relayout.
  * 
  * \param node The image node
- * \param base_url Base URL for resolving relative image URLs
- * \param image_cache_manager Image cache manager for loading remote images
  * \param line Current line state for positioning
- * \return LAYOUT_BOX containing the image layout
+ * \param context The layout tree being built, base URL and image cache manager
+ * \return Index of the image box in the layout tree
  */
-LAYOUT_BOX layout_image_element(
-    std::shared_ptr<NODE> node,
-    const QString &base_url,
-    IMAGE_CACHE_MANAGER *image_cache_manager,
-    LINE_STATE &line)
+int layout_image_element(
+    NODE *node,
+    LINE_STATE &line,
+    LAYOUT_CONTEXT &context)
 {
-    LAYOUT_BOX box;
-    box.node = node;
-    box.style = node->get_all_styles();
+    LAYOUT_TREE &tree = context.tree;
+    int index = tree.add_box(node);
+    const COMPUTED_STYLE &style = node->get_computed_style();
 
     QString src = QString::fromStdString(node->get_attribute("src"));
     if (src.isEmpty())
-        return box;
+        return index;
 
-    QString absolute_url = resolve_url(base_url, src);
-    QPixmap image;
+    QString absolute_url = resolve_url(context.base_url, src);
+    QImage image;
 
     if (absolute_url.startsWith("file://")) {
         QString local_path = QUrl(absolute_url).toLocalFile();
         image.load(local_path);
     }
     else if (absolute_url.startsWith("http://") || absolute_url.startsWith("https://")) {
-        auto image_it = image_cache_manager->image_cacher.find(absolute_url);
-        if (image_it != image_cache_manager->image_cacher.end() && !image_it->second.isNull()) {
-            image = image_it->second;
+        // Every pass asks again; the cache sends one request per URL
+        if (const QImage *cached = context.image_cache_manager->find(absolute_url)) {
+            image = *cached;
         }
         else {
-            box.width = 0;
-            box.height = 0;
-            image_cache_manager->image_network_manager->get(QNetworkRequest(src));
-            image_cache_manager->src = absolute_url;
-            return box;
+            context.image_cache_manager->request(absolute_url);
         }
     }
     else if (absolute_url.startsWith("data:")) {
@@ -61,67 +128,140 @@ LAYOUT_BOX layout_image_element(
         }
     }
 
-    if (!image.isNull()) {
+    bool size_reserved = style.width > 0 && style.height > 0;
+    if (!image.isNull() || size_reserved) {
+        LAYOUT_BOX &box = tree.boxes[index];
+
         // Calculate dimensions based on CSS properties
-        if (box.style.width < 0 && box.style.height < 0) {
+        if (size_reserved) {
+            box.width = style.width;
+            box.height = style.height;
+        }
+        else if (style.width < 0 && style.height < 0) {
             box.width = image.width();
             box.height = image.height();
         }
-        else if (box.style.width > 0 && box.style.height < 0) {
-            box.width = box.style.width;
+        else if (style.width > 0 && style.height < 0) {
+            box.width = style.width;
             box.height = box.width * image.height() / image.width();
         }
-        else if (box.style.width < 0 && box.style.height > 0) {
-            box.height = box.style.height;
+        else if (style.width < 0 && style.height > 0) {
+            box.height = style.height;
             box.width = box.height * image.width() / image.height();
         }
         else {
-            box.width = box.style.width;
-            box.height = box.style.height;
+            box.width = style.width;
+            box.height = style.height;
         }
 
-        box.image = image;
-        box.x = box.style.margin_left;
-        box.y = line.current_y + box.style.margin_top;
-        line.current_y = box.y + box.height + box.style.margin_bottom;
+        box.image = static_cast<int>(tree.images.size());
+        tree.images.push_back(image);
+        box.x = style.margin_left;
+        box.y = line.current_y + style.margin_top;
+        line.current_y = box.y + box.height + style.margin_bottom;
     }
 
-    return box;
+    finish_overflow(tree, index);
+    return index;
 }
 
 // ============================================================================
 // Text Layout Helper
 // ============================================================================
 
+/**
+ * \brief Shapes one line fragment into glyph runs.
+ *
+ * Runs once per fragment when text is laid out, so painting a line is a
+ * single glyph-run draw without reshaping. Glyph positions are relative to
+ * the fragment's top-left corner, with the baseline at the font's ascent.
+ *
+ * \param text The text node's content.
+ * \param fragment The fragment to shape.
+ * \param font The font the text is laid out with.
+ * \return The glyph runs of the fragment.
+ */
+static QList<QGlyphRun> shape_fragment(const QString &text, const TEXT_FRAGMENT &fragment, const QFont &font)
+{
+    QTextLayout text_layout(QString::fromRawData(text.constData() + fragment.offset, static_cast<qsizetype>(fragment.length)), font);
+    text_layout.beginLayout();
+    QTextLine text_line = text_layout.createLine();
+    if (!text_line.isValid()) {
+        text_layout.endLayout();
+        return {};
+    }
+    text_line.setPosition(QPointF(0, 0));
+    text_layout.endLayout();
+
+    return text_layout.glyphRuns();
+}
+
+/**
+ * \brief Returns the interned font a glyph run was shaped with.
+ *
+ * A run's raw font may only be used on the layout thread, so paint threads
+ * open the font themselves from its entry. Runs of characters the style's
+ * font lacks were shaped with a fallback font, which is interned under its
+ * own family so the glyph indexes refer to the same font file.
+ */
+static const FONT_ENTRY *run_font(const QGlyphRun &run, const FONT_ENTRY &font)
+{
+    QString family = run.rawFont().familyName();
+    if (family.isEmpty() || family == font.key.family) {
+        return &font;
+    }
+
+    FONT_CACHE &cache = FONT_CACHE::shared();
+    return &cache.get(cache.intern(family, font.key.pixel_size, font.key.weight, font.key.italic));
+}
+
 /**
  * \brief Handles layout calculation for text nodes.
  * 
  * Splits text into words and calculates their positions on the current line,
- * handling word wrapping when content exceeds available width.
+ * handling word wrapping when content exceeds available width. Words that
+ * end up on the same line are merged into a single TEXT_FRAGMENT referring
+ * to a range of the node's text, so a paragraph produces one fragment per
+ * line rather than one box per word. Each fragment is shaped into glyph
+ * runs here, so paint never reshapes text. Word widths come from the
+ * context's measurement table when measure_text covered the node.
  * 
  * \param root The text node
- * \param style The computed style for the text
  * \param line Current line state for positioning
- * \return LAYOUT_BOX containing the text layout
+ * \param context The layout tree being built
+ * \return Index of the text box in the layout tree
  */
-LAYOUT_BOX layout_text_element(
-    std::shared_ptr<NODE> root,
-    const COMPUTED_STYLE &style,
-    LINE_STATE &line)
+int layout_text_element(
+    NODE *root,
+    LINE_STATE &line,
+    LAYOUT_CONTEXT &context)
 {
-    LAYOUT_BOX box;
-    box.node = root;
-    box.style = style;
+    LAYOUT_TREE &tree = context.tree;
+    int index = tree.add_box(root);
+    const COMPUTED_STYLE &style = root->get_computed_style();
+    size_t first_fragment = tree.fragments.size();
+
+    const FONT_ENTRY &font = style.font();
+    const QString &text = root->get_text_utf16();
+    float word_height = font.line_height;
 
-    QFont font = style.to_font();
-    QFontMetrics metrics(font);
+    // Widths measured by the parallel prepass, if it covered this node
+    const std::vector<int> *measured = nullptr;
+    if (context.measurements) {
+        auto measured_it = context.measurements->word_widths.find(root);
+        if (measured_it != context.measurements->word_widths.end()) {
+            measured = &measured_it->second;
+        }
+    }
 
-    std::string text = root->get_text_content();
-    std::vector<std::string> words = split_into_words(text);
+    size_t token = 0;
+    qsizetype position = 0;
+    while (position < text.size()) {
+        qsizetype word_end = token_end(text, position);
 
-    for (auto &word : words) {
-        int word_width = metrics.horizontalAdvance(QString::fromStdString(word));
-        int word_height = metrics.height();
+        QStringView word(text.constData() + position, word_end - position);
+        int word_width = measured && token < measured->size() ? (*measured)[token] : font.word_width(word);
+        ++token;
 
         bool will_wrap = (line.current_x + word_width > line.max_width) && line.current_x > 0;
         if (will_wrap) {
@@ -130,189 +270,656 @@ LAYOUT_BOX layout_text_element(
             line.line_height = 0;
         }
 
-        LAYOUT_BOX word_box;
-        word_box.node = root;
-        word_box.text = word;
-        word_box.style = style;
-        word_box.x = line.current_x;
-        word_box.y = line.current_y;
-        word_box.width = word_width;
-        word_box.height = word_height;
+        if (will_wrap || tree.fragments.size() == first_fragment) {
+            tree.fragments.push_back({static_cast<size_t>(position), 0, line.current_x, line.current_y, 0, word_height, {}});
+        }
 
-        box.children.push_back(word_box);
+        TEXT_FRAGMENT &fragment = tree.fragments.back();
+        fragment.length += static_cast<size_t>(word.size());
+        fragment.width += word_width;
         line.current_x += word_width;
 
-        float effective_line_height = std::max(static_cast<float>(word_height), style.line_height);
+        float effective_line_height = std::max(word_height, style.line_height);
         if (effective_line_height > line.line_height) {
             line.line_height = effective_line_height;
         }
+
+        position = word_end;
+    }
+
+    LAYOUT_BOX &box = tree.boxes[index];
+    box.first_fragment = first_fragment;
+    box.fragment_count = tree.fragments.size() - first_fragment;
+
+    for (size_t i = first_fragment; i < tree.fragments.size(); ++i) {
+        TEXT_FRAGMENT &fragment = tree.fragments[i];
+        fragment.glyph_runs = shape_fragment(text, fragment, font.font);
+        fragment.glyph_run_fonts.clear();
+        for (const QGlyphRun &run : fragment.glyph_runs) {
+            fragment.glyph_run_fonts.push_back(run_font(run, font));
+        }
     }
 
-    if (!box.children.empty()) {
-        box.x = box.children[0].x;
-        box.y = box.children[0].y;
+    if (box.fragment_count > 0) {
+        box.x = tree.fragments[first_fragment].x;
+        box.y = tree.fragments[first_fragment].y;
         box.width = line.current_x - box.x;
         box.height = line.line_height;
     }
 
-    return box;
+    finish_overflow(tree, index);
+    return index;
 }
 
 // ============================================================================
-// Block Layout Helper
+// Text Measurement Prepass
 // ============================================================================
 
 /**
- * \brief Handles layout calculation for block-level elements.
- * 
- * Calculates width, positions children vertically, handles absolute/fixed
- * positioned children separately, and calculates height based on content.
- * 
- * \param root The block element node
- * \param parent_width Available width for layout
- * \param line Current line state
- * \param base_url Base URL for resource resolution
- * \param image_cache_manager Image cache manager
- * \return LAYOUT_BOX containing the block layout
+ * \brief Measures the tokens of a batch of text nodes on one thread.
+ *
+ * Fonts are opened by the measuring thread itself, so concurrent batches
+ * share no font objects. Words are measured from glyph advances, which only
+ * takes the font database lock when a thread first opens a font, or for
+ * words needing a fallback font. Words repeated within the batch are
+ * measured once.
+ *
+ * \param jobs The collected text nodes and the vectors receiving their widths.
+ * \param begin The first job of the batch.
+ * \param end One past the last job of the batch.
  */
-LAYOUT_BOX layout_block_element(
-    std::shared_ptr<NODE> root,
-    float parent_width,
-    LINE_STATE &line,
-    const QString &base_url,
-    IMAGE_CACHE_MANAGER *image_cache_manager)
+static void measure_batch(const std::vector<std::pair<NODE *, std::vector<int> *>> &jobs, size_t begin, size_t end)
 {
-    LAYOUT_BOX box;
-    box.node = root;
-    box.style = root->get_all_styles();
+    std::unordered_map<int, std::unordered_map<std::u16string_view, int>> widths_by_font;
 
-    // Calculate width
-    if (box.style.width > 0) {
-        box.width = box.style.width;
-    }
-    else {
-        box.width = parent_width - box.style.margin_left - box.style.margin_right;
-    }
+    for (size_t i = begin; i < end; ++i) {
+        NODE *node = jobs[i].first;
+        std::vector<int> &widths = *jobs[i].second;
+        const COMPUTED_STYLE &style = node->get_computed_style();
+        const QString &text = node->get_text_utf16();
 
-    box.is_positioned = box.style.position != POSITION_TYPE::Static;
+        const THREAD_FONT &font = style.font().thread_font();
+        std::unordered_map<std::u16string_view, int> &known = widths_by_font[style.font_id];
 
-    // Initialize line state for block's children
-    line.current_x = box.style.padding_left;
-    line.current_y = box.style.padding_top;
-    line.line_height = 0;
-    line.max_width = box.width - box.style.padding_right - box.style.padding_left;
-    line.padding_left = box.style.padding_left;
+        qsizetype position = 0;
+        while (position < text.size()) {
+            qsizetype word_end = token_end(text, position);
+            std::u16string_view key(text.utf16() + position, static_cast<size_t>(word_end - position));
+
+            auto known_it = known.find(key);
+            if (known_it == known.end()) {
+                int width = measure_word(QStringView(text.constData() + position, word_end - position), font);
+                known_it = known.emplace(key, width).first;
+            }
+            widths.push_back(known_it->second);
+            position = word_end;
+        }
+    }
+}
 
-    float content_y = box.style.padding_top;
-    float child_parent_width = box.width - box.style.padding_left - box.style.padding_right;
+/**
+ * \brief Measures the words of every text node the next layout pass will break into lines.
+ *
+ * Font measurement dominates the layout of text-heavy pages but, unlike
+ * line breaking, does not depend on where earlier text ended. The text
+ * nodes are collected first, then measured in batches on the shared
+ * work-stealing pool; create_layout_tree consumes the table through
+ * LAYOUT_CONTEXT::measurements and breaks lines sequentially, so the
+ * result is identical to measuring during layout. Clean blocks that the
+ * previous pass's cache will probably supply are skipped, unless the layout
+ * width changed since the last measurement, which would make the cached
+ * blocks too wide or too narrow to be reused, or they hold estimated
+ * heights. A skipped block that layout does not reuse after all is
+ * measured on the layout thread.
+ *
+ * \param root The root of the DOM tree about to be laid out.
+ * \param width The width the tree is about to be laid out in.
+ * \param previous_cache The previous layout pass's cache, or nullptr.
+ * \param measurements Receives one width per token for each collected text node.
+ */
+void measure_text(
+    NODE *root,
+    float width,
+    const LAYOUT_CACHE *previous_cache,
+    TEXT_MEASUREMENTS &measurements)
+{
+    if (measurements.width != width) {
+        previous_cache = nullptr;
+    }
+    measurements.clear();
+    measurements.width = width;
 
-    for (auto child : root->get_children()) {
-        LAYOUT_BOX child_box = create_layout_tree(child, child_parent_width, line, base_url, image_cache_manager);
+    std::vector<std::pair<NODE *, std::vector<int> *>> jobs;
+    std::vector<NODE *> stack{root};
+    while (!stack.empty()) {
+        NODE *node = stack.back();
+        stack.pop_back();
 
-        // Handle positioned children
-        if (child_box.style.position == POSITION_TYPE::Absolute) {
-            if (child_box.style.width > 0) {
-                child_box.width = child_box.style.width;
-            } else {
-                child_box.width = child_parent_width;
-            }
-            child_box.x = box.style.padding_left + child_box.style.left;
-            child_box.y = box.style.padding_top + child_box.style.top;
-            box.absolute_children.push_back(child_box);
+        const COMPUTED_STYLE &style = node->get_computed_style();
+        if (!node->is_style_resolved() || style.display == DISPLAY_TYPE::NONE) {
             continue;
         }
-        else if (child_box.style.position == POSITION_TYPE::Fixed) {
-            if (child_box.style.width > 0) {
-                child_box.width = child_box.style.width;
-            } else {
-                child_box.width = child_parent_width;
-            }
-            child_box.x = 0;
-            child_box.y = 0;
-            box.absolute_children.push_back(child_box);
+
+        if (node->get_type() == NODE_TYPE::TEXT) {
+            jobs.emplace_back(node, &measurements.word_widths[node]);
             continue;
         }
 
-        // Position child in flow
-        if (child_box.style.display == DISPLAY_TYPE::BLOCK) {
-            child_box.x = child_box.style.margin_left + box.style.padding_left;
-            child_box.y = content_y + child_box.style.margin_top;
-            content_y += child_box.height + child_box.style.margin_top + child_box.style.margin_bottom;
-            line.current_x = box.style.padding_left;
-            line.current_y = content_y;
-            line.line_height = 0;
+        bool layout_clean = !node->is_layout_dirty() && !node->has_layout_dirty_descendant();
+        if (layout_clean && style.display == DISPLAY_TYPE::BLOCK && previous_cache) {
+            auto entry_it = previous_cache->find(node);
+            if (entry_it != previous_cache->end() && !entry_it->second.has_estimates) {
+                continue;
+            }
         }
-        else {
-            float inline_bottom = line.current_y + line.line_height;
-            if (inline_bottom > content_y) {
-                content_y = inline_bottom;
+
+        const auto &children = node->get_children();
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {
+            stack.push_back(it->get());
+        }
+    }
+
+    if (jobs.empty()) {
+        return;
+    }
+
+    // A few batches per thread, so stealing evens out uneven text lengths
+    WORK_STEALING_POOL &pool = WORK_STEALING_POOL::shared();
+    size_t batch_size = std::max<size_t>(16, jobs.size() / (pool.thread_count() * 4));
+
+    TASK_GROUP group;
+    for (size_t begin = batch_size; begin < jobs.size(); begin += batch_size) {
+        size_t end = std::min(begin + batch_size, jobs.size());
+        pool.submit([&jobs, begin, end]() { measure_batch(jobs, begin, end); }, &group);
+    }
+    measure_batch(jobs, 0, std::min(batch_size, jobs.size()));
+    pool.wait(group);
+}
+
+/**
+ * \brief Drops every measured width, keeping the table's buckets.
+ */
+void TEXT_MEASUREMENTS::clear()
+{
+    word_widths.clear();
+}
+
+// ============================================================================
+// Block Layout Helper
+// ============================================================================
+
+/**
+ * \brief Resolves the width of a block box from its style and the available width.
+ */
+static float block_width(const COMPUTED_STYLE &style, float parent_width)
+{
+    if (style.width > 0) {
+        return style.width;
+    }
+    return parent_width - style.margin_left - style.margin_right;
+}
+
+/**
+ * \brief Resolves a node's relative lengths for this pass, before its style is read.
+ *
+ * Percentages refer to the width the node is laid out in, or to the viewport
+ * for fixed boxes. Only nodes with relative lengths pay for this.
+ *
+ * \param node The node about to be laid out or estimated.
+ * \param containing_width The width available to the node.
+ * \param context The layout context holding the viewport and root font size.
+ */
+static void resolve_lengths(NODE *node, float containing_width, LAYOUT_CONTEXT &context)
+{
+    const COMPUTED_STYLE &style = node->get_computed_style();
+    if (style.relative_lengths.empty()) {
+        return;
+    }
+
+    bool fixed = style.position == POSITION_TYPE::Fixed;
+    LENGTH_BASIS basis;
+    basis.containing_width = fixed ? context.viewport_width : containing_width;
+    basis.containing_height = fixed ? context.viewport_height : -1;
+    basis.root_font_size = context.root_font_size;
+    basis.viewport_width = context.viewport_width;
+    basis.viewport_height = context.viewport_height;
+
+    if (node->resolve_lengths(basis) || fixed) {
+        ++context.viewport_lengths;
+    }
+}
+
+/**
+ * \brief Copies a clean block's subtree from the previous layout pass.
+ *
+ * A block's layout depends only on its resolved width and its subtree: it
+ * resets the line state for its children, and its parent assigns its
+ * position afterwards. When no node in the subtree is layout-dirty and the
+ * width matches the one the block was last laid out with, its boxes,
+ * fragments and images are appended unchanged with their indices rebased,
+ * and the line state it left behind is restored. Cache entries of the
+ * blocks inside are carried over so they stay reusable on the next pass.
+ *
+ * \param root The block element node, known to be layout-clean.
+ * \param width The block's resolved width for this pass.
+ * \param line Current line state, set to the state the block left last time.
+ * \param context The layout tree being built and the previous pass's tree and cache.
+ * \return Index of the copied block box, or -1 if the block has to be laid out.
+ */
+static int reuse_cached_block(NODE *root, float width, LINE_STATE &line, LAYOUT_CONTEXT &context)
+{
+    if (!context.previous_tree || !context.previous_cache) {
+        return -1;
+    }
+
+    auto entry_it = context.previous_cache->find(root);
+    if (entry_it == context.previous_cache->end() || entry_it->second.width != width || entry_it->second.has_estimates) {
+        return -1;
+    }
+
+    const LAYOUT_CACHE_ENTRY &entry = entry_it->second;
+    if (entry.uses_viewport) {
+        if (entry.viewport_width != context.viewport_width || entry.viewport_height != context.viewport_height ||
+            entry.root_font_size != context.root_font_size) {
+            return -1;
+        }
+        ++context.viewport_lengths;
+    }
+    const LAYOUT_TREE &previous = *context.previous_tree;
+    LAYOUT_TREE &tree = context.tree;
+
+    int box_delta = static_cast<int>(tree.boxes.size()) - entry.first_box;
+    size_t fragment_base = tree.fragments.size();
+    int image_delta = static_cast<int>(tree.images.size()) - static_cast<int>(entry.first_image);
+    auto rebase = [box_delta](int index) { return index >= 0 ? index + box_delta : index; };
+
+    for (int i = entry.first_box; i < entry.end_box; ++i) {
+        LAYOUT_BOX box = previous.boxes[i];
+        box.parent = rebase(box.parent);
+        box.first_child = rebase(box.first_child);
+        box.last_child = rebase(box.last_child);
+        box.first_absolute_child = rebase(box.first_absolute_child);
+        box.last_absolute_child = rebase(box.last_absolute_child);
+        box.next_sibling = rebase(box.next_sibling);
+        box.first_fragment = box.first_fragment - entry.first_fragment + fragment_base;
+        if (box.image >= 0) {
+            box.image += image_delta;
+        }
+
+        // The repaint after relayout covers pending paint-only changes
+        box.node->clear_paint_dirty();
+
+        if (i != entry.first_box && context.cache) {
+            auto inner_it = context.previous_cache->find(box.node);
+            if (inner_it != context.previous_cache->end() && inner_it->second.first_box == i) {
+                LAYOUT_CACHE_ENTRY inner = inner_it->second;
+                inner.first_box += box_delta;
+                inner.end_box += box_delta;
+                inner.first_fragment = inner.first_fragment - entry.first_fragment + fragment_base;
+                inner.end_fragment = inner.end_fragment - entry.first_fragment + fragment_base;
+                inner.first_image += image_delta;
+                inner.end_image += image_delta;
+                (*context.cache)[box.node] = inner;
             }
         }
 
-        box.children.push_back(child_box);
+        tree.boxes.push_back(box);
     }
 
-    // Calculate height
-    if (box.style.height > 0) {
-        box.height = box.style.height;
-    } else {
-        box.height = content_y + box.style.padding_bottom;
+    tree.fragments.insert(tree.fragments.end(),
+                          previous.fragments.begin() + entry.first_fragment,
+                          previous.fragments.begin() + entry.end_fragment);
+    tree.images.insert(tree.images.end(),
+                       previous.images.begin() + entry.first_image,
+                       previous.images.begin() + entry.end_image);
+
+    int index = entry.first_box + box_delta;
+    tree.boxes[index].parent = -1;
+    tree.boxes[index].next_sibling = -1;
+
+    if (context.cache) {
+        LAYOUT_CACHE_ENTRY copied = entry;
+        copied.first_box = index;
+        copied.end_box = static_cast<int>(tree.boxes.size());
+        copied.first_fragment = fragment_base;
+        copied.end_fragment = tree.fragments.size();
+        copied.first_image = entry.first_image + image_delta;
+        copied.end_image = tree.images.size();
+        (*context.cache)[root] = copied;
+    }
+
+    context.reused_boxes += static_cast<size_t>(entry.end_box - entry.first_box);
+    line = entry.line_after;
+    return index;
+}
+
+/**
+ * \brief Reports whether virtualized layout may replace a child by an estimate.
+ *
+ * Only in-flow blocks qualify: their height is all their parent needs from
+ * them. Positioned boxes may be drawn anywhere, and inline content shares
+ * lines with its siblings.
+ */
+static bool is_virtualizable(const NODE *node)
+{
+    if (node->get_type() != NODE_TYPE::ELEMENT || !node->is_style_resolved()) {
+        return false;
+    }
+    const COMPUTED_STYLE &style = node->get_computed_style();
+    return style.display == DISPLAY_TYPE::BLOCK && style.position == POSITION_TYPE::Static &&
+           node->get_tag_name() != "img";
+}
+
+/**
+ * \brief Estimates the height a block would take, margins included, without laying it out.
+ *
+ * The block's exact height from an earlier pass is used when known; the
+ * estimates are refined that way as the user scrolls blocks into view.
+ * Otherwise the average of the siblings laid out so far is used, and
+ * failing that a single line of the block's font.
+ *
+ * \param node The block to estimate.
+ * \param sibling_average Average height of exactly laid-out siblings, or 0 if none.
+ * \param context The layout context holding the known block heights.
+ * \return The estimated height in pixels.
+ */
+static float estimate_block_height(const NODE *node, float sibling_average, const LAYOUT_CONTEXT &context)
+{
+    if (context.block_heights) {
+        auto it = context.block_heights->find(node);
+        if (it != context.block_heights->end()) {
+            return it->second;
+        }
+    }
+
+    if (sibling_average > 0) {
+        return sibling_average;
     }
 
-    return box;
+    const COMPUTED_STYLE &style = node->get_computed_style();
+    float height = style.height > 0 ? style.height : style.font().line_height + style.padding_top + style.padding_bottom;
+    return height + style.margin_top + style.margin_bottom;
 }
 
 // ============================================================================
-// Inline Layout Helper
+// Iterative Traversal
 // ============================================================================
 
+// Returned by open_box when the node's children still have to be laid out
+static constexpr int LAYOUT_PENDING = -2;
+
+// A block or inline box whose children are being laid out
+struct LAYOUT_FRAME
+{
+    NODE *node = nullptr;
+    int index = -1;
+    bool is_block = false;
+    size_t next_child = 0;
+    float parent_width = 0; // passed on to the children of inline boxes
+
+    // Block state
+    float child_parent_width = 0;
+    float content_y = 0;
+    float origin_y = 0;
+    const LAYOUT_VIEWPORT *viewport = nullptr;
+    int placeholder = -1;
+    float sibling_height_total = 0;
+    int sibling_count = 0;
+    size_t first_fragment = 0;
+    size_t first_image = 0;
+    size_t estimated_before = 0;
+    size_t viewport_lengths_before = 0;
+
+    // Inline state
+    float start_x = 0;
+    float start_line_height = 0;
+};
+
 /**
- * \brief Handles layout calculation for inline elements.
- * 
- * Processes children inline with proper spacing, wrapping across lines,
- * and height calculation considering padding.
- * 
- * \param root The inline element node
- * \param parent_width Available width for layout
- * \param line Current line state
- * \param base_url Base URL for resource resolution
- * \param image_cache_manager Image cache manager
- * \return LAYOUT_BOX containing the inline layout
+ * \brief Creates a block's box and pushes the frame that lays out its children.
+ *
+ * \param root The block element node.
+ * \param parent_width Available width for layout.
+ * \param line Current line state, reset for the block's children.
+ * \param context The layout tree being built.
+ * \param stack The traversal stack receiving the block's frame.
  */
-LAYOUT_BOX layout_inline_element(
-    std::shared_ptr<NODE> root,
-    float parent_width,
-    LINE_STATE &line,
-    const QString &base_url,
-    IMAGE_CACHE_MANAGER *image_cache_manager)
+static void begin_block(NODE *root, float parent_width, LINE_STATE &line, LAYOUT_CONTEXT &context,
+                        std::vector<LAYOUT_FRAME> &stack)
 {
-    LAYOUT_BOX box;
-    box.node = root;
-    box.style = root->get_all_styles();
+    LAYOUT_TREE &tree = context.tree;
+    const COMPUTED_STYLE &style = root->get_computed_style();
+
+    LAYOUT_FRAME frame;
+    frame.node = root;
+    frame.index = tree.add_box(root);
+    frame.is_block = true;
+    frame.first_fragment = tree.fragments.size();
+    frame.first_image = tree.images.size();
+    frame.estimated_before = context.estimated_boxes;
+    frame.viewport_lengths_before = context.viewport_lengths;
+
+    float width = block_width(style, parent_width);
+    tree.boxes[frame.index].width = width;
+    tree.boxes[frame.index].is_positioned = style.position != POSITION_TYPE::Static;
+
+    // Initialize line state for block's children
+    line.current_x = style.padding_left;
+    line.current_y = style.padding_top;
+    line.line_height = 0;
+    line.max_width = width - style.padding_right - style.padding_left;
+    line.padding_left = style.padding_left;
+
+    frame.content_y = style.padding_top;
+    frame.child_parent_width = width - style.padding_left - style.padding_right;
+    frame.parent_width = frame.child_parent_width;
+    frame.viewport = context.viewport;
+    frame.origin_y = context.origin_y;
+
+    stack.push_back(frame);
+}
+
+/**
+ * \brief Replaces a block's child by an estimate if it lies outside the viewport.
+ *
+ * Consecutive estimated children share one placeholder box.
+ *
+ * \param frame The block's frame.
+ * \param child The child about to be laid out.
+ * \param line Current line state, moved below the placeholder.
+ * \param context The layout tree being built and the viewport.
+ * \return True if the child was estimated and must not be laid out.
+ */
+static bool estimate_child(LAYOUT_FRAME &frame, NODE *child, LINE_STATE &line, LAYOUT_CONTEXT &context)
+{
+    if (!frame.viewport || !is_virtualizable(child)) {
+        frame.placeholder = -1;
+        return false;
+    }
+
+    float top = frame.origin_y + frame.content_y;
+    float sibling_average = frame.sibling_count > 0 ? frame.sibling_height_total / frame.sibling_count : 0;
+    float estimate = estimate_block_height(child, sibling_average, context);
+
+    if (top <= frame.viewport->bottom && top + estimate >= frame.viewport->top) {
+        frame.placeholder = -1;
+        return false;
+    }
+
+    LAYOUT_TREE &tree = context.tree;
+    const COMPUTED_STYLE &style = frame.node->get_computed_style();
+
+    if (frame.placeholder < 0) {
+        frame.placeholder = tree.add_box(child);
+        LAYOUT_BOX &placeholder_box = tree.boxes[frame.placeholder];
+        placeholder_box.x = style.padding_left;
+        placeholder_box.y = frame.content_y;
+        placeholder_box.width = frame.child_parent_width;
+        tree.append_child(frame.index, frame.placeholder);
+        ++context.estimated_boxes;
+    }
+
+    LAYOUT_BOX &placeholder_box = tree.boxes[frame.placeholder];
+    placeholder_box.height += estimate;
+    ++placeholder_box.estimated_count;
+    finish_overflow(tree, frame.placeholder);
+
+    frame.content_y += estimate;
+    line.current_x = style.padding_left;
+    line.current_y = frame.content_y;
+    line.line_height = 0;
+    return true;
+}
+
+/**
+ * \brief Positions a finished child box inside its block and links it.
+ *
+ * \param frame The block's frame.
+ * \param child_index The index of the child's box.
+ * \param line Current line state.
+ * \param context The layout tree being built.
+ */
+static void place_block_child(LAYOUT_FRAME &frame, int child_index, LINE_STATE &line, LAYOUT_CONTEXT &context)
+{
+    LAYOUT_TREE &tree = context.tree;
+    const COMPUTED_STYLE &style = frame.node->get_computed_style();
+    LAYOUT_BOX &child_box = tree.boxes[child_index];
+    const COMPUTED_STYLE &child_style = *child_box.style;
+
+    // Handle positioned children
+    if (child_style.position == POSITION_TYPE::Absolute) {
+        if (child_style.width > 0) {
+            child_box.width = child_style.width;
+        } else {
+            child_box.width = frame.child_parent_width;
+        }
+        child_box.x = style.padding_left + child_style.left;
+        child_box.y = style.padding_top + child_style.top;
+        finish_overflow(tree, child_index);
+        tree.append_absolute_child(frame.index, child_index);
+        return;
+    }
+    else if (child_style.position == POSITION_TYPE::Fixed) {
+        if (child_style.width > 0) {
+            child_box.width = child_style.width;
+        } else {
+            child_box.width = frame.child_parent_width;
+        }
+        child_box.x = 0;
+        child_box.y = 0;
+        finish_overflow(tree, child_index);
+        tree.append_absolute_child(frame.index, child_index);
+        return;
+    }
+
+    // Position child in flow
+    if (child_style.display == DISPLAY_TYPE::BLOCK) {
+        child_box.x = child_style.margin_left + style.padding_left;
+        child_box.y = frame.content_y + child_style.margin_top;
+        float child_height = child_box.height + child_style.margin_top + child_style.margin_bottom;
+        frame.content_y += child_height;
+        frame.sibling_height_total += child_height;
+        ++frame.sibling_count;
+        if (context.block_heights) {
+            (*context.block_heights)[child_box.node] = child_height;
+        }
+        line.current_x = style.padding_left;
+        line.current_y = frame.content_y;
+        line.line_height = 0;
+    }
+    else {
+        float inline_bottom = line.current_y + line.line_height;
+        if (inline_bottom > frame.content_y) {
+            frame.content_y = inline_bottom;
+        }
+    }
+
+    tree.append_child(frame.index, child_index);
+}
+
+/**
+ * \brief Sizes a block once all its children are laid out, and records it in the layout cache.
+ *
+ * \param frame The block's frame.
+ * \param line The line state the block leaves for its parent.
+ * \param context The layout tree being built.
+ */
+static void finish_block(const LAYOUT_FRAME &frame, const LINE_STATE &line, LAYOUT_CONTEXT &context)
+{
+    LAYOUT_TREE &tree = context.tree;
+    const COMPUTED_STYLE &style = frame.node->get_computed_style();
+
+    // Calculate height
+    LAYOUT_BOX &box = tree.boxes[frame.index];
+    if (style.height > 0) {
+        box.height = style.height;
+    } else {
+        box.height = frame.content_y + style.padding_bottom;
+    }
+
+    finish_overflow(tree, frame.index);
+    context.origin_y = frame.origin_y;
+
+    if (context.cache) {
+        (*context.cache)[frame.node] = {box.width, frame.index, static_cast<int>(tree.boxes.size()),
+                                        frame.first_fragment, tree.fragments.size(),
+                                        frame.first_image, tree.images.size(), line,
+                                        context.estimated_boxes != frame.estimated_before,
+                                        context.viewport_lengths != frame.viewport_lengths_before,
+                                        context.viewport_width, context.viewport_height, context.root_font_size};
+    }
+}
+
+/**
+ * \brief Creates an inline box and pushes the frame that lays out its children.
+ *
+ * \param root The inline element node.
+ * \param parent_width Available width for layout.
+ * \param line Current line state, advanced by the left spacing.
+ * \param context The layout tree being built.
+ * \param stack The traversal stack receiving the inline box's frame.
+ */
+static void begin_inline(NODE *root, float parent_width, LINE_STATE &line, LAYOUT_CONTEXT &context,
+                         std::vector<LAYOUT_FRAME> &stack)
+{
+    const COMPUTED_STYLE &style = root->get_computed_style();
+
+    LAYOUT_FRAME frame;
+    frame.node = root;
+    frame.index = context.tree.add_box(root);
+    frame.parent_width = parent_width;
 
     // Apply left spacing (margin + padding)
-    float left_spacing = box.style.margin_left + box.style.padding_left;
+    float left_spacing = style.margin_left + style.padding_left;
     line.current_x += left_spacing;
 
-    float start_x = line.current_x;
-    float start_y = line.current_y;
-    float start_line_height = line.line_height;
+    frame.start_x = line.current_x;
+    frame.start_line_height = line.line_height;
 
-    // Process children
-    for (auto child : root->get_children()) {
-        LAYOUT_BOX child_box = create_layout_tree(child, parent_width, line, base_url, image_cache_manager);
-        box.children.push_back(child_box);
-    }
+    stack.push_back(frame);
+}
+
+/**
+ * \brief Sizes an inline box once all its children are laid out.
+ *
+ * \param frame The inline box's frame.
+ * \param line Current line state, advanced by the right spacing.
+ * \param context The layout tree being built.
+ */
+static void finish_inline(const LAYOUT_FRAME &frame, LINE_STATE &line, LAYOUT_CONTEXT &context)
+{
+    LAYOUT_TREE &tree = context.tree;
+    const COMPUTED_STYLE &style = frame.node->get_computed_style();
 
     float end_x = line.current_x;
 
     // Apply right spacing (padding + margin)
-    float right_spacing = box.style.padding_right + box.style.margin_right;
+    float right_spacing = style.padding_right + style.margin_right;
     line.current_x += right_spacing;
 
     // Calculate height with padding
-    float content_height = line.line_height - start_line_height;
-    float total_height = content_height + box.style.padding_top + box.style.padding_bottom;
+    float content_height = line.line_height - frame.start_line_height;
+    float total_height = content_height + style.padding_top + style.padding_bottom;
 
     // Update line height if this inline element is taller
     if (total_height > line.line_height) {
@@ -320,17 +927,213 @@ LAYOUT_BOX layout_inline_element(
     }
 
     // Set box dimensions
+    LAYOUT_BOX &box = tree.boxes[frame.index];
     box.y = 0;
     box.x = 0;
-    box.width = end_x - start_x;
+    box.width = end_x - frame.start_x;
     box.height = total_height;
 
-    return box;
+    finish_overflow(tree, frame.index);
+}
+
+/**
+ * \brief Starts the layout of one node.
+ *
+ * Leaves (text, images, reused blocks, boxes of other display types) are
+ * laid out completely. Blocks and inline elements get a frame on the stack
+ * and are finished by run_layout once their children are done.
+ *
+ * \param root The DOM node to layout.
+ * \param parent_width The available width for layout in pixels.
+ * \param line The current line state.
+ * \param context The layout tree being built.
+ * \param stack The traversal stack.
+ * \return The box index, -1 if the node generates no box, or LAYOUT_PENDING
+ *         if a frame was pushed.
+ */
+static int open_box(NODE *root, float parent_width, LINE_STATE &line, LAYOUT_CONTEXT &context,
+                    std::vector<LAYOUT_FRAME> &stack)
+{
+    bool layout_clean = !root->is_layout_dirty() && !root->has_layout_dirty_descendant();
+    root->clear_layout_dirty();
+    root->clear_paint_dirty();
+
+    // Skip display:none elements. Unresolved nodes sit inside a display:none
+    // subtree that the cascade never styled.
+    const COMPUTED_STYLE &style = root->get_computed_style();
+    if (style.display == DISPLAY_TYPE::NONE || !root->is_style_resolved()) {
+        return -1;
+    }
+    resolve_lengths(root, parent_width, context);
+
+    // Delegate to specialized handlers based on element type
+    if (root->get_tag_name() == "img" && context.image_cache_manager != nullptr) {
+        return layout_image_element(root, line, context);
+    }
+
+    if (root->get_type() == NODE_TYPE::TEXT) {
+        const QString &text = root->get_text_utf16();
+        bool has_content = std::any_of(text.begin(), text.end(), [](QChar c) { return !is_layout_space(c); });
+        if (has_content) {
+            return layout_text_element(root, line, context);
+        }
+        return -1;
+    }
+
+    if (style.display == DISPLAY_TYPE::BLOCK) {
+        if (layout_clean) {
+            int reused = reuse_cached_block(root, block_width(style, parent_width), line, context);
+            if (reused >= 0) {
+                return reused;
+            }
+        }
+        begin_block(root, parent_width, line, context, stack);
+        return LAYOUT_PENDING;
+    }
+
+    if (style.display == DISPLAY_TYPE::INLINE) {
+        begin_inline(root, parent_width, line, context, stack);
+        return LAYOUT_PENDING;
+    }
+
+    return context.tree.add_box(root);
+}
+
+/**
+ * \brief Lays out the children of the frames on the stack until it is empty.
+ *
+ * The DOM is walked with an explicit stack of frames instead of recursion,
+ * so the depth of a document is limited by memory rather than by the
+ * thread's stack. A frame takes its children one at a time: leaves are
+ * placed at once, and blocks and inline elements push a frame of their own,
+ * which is placed in its parent when popped.
+ *
+ * \param stack The traversal stack, holding at least one frame.
+ * \param line The current line state.
+ * \param context The layout tree being built.
+ * \return The index of the box of the bottom frame.
+ */
+static int run_layout(std::vector<LAYOUT_FRAME> &stack, LINE_STATE &line, LAYOUT_CONTEXT &context)
+{
+    auto attach = [&](LAYOUT_FRAME &parent, int child_index) {
+        if (parent.is_block) {
+            context.viewport = parent.viewport;
+            if (child_index >= 0) {
+                place_block_child(parent, child_index, line, context);
+            }
+        }
+        else if (child_index >= 0) {
+            context.tree.append_child(parent.index, child_index);
+        }
+    };
+
+    while (true) {
+        LAYOUT_FRAME &frame = stack.back();
+        const auto &children = frame.node->get_children();
+
+        if (frame.next_child < children.size()) {
+            NODE *child = children[frame.next_child++].get();
+
+            if (frame.is_block) {
+                if (child->is_style_resolved()) {
+                    resolve_lengths(child, frame.parent_width, context);
+                }
+                if (estimate_child(frame, child, line, context)) {
+                    continue;
+                }
+
+                // Children place themselves relative to their block, so only
+                // in-flow blocks learn where they are; elsewhere the viewport
+                // is not applied.
+                const COMPUTED_STYLE &next_style = child->get_computed_style();
+                bool in_flow_block = next_style.display == DISPLAY_TYPE::BLOCK && next_style.position == POSITION_TYPE::Static;
+                context.origin_y = frame.origin_y + frame.content_y + next_style.margin_top;
+                context.viewport = in_flow_block ? frame.viewport : nullptr;
+            }
+
+            // May push a frame, after which `frame` must not be used
+            int child_index = open_box(child, frame.parent_width, line, context, stack);
+            if (child_index != LAYOUT_PENDING) {
+                attach(stack.back(), child_index);
+            }
+            continue;
+        }
+
+        int index = frame.index;
+        if (frame.is_block) {
+            finish_block(frame, line, context);
+        }
+        else {
+            finish_inline(frame, line, context);
+        }
+
+        stack.pop_back();
+        if (stack.empty()) {
+            return index;
+        }
+        attach(stack.back(), index);
+    }
 }
 
 // ============================================================================
-// Main Layout Tree Creation
+// Block and Inline Layout
 // ============================================================================
+
+/**
+ * \brief Handles layout calculation for block-level elements.
+ * 
+ * Calculates width, positions children vertically, handles absolute/fixed
+ * positioned children separately, and calculates height based on content.
+ * The subtree is traversed without recursion (see run_layout).
+ *
+ * With a viewport in the context, in-flow block children entirely outside
+ * it are not laid out: consecutive ones are replaced by a single
+ * placeholder box with their estimated total height, so the boxes built
+ * depend on the size of the viewport rather than of the document.
+ * 
+ * \param root The block element node
+ * \param parent_width Available width for layout
+ * \param line Current line state
+ * \param context The layout tree being built, base URL and image cache manager
+ * \return Index of the block box in the layout tree
+ */
+int layout_block_element(
+    NODE *root,
+    float parent_width,
+    LINE_STATE &line,
+    LAYOUT_CONTEXT &context)
+{
+    std::vector<LAYOUT_FRAME> stack;
+    resolve_lengths(root, parent_width, context);
+    begin_block(root, parent_width, line, context, stack);
+    return run_layout(stack, line, context);
+}
+
+/**
+ * \brief Handles layout calculation for inline elements.
+ * 
+ * Processes children inline with proper spacing, wrapping across lines,
+ * and height calculation considering padding. The subtree is traversed
+ * without recursion (see run_layout).
+ * 
+ * \param root The inline element node
+ * \param parent_width Available width for layout
+ * \param line Current line state
+ * \param context The layout tree being built, base URL and image cache manager
+ * \return Index of the inline box in the layout tree
+ */
+int layout_inline_element(
+    NODE *root,
+    float parent_width,
+    LINE_STATE &line,
+    LAYOUT_CONTEXT &context)
+{
+    std::vector<LAYOUT_FRAME> stack;
+    resolve_lengths(root, parent_width, context);
+    begin_inline(root, parent_width, line, context, stack);
+    return run_layout(stack, line, context);
+}
+
 // ============================================================================
 // Main Layout Tree Creation
 // ============================================================================
@@ -338,53 +1141,118 @@ LAYOUT_BOX layout_inline_element(
 /**
  * \brief Converts a DOM tree into a layout tree with computed positions and dimensions.
  *
- * Recursively traverses the DOM tree and creates a parallel layout tree (LAYOUT_BOX structures)
- * with calculated positions, dimensions, and visual properties. Dispatches to specialized
- * layout helpers based on element type (image, text, block, inline).
+ * Traverses the DOM tree with an explicit stack and appends LAYOUT_BOX
+ * entries to the context's flat layout tree, with calculated positions,
+ * dimensions and a pointer to each node's computed style. Boxes refer to
+ * each other by index, so nothing is copied when a child is attached to its
+ * parent. Dispatches to specialized layout helpers based on element type
+ * (image, text, block, inline).
+ * When the context carries the previous pass's tree and cache, blocks whose
+ * subtree is layout-clean and whose width is unchanged are copied from the
+ * previous pass instead of being laid out again.
+ * Relative lengths (em, rem, %, vw, vh) are resolved to pixels as each node
+ * is reached, against the width it is laid out in and the viewport and root
+ * font size in the context, so a resize needs no new cascade.
  *
  * \param root The DOM node to layout.
  * \param parent_width The available width for layout in pixels.
  * \param line The current line state tracking horizontal and vertical positions.
- * \param base_url The base URL for resolving relative image and resource URLs.
- * \param image_cache_manager Pointer to the image cache manager for loading images.
- * \return A LAYOUT_BOX representing the complete layout of the subtree.
+ * \param context The layout tree being built, base URL and image cache manager.
+ * \return Index of the node's box, or -1 if the node generates no box
+ *         (display:none, unstyled, or whitespace-only text).
  */
-LAYOUT_BOX create_layout_tree(
-    std::shared_ptr<NODE> root,
+int create_layout_tree(
+    NODE *root,
     float parent_width,
-    LINE_STATE &line, const QString &base_url, IMAGE_CACHE_MANAGER *image_cache_manager)
+    LINE_STATE &line,
+    LAYOUT_CONTEXT &context)
+{
+    std::vector<LAYOUT_FRAME> stack;
+    int index = open_box(root, parent_width, line, context, stack);
+    if (index != LAYOUT_PENDING) {
+        return index;
+    }
+    return run_layout(stack, line, context);
+}
+
+// ============================================================================
+// Layout Tree Storage
+// ============================================================================
+
+/**
+ * \brief Empties the tree while keeping the capacity of its arrays.
+ *
+ * The next layout pass refills the same storage, so relayout of a page of
+ * similar size does not allocate boxes or fragments again.
+ */
+void LAYOUT_TREE::clear()
+{
+    boxes.clear();
+    fragments.clear();
+    images.clear();
+}
+
+/**
+ * \brief Reports whether the tree has no boxes.
+ */
+bool LAYOUT_TREE::empty() const
+{
+    return boxes.empty();
+}
+
+/**
+ * \brief Appends a box for a node, not yet linked to a parent.
+ *
+ * References to boxes are invalidated by this call; hold indices instead.
+ *
+ * \param node The node the box belongs to.
+ * \return The index of the new box.
+ */
+int LAYOUT_TREE::add_box(NODE *node)
 {
     LAYOUT_BOX box;
-    box.node = root;
-    box.style = root->get_all_styles();
+    box.node = node;
+    box.style = &node->get_computed_style();
+    boxes.push_back(box);
+    return static_cast<int>(boxes.size() - 1);
+}
 
-    // Skip display:none elements
-    if (box.style.display == DISPLAY_TYPE::NONE) {
-        return box;
-    }
+/**
+ * \brief Links a box as the last in-flow child of another.
+ *
+ * \param parent The index of the parent box.
+ * \param child The index of the child box.
+ */
+void LAYOUT_TREE::append_child(int parent, int child)
+{
+    LAYOUT_BOX &parent_box = boxes[parent];
+    boxes[child].parent = parent;
 
-    // Delegate to specialized handlers based on element type
-    if (root->get_tag_name() == "img" && image_cache_manager != nullptr) {
-        return layout_image_element(root, base_url, image_cache_manager, line);
+    if (parent_box.last_child < 0) {
+        parent_box.first_child = child;
     }
-
-    if (root->get_type() == NODE_TYPE::TEXT) {
-        std::string text = root->get_text_content();
-        text.erase(0, text.find_first_not_of(" \t\n\r"));
-        text.erase(text.find_last_not_of(" \t\n\r") + 1);
-        if (!text.empty()) {
-            return layout_text_element(root, box.style, line);
-        }
-        return box;
+    else {
+        boxes[parent_box.last_child].next_sibling = child;
     }
+    parent_box.last_child = child;
+}
 
-    if (box.style.display == DISPLAY_TYPE::BLOCK) {
-        return layout_block_element(root, parent_width, line, base_url, image_cache_manager);
-    }
+/**
+ * \brief Links a box as the last absolutely or fixed positioned child of another.
+ *
+ * \param parent The index of the containing box.
+ * \param child The index of the positioned box.
+ */
+void LAYOUT_TREE::append_absolute_child(int parent, int child)
+{
+    LAYOUT_BOX &parent_box = boxes[parent];
+    boxes[child].parent = parent;
 
-    if (box.style.display == DISPLAY_TYPE::INLINE) {
-        return layout_inline_element(root, parent_width, line, base_url, image_cache_manager);
+    if (parent_box.last_absolute_child < 0) {
+        parent_box.first_absolute_child = child;
     }
-
-    return box;
-}
\ No newline at end of file
+    else {
+        boxes[parent_box.last_absolute_child].next_sibling = child;
+    }
+    parent_box.last_absolute_child = child;
+}
@@ -0,0 +1,198 @@
+#include "css/media_query.h"
+#include "util_functions.h"
+#include <cctype>
+
+namespace
+{
+    float parse_media_length(const std::string &value)
+    {
+        size_t unit_start = 0;
+        float number = 0;
+        try
+        {
+            number = std::stof(value, &unit_start);
+        }
+        catch (...)
+        {
+            return 0;
+        }
+
+        std::string unit = value.substr(unit_start);
+        trim(unit);
+        if (unit == "em" || unit == "rem")
+        {
+            // Relative to the initial font size, as media queries are
+            return number * 16;
+        }
+        return number;
+    }
+
+    bool parse_media_feature(const std::string &text, MEDIA_FEATURE &feature)
+    {
+        size_t colon = text.find(':');
+        if (colon == std::string::npos)
+        {
+            return false;
+        }
+
+        std::string name = text.substr(0, colon);
+        std::string value = text.substr(colon + 1);
+        trim(name);
+        trim(value);
+
+        if (name == "orientation")
+        {
+            if (value != "landscape" && value != "portrait")
+            {
+                return false;
+            }
+            feature.type = MEDIA_FEATURE_TYPE::Orientation;
+            feature.landscape = value == "landscape";
+            return true;
+        }
+
+        if (name == "min-width")
+            feature.type = MEDIA_FEATURE_TYPE::MinWidth;
+        else if (name == "max-width")
+            feature.type = MEDIA_FEATURE_TYPE::MaxWidth;
+        else if (name == "min-height")
+            feature.type = MEDIA_FEATURE_TYPE::MinHeight;
+        else if (name == "max-height")
+            feature.type = MEDIA_FEATURE_TYPE::MaxHeight;
+        else
+            return false;
+
+        feature.value = parse_media_length(value);
+        return true;
+    }
+
+    MEDIA_QUERY parse_media_query(const std::string &text)
+    {
+        MEDIA_QUERY query;
+        size_t pos = 0;
+
+        while (pos < text.size())
+        {
+            skip_space(pos, text);
+            if (pos >= text.size())
+            {
+                break;
+            }
+
+            if (text[pos] == '(')
+            {
+                size_t close = text.find(')', pos);
+                if (close == std::string::npos)
+                {
+                    close = text.size();
+                }
+
+                MEDIA_FEATURE feature;
+                if (parse_media_feature(text.substr(pos + 1, close - pos - 1), feature))
+                {
+                    query.features.push_back(feature);
+                }
+                else
+                {
+                    // Unknown features make the whole query false
+                    query.matches_type = false;
+                }
+                pos = close + 1;
+                continue;
+            }
+
+            size_t start = pos;
+            while (pos < text.size() && !std::isspace(static_cast<unsigned char>(text[pos])) && text[pos] != '(')
+            {
+                ++pos;
+            }
+            std::string word = text.substr(start, pos - start);
+
+            if (word == "not")
+            {
+                query.negated = true;
+            }
+            else if (word != "only" && word != "and" && word != "screen" && word != "all")
+            {
+                query.matches_type = false;
+            }
+        }
+
+        return query;
+    }
+
+    bool feature_matches(const MEDIA_FEATURE &feature, float viewport_width, float viewport_height)
+    {
+        switch (feature.type)
+        {
+        case MEDIA_FEATURE_TYPE::MinWidth:
+            return viewport_width >= feature.value;
+        case MEDIA_FEATURE_TYPE::MaxWidth:
+            return viewport_width <= feature.value;
+        case MEDIA_FEATURE_TYPE::MinHeight:
+            return viewport_height >= feature.value;
+        case MEDIA_FEATURE_TYPE::MaxHeight:
+            return viewport_height <= feature.value;
+        default:
+            return feature.landscape == (viewport_width > viewport_height);
+        }
+    }
+}
+
+/**
+ * \brief Compiles the prelude of an @media rule.
+ *
+ * Supports media types (screen and all match, anything else does not),
+ * "not" and "only", and the min/max-width, min/max-height and orientation
+ * features joined by "and". Queries separated by commas are alternatives.
+ * A query using an unknown feature never matches.
+ *
+ * \param prelude The text between "@media" and the opening brace.
+ * \return The compiled condition; an empty prelude always matches.
+ */
+MEDIA_CONDITION parse_media_condition(const std::string &prelude)
+{
+    MEDIA_CONDITION condition;
+    condition.text = prelude;
+    trim(condition.text);
+    std::transform(condition.text.begin(), condition.text.end(), condition.text.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    std::string text = condition.text;
+    for (const auto &query_text : split(text, ','))
+    {
+        condition.queries.push_back(parse_media_query(query_text));
+    }
+
+    if (condition.queries.empty())
+    {
+        condition.queries.push_back(MEDIA_QUERY{});
+    }
+    return condition;
+}
+
+/**
+ * \brief Evaluates a compiled media condition for a viewport size.
+ *
+ * \param condition The compiled condition.
+ * \param viewport_width The viewport width in pixels.
+ * \param viewport_height The viewport height in pixels.
+ * \return True if any of the condition's queries holds.
+ */
+bool media_condition_matches(const MEDIA_CONDITION &condition, float viewport_width, float viewport_height)
+{
+    for (const auto &query : condition.queries)
+    {
+        bool matches = query.matches_type;
+        for (size_t i = 0; matches && i < query.features.size(); ++i)
+        {
+            matches = feature_matches(query.features[i], viewport_width, viewport_height);
+        }
+
+        if (matches != query.negated)
+        {
+            return true;
+        }
+    }
+    return false;
+}
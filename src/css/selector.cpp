@@ -0,0 +1,310 @@
+#include "css/selector.h"
+#include "util_functions.h"
+#include <cctype>
+
+namespace
+{
+    bool is_identifier_char(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' ||
+               static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    std::string read_identifier(const std::string &text, size_t &pos)
+    {
+        size_t start = pos;
+        while (pos < text.size() && is_identifier_char(text[pos]))
+        {
+            ++pos;
+        }
+        return text.substr(start, pos - start);
+    }
+
+    bool compound_matches(const COMPOUND_SELECTOR &compound, const NODE &node)
+    {
+        if (node.get_type() != NODE_TYPE::ELEMENT)
+        {
+            return false;
+        }
+
+        if (!compound.tag.empty() && node.get_tag_name() != compound.tag)
+        {
+            return false;
+        }
+
+        if (!compound.id.empty() && node.get_attribute("id") != compound.id)
+        {
+            return false;
+        }
+
+        if (!compound.classes.empty())
+        {
+            std::string class_value = node.get_attribute("class");
+            std::vector<std::string> classes = split(class_value, ' ');
+            for (const auto &required : compound.classes)
+            {
+                if (std::find(classes.begin(), classes.end(), required) == classes.end())
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (const auto &attribute : compound.attributes)
+        {
+            if (!node.has_attribute(attribute.name))
+            {
+                return false;
+            }
+            if (attribute.has_value && node.get_attribute(attribute.name) != attribute.value)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    const NODE *previous_sibling(const NODE &node)
+    {
+        auto parent = node.get_parent();
+        if (!parent)
+        {
+            return nullptr;
+        }
+
+        const NODE *previous = nullptr;
+        for (const auto &sibling : parent->get_children())
+        {
+            if (sibling.get() == &node)
+            {
+                return previous;
+            }
+            if (sibling->get_type() == NODE_TYPE::ELEMENT)
+            {
+                previous = sibling.get();
+            }
+        }
+        return nullptr;
+    }
+
+    bool matches_from(const COMPLEX_SELECTOR &selector, size_t index, const NODE &node)
+    {
+        if (!compound_matches(selector.compounds[index], node))
+        {
+            return false;
+        }
+
+        if (index == 0)
+        {
+            return true;
+        }
+
+        switch (selector.combinators[index - 1])
+        {
+        case COMBINATOR::Child:
+        {
+            auto parent = node.get_parent();
+            return parent && matches_from(selector, index - 1, *parent);
+        }
+        case COMBINATOR::Descendant:
+        {
+            for (auto ancestor = node.get_parent(); ancestor; ancestor = ancestor->get_parent())
+            {
+                if (matches_from(selector, index - 1, *ancestor))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        case COMBINATOR::Adjacent:
+        {
+            const NODE *previous = previous_sibling(node);
+            return previous && matches_from(selector, index - 1, *previous);
+        }
+        case COMBINATOR::Sibling:
+        {
+            for (const NODE *previous = previous_sibling(node); previous; previous = previous_sibling(*previous))
+            {
+                if (matches_from(selector, index - 1, *previous))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        }
+        return false;
+    }
+}
+
+/**
+ * \brief Compiles a single selector into compound selectors and combinators.
+ *
+ * Supports type, universal, class, ID and attribute ([name], [name=value])
+ * selectors, combined with descendant (whitespace), child (>), adjacent
+ * sibling (+) and general sibling (~) combinators. Selectors using anything
+ * else (pseudo-classes, pseudo-elements, ...) are marked invalid and never match.
+ *
+ * \param selector The selector text (e.g., "ul > li.active a[href]").
+ * \return The compiled selector.
+ */
+COMPLEX_SELECTOR parse_selector(const std::string &selector)
+{
+    COMPLEX_SELECTOR result;
+    COMPOUND_SELECTOR compound;
+    bool compound_started = false;
+    bool pending_descendant = false;
+    size_t pos = 0;
+
+    auto finish_compound = [&](COMBINATOR combinator)
+    {
+        if (!compound_started)
+        {
+            result.is_valid = false;
+            return;
+        }
+        result.compounds.push_back(compound);
+        result.combinators.push_back(combinator);
+        compound = COMPOUND_SELECTOR();
+        compound_started = false;
+    };
+
+    while (pos < selector.size() && result.is_valid)
+    {
+        char c = selector[pos];
+
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            skip_space(pos, selector);
+            pending_descendant = compound_started;
+            continue;
+        }
+
+        if (c == '>' || c == '+' || c == '~')
+        {
+            finish_compound(c == '>' ? COMBINATOR::Child : c == '+' ? COMBINATOR::Adjacent : COMBINATOR::Sibling);
+            pending_descendant = false;
+            ++pos;
+            continue;
+        }
+
+        if (pending_descendant)
+        {
+            finish_compound(COMBINATOR::Descendant);
+            pending_descendant = false;
+        }
+
+        if (c == '.')
+        {
+            ++pos;
+            std::string name = read_identifier(selector, pos);
+            result.is_valid = !name.empty();
+            compound.classes.push_back(name);
+        }
+        else if (c == '#')
+        {
+            ++pos;
+            compound.id = read_identifier(selector, pos);
+            result.is_valid = !compound.id.empty();
+        }
+        else if (c == '[')
+        {
+            size_t end = selector.find(']', pos);
+            if (end == std::string::npos)
+            {
+                result.is_valid = false;
+                break;
+            }
+
+            std::string body = selector.substr(pos + 1, end - pos - 1);
+            ATTRIBUTE_SELECTOR attribute;
+            size_t equal_pos = body.find('=');
+            attribute.name = body.substr(0, equal_pos);
+            trim(attribute.name);
+            if (equal_pos != std::string::npos)
+            {
+                attribute.value = body.substr(equal_pos + 1);
+                trim(attribute.value);
+                if (attribute.value.size() >= 2 && (attribute.value[0] == '"' || attribute.value[0] == '\''))
+                {
+                    attribute.value = attribute.value.substr(1, attribute.value.size() - 2);
+                }
+                attribute.has_value = true;
+            }
+            result.is_valid = !attribute.name.empty();
+            compound.attributes.push_back(attribute);
+            pos = end + 1;
+        }
+        else if (c == '*')
+        {
+            ++pos;
+        }
+        else if (is_identifier_char(c))
+        {
+            compound.tag = read_identifier(selector, pos);
+        }
+        else
+        {
+            result.is_valid = false;
+            break;
+        }
+
+        compound_started = true;
+    }
+
+    if (!compound_started)
+    {
+        result.is_valid = false;
+    }
+    else
+    {
+        result.compounds.push_back(compound);
+    }
+
+    return result;
+}
+
+/**
+ * \brief Compiles a comma-separated selector list, dropping invalid entries.
+ *
+ * \param selector_list The selector list text (e.g., "h1, h2, .title").
+ * \return The valid compiled selectors in source order.
+ */
+std::vector<COMPLEX_SELECTOR> parse_selector_list(const std::string &selector_list)
+{
+    std::vector<COMPLEX_SELECTOR> result;
+    std::string list = selector_list;
+
+    for (auto &selector : split(list, ','))
+    {
+        COMPLEX_SELECTOR compiled = parse_selector(selector);
+        if (compiled.is_valid)
+        {
+            result.push_back(compiled);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * \brief Tests if a compiled selector matches a DOM node.
+ *
+ * Matches right to left: the subject compound is tested against the node,
+ * then each combinator walks to the parent, an ancestor or a previous sibling.
+ *
+ * \param selector The compiled selector.
+ * \param node The DOM node to test against.
+ * \return True if the selector matches the node.
+ */
+bool selector_matches(const COMPLEX_SELECTOR &selector, const NODE &node)
+{
+    if (!selector.is_valid || selector.compounds.empty())
+    {
+        return false;
+    }
+
+    return matches_from(selector, selector.compounds.size() - 1, node);
+}
@@ -0,0 +1,194 @@
+#include "css/tile_cache.h"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * \brief Creates an empty cache.
+ *
+ * \param budget The most bytes of tile images kept; tiles being rendered
+ *               are never evicted, so the budget can be exceeded briefly.
+ */
+TILE_CACHE::TILE_CACHE(size_t budget) : m_budget(budget)
+{
+}
+
+uint64_t TILE_CACHE::key(int column, int row)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(row)) << 32) | static_cast<uint32_t>(column);
+}
+
+void TILE_CACHE::touch(TILE &tile)
+{
+    m_lru.splice(m_lru.begin(), m_lru, tile.lru);
+}
+
+/**
+ * \brief Drops the least recently used tiles until the cache fits its budget.
+ */
+void TILE_CACHE::evict()
+{
+    auto it = m_lru.end();
+    while (m_bytes > m_budget && it != m_lru.begin()) {
+        --it;
+        auto tile_it = m_tiles.find(*it);
+        if (tile_it->second.pending) {
+            continue;
+        }
+
+        m_bytes -= static_cast<size_t>(tile_it->second.image.sizeInBytes());
+        m_tiles.erase(tile_it);
+        it = m_lru.erase(it);
+    }
+}
+
+/**
+ * \brief Looks up a tile and marks it as recently used.
+ *
+ * \param column The tile's column, counted from the left of the document.
+ * \param row The tile's row, counted from the top of the document.
+ * \return The tile, or nullptr if it was never rendered or was evicted.
+ */
+TILE *TILE_CACHE::find(int column, int row)
+{
+    auto it = m_tiles.find(key(column, row));
+    if (it == m_tiles.end()) {
+        return nullptr;
+    }
+
+    touch(it->second);
+    return &it->second;
+}
+
+/**
+ * \brief Marks a tile as being rendered, creating it if needed.
+ *
+ * \param column The tile's column.
+ * \param row The tile's row.
+ * \return The version the rendered image has to be stored with.
+ */
+uint64_t TILE_CACHE::schedule(int column, int row)
+{
+    uint64_t tile_key = key(column, row);
+    auto [it, inserted] = m_tiles.try_emplace(tile_key);
+    TILE &tile = it->second;
+
+    if (inserted) {
+        m_lru.push_front(tile_key);
+        tile.lru = m_lru.begin();
+        tile.version = m_next_version++;
+    }
+    else {
+        touch(tile);
+    }
+
+    tile.pending = true;
+    return tile.version;
+}
+
+/**
+ * \brief Stores the image a worker rendered for a tile.
+ *
+ * An image rendered before the tile was last damaged is dropped, and the
+ * tile keeps showing its previous image until it is rendered again.
+ *
+ * \param column The tile's column.
+ * \param row The tile's row.
+ * \param version The version returned by schedule().
+ * \param image The rendered image.
+ * \return True if the image was stored, false if it was out of date.
+ */
+bool TILE_CACHE::store(int column, int row, uint64_t version, const QImage &image)
+{
+    auto it = m_tiles.find(key(column, row));
+    if (it == m_tiles.end()) {
+        return false;
+    }
+
+    TILE &tile = it->second;
+    tile.pending = false;
+    if (tile.version != version) {
+        return false;
+    }
+
+    m_bytes -= static_cast<size_t>(tile.image.sizeInBytes());
+    m_bytes += static_cast<size_t>(image.sizeInBytes());
+    tile.image = image;
+    tile.rendered_version = version;
+    touch(tile);
+    evict();
+    return true;
+}
+
+/**
+ * \brief Marks the tiles covering a damaged area as out of date.
+ *
+ * Their images are kept so they can be shown until the new ones arrive.
+ *
+ * \param rect The damaged area, in document coordinates.
+ */
+void TILE_CACHE::invalidate(const QRectF &rect)
+{
+    if (rect.isEmpty() || m_tiles.empty()) {
+        return;
+    }
+
+    int first_column = std::max(0, static_cast<int>(std::floor(rect.left() / TILE_SIZE)));
+    int last_column = std::max(0, static_cast<int>(std::floor(rect.right() / TILE_SIZE)));
+    int first_row = std::max(0, static_cast<int>(std::floor(rect.top() / TILE_SIZE)));
+    int last_row = std::max(0, static_cast<int>(std::floor(rect.bottom() / TILE_SIZE)));
+
+    // Large areas are cheaper to check tile by tile than position by position
+    size_t area = static_cast<size_t>(last_column - first_column + 1) * static_cast<size_t>(last_row - first_row + 1);
+    if (area > m_tiles.size()) {
+        for (auto &[tile_key, tile] : m_tiles) {
+            int column = static_cast<int>(static_cast<uint32_t>(tile_key));
+            int row = static_cast<int>(tile_key >> 32);
+            if (column >= first_column && column <= last_column && row >= first_row && row <= last_row) {
+                tile.version = m_next_version++;
+            }
+        }
+        return;
+    }
+
+    for (int row = first_row; row <= last_row; ++row) {
+        for (int column = first_column; column <= last_column; ++column) {
+            auto it = m_tiles.find(key(column, row));
+            if (it != m_tiles.end()) {
+                it->second.version = m_next_version++;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Marks every tile as out of date, as after a relayout.
+ */
+void TILE_CACHE::invalidate_all()
+{
+    for (auto &[tile_key, tile] : m_tiles) {
+        tile.version = m_next_version++;
+    }
+}
+
+/**
+ * \brief Drops all tiles, including those being rendered.
+ *
+ * Images that arrive for them afterwards are ignored by store().
+ */
+void TILE_CACHE::clear()
+{
+    m_tiles.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
+
+/**
+ * \brief Returns the area of the document a tile covers.
+ *
+ * \param column The tile's column.
+ * \param row The tile's row.
+ */
+QRect TILE_CACHE::tile_rect(int column, int row)
+{
+    return QRect(column * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+}
@@ -0,0 +1,183 @@
+#include "gui/image_cache_manager.h"
+#include <QNetworkRequest>
+#include <QUrl>
+
+/**
+ * \brief Creates an empty cache.
+ *
+ * \param budget The most bytes of decoded images kept. Images still shown
+ *               keep their pixels alive through QImage's sharing, so the
+ *               budget bounds what the cache holds on to, not what is shown.
+ */
+IMAGE_CACHE_MANAGER::IMAGE_CACHE_MANAGER(size_t budget) : m_budget(budget)
+{
+}
+
+/**
+ * \brief Sets the network manager images are downloaded with.
+ *
+ * Its finished signal should be connected to a slot that hands each reply
+ * to take_reply() and the decoded image to store().
+ */
+void IMAGE_CACHE_MANAGER::set_network_manager(QNetworkAccessManager *network_manager)
+{
+    m_network_manager = network_manager;
+}
+
+/**
+ * \brief Drops the least recently used images until the cache fits its budget.
+ *
+ * An evicted URL is downloaded again the next time layout asks for it. The
+ * most recent image is kept even if it alone exceeds the budget, so it is
+ * not downloaded over and over. Images a layout tree still holds a copy of
+ * are kept too: they are on screen, and evicting them would only download
+ * them again on the next layout.
+ */
+void IMAGE_CACHE_MANAGER::evict()
+{
+    auto it = m_lru.end();
+    while (m_bytes > m_budget && it != m_lru.begin() && std::prev(it) != m_lru.begin())
+    {
+        --it;
+        auto entry = m_entries.find(*it);
+        if (!entry->second.image.isDetached())
+        {
+            continue;
+        }
+
+        m_bytes -= static_cast<size_t>(entry->second.image.sizeInBytes());
+        m_entries.erase(entry);
+        it = m_lru.erase(it);
+    }
+}
+
+/**
+ * \brief Looks up a loaded image and marks it as recently used.
+ *
+ * \param url The image's absolute URL.
+ * \return The image, or nullptr if it is not loaded (yet).
+ */
+const QImage *IMAGE_CACHE_MANAGER::find(const QString &url)
+{
+    auto it = m_entries.find(url);
+    if (it == m_entries.end() || it->second.image.isNull())
+    {
+        return nullptr;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    return &it->second.image;
+}
+
+/**
+ * \brief Starts downloading an image unless it is loaded, in flight or failed.
+ *
+ * Layout calls this for every image it does not find, on every pass; later
+ * calls for the same URL join the request already made. A failed URL is
+ * not requested again until forget_failed() is called for the next document.
+ *
+ * \param url The image's absolute URL.
+ * \return True if a new request was sent.
+ */
+bool IMAGE_CACHE_MANAGER::request(const QString &url)
+{
+    if (!m_network_manager || m_entries.count(url) > 0)
+    {
+        return false;
+    }
+
+    m_entries[url].pending = true;
+    QNetworkReply *reply = m_network_manager->get(QNetworkRequest(QUrl(url)));
+    if (reply)
+    {
+        m_replies[reply] = url;
+    }
+    return true;
+}
+
+/**
+ * \brief Returns the URL a finished reply was requested for, and forgets the reply.
+ *
+ * Replies may finish in any order; each is matched to its own request
+ * rather than to the one made last.
+ *
+ * \param reply A reply of the cache's network manager.
+ * \return The URL, or an empty string if the reply was not requested by the cache.
+ */
+QString IMAGE_CACHE_MANAGER::take_reply(QNetworkReply *reply)
+{
+    auto it = m_replies.find(reply);
+    if (it == m_replies.end())
+    {
+        return QString();
+    }
+
+    QString url = it->second;
+    m_replies.erase(it);
+    return url;
+}
+
+/**
+ * \brief Stores a downloaded image and ends its request.
+ *
+ * \param url The URL the image was requested for.
+ * \param image The decoded image, or a null image if the download or
+ *              decoding failed.
+ * \return True if the image was stored and can be shown.
+ */
+bool IMAGE_CACHE_MANAGER::store(const QString &url, const QImage &image)
+{
+    ENTRY &entry = m_entries[url];
+    entry.pending = false;
+    if (image.isNull())
+    {
+        return false;
+    }
+
+    if (!entry.image.isNull())
+    {
+        m_bytes -= static_cast<size_t>(entry.image.sizeInBytes());
+        m_lru.erase(entry.lru);
+    }
+
+    entry.image = image;
+    m_bytes += static_cast<size_t>(image.sizeInBytes());
+    m_lru.push_front(url);
+    entry.lru = m_lru.begin();
+
+    evict();
+    return true;
+}
+
+/**
+ * \brief Forgets the downloads that failed, so they are requested again.
+ *
+ * Called when a document is rendered, so a transient network error blanks
+ * an image for that page only, not for the rest of the session.
+ */
+void IMAGE_CACHE_MANAGER::forget_failed()
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        bool failed = !it->second.pending && it->second.image.isNull();
+        it = failed ? m_entries.erase(it) : std::next(it);
+    }
+}
+
+/**
+ * \brief Changes the budget, evicting images if the cache no longer fits it.
+ */
+void IMAGE_CACHE_MANAGER::set_budget(size_t budget)
+{
+    m_budget = budget;
+    evict();
+}
+
+/**
+ * \brief Tells whether a request for an image is in flight.
+ */
+bool IMAGE_CACHE_MANAGER::is_pending(const QString &url) const
+{
+    auto it = m_entries.find(url);
+    return it != m_entries.end() && it->second.pending;
+}
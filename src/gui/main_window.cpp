@@ -18,7 +18,7 @@
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), m_header(nullptr), m_renderer(nullptr)
 {
     m_network_manager = new QNetworkAccessManager(this);
-    m_image_cache_manager.image_network_manager = new QNetworkAccessManager(this);
+    m_image_cache_manager.set_network_manager(new QNetworkAccessManager(this));
     m_reflow_timer = new QTimer(this);
     m_reflow_timer->setSingleShot(true);
     setup_ui();
@@ -90,7 +90,7 @@ void MainWindow::set_connections()
     connect(m_header, &Header::url_selected, this, &MainWindow::fetch_url);
     connect(m_header, &Header::back_clicked, m_renderer, &Renderer::go_back);
     connect(m_header, &Header::forward_clicked, m_renderer, &Renderer::go_forward);
-    connect(m_image_cache_manager.image_network_manager, &QNetworkAccessManager::finished, this, &MainWindow::download_image);
+    connect(m_image_cache_manager.network_manager(), &QNetworkAccessManager::finished, this, &MainWindow::download_image);
     connect(m_reflow_timer, &QTimer::timeout, this, &MainWindow::reflow);
 
     connect(m_renderer, &Renderer::link_clicked, this, &MainWindow::navigate);
@@ -122,14 +122,14 @@ void MainWindow::render_file(const QString &file_path)
     }
 
     QByteArray data = file.readAll();
-    QString html_content = QString::fromUtf8(data);
 
     QFileInfo file_info(local_path);
     m_cached_base_url = QUrl::fromLocalFile(
                             file_info.absolutePath() + "/")
                             .toString();
 
-    m_cached_tree = create_tree(html_content.toStdString());
+    // The bytes are already UTF-8; text nodes decode their own text once.
+    m_cached_tree = create_tree(data.toStdString());
     m_renderer->set_document(m_cached_tree, m_image_cache_manager, m_cached_base_url);
     file.close();
 }
@@ -153,9 +153,8 @@ void MainWindow::fetch_url(const QString &url)
             {
         if (reply->error() == QNetworkReply::NoError) {
             QByteArray data = reply->readAll();
-            QString html_content = QString::fromUtf8(data);
 
-            m_cached_tree = create_tree(html_content.toStdString());
+            m_cached_tree = create_tree(data.toStdString());
 
             QUrl paresed_url(url);
             m_cached_base_url = paresed_url.scheme() + "://" + paresed_url.host() + paresed_url.path();
@@ -175,20 +174,29 @@ void MainWindow::fetch_url(const QString &url)
 /**
  * \brief Handles completion of image download from the network.
  *
- * Caches downloaded images in the image cache manager and triggers a reflow
- * to update the rendered page with the newly available image.
+ * Caches the downloaded image under the URL its own request was made for,
+ * whatever order downloads finish in, and triggers a reflow to show the
+ * newly available image in the rendered page. A failed download is recorded
+ * too, so layout does not request it again.
  *
  * \param reply The QNetworkReply containing the downloaded image data.
  */
 void MainWindow::download_image(QNetworkReply *reply)
 {
-    if (reply->error() == QNetworkReply::NoError)
+    QString url = m_image_cache_manager.take_reply(reply);
+    if (!url.isEmpty())
     {
-        QPixmap image;
-        image.loadFromData(reply->readAll());
+        QImage image;
+        if (reply->error() == QNetworkReply::NoError)
+        {
+            image.loadFromData(reply->readAll());
+        }
 
-        m_image_cache_manager.image_cacher[m_image_cache_manager.src] = image;
-        request_reflow();
+        if (m_image_cache_manager.store(url, image))
+        {
+            m_loaded_images.insert(url);
+            request_reflow();
+        }
     }
     reply->deleteLater();
 }
@@ -205,14 +213,16 @@ void MainWindow::request_reflow()
 }
 
 /**
- * \brief Recalculates the layout and re-renders the current document.
+ * \brief Shows the images downloaded since the last reflow.
  *
- * Triggered by the reflow timer, updates the layout tree to account for
- * newly loaded images or other changes to the document.
+ * Triggered by the reflow timer, so a burst of downloads is handled in one
+ * pass. Only the image boxes, and the blocks whose layout they change, are
+ * updated; the document is not rendered again and history is untouched.
  */
 void MainWindow::reflow()
 {
-    m_renderer->set_document(m_cached_tree, m_image_cache_manager, m_cached_base_url);
+    m_renderer->resources_loaded(m_loaded_images);
+    m_loaded_images.clear();
 }
 
 /**
@@ -4,7 +4,7 @@
 #include <QScrollArea>
 #include <QScrollBar>
 #include <QResizeEvent>
-#include <queue>
+#include <algorithm>
 #include "util_functions.h"
 
 /**
@@ -17,9 +17,20 @@
  */
 Renderer::Renderer(QWidget *parent) : QWidget(parent), m_root(nullptr), m_viewport_height(0), m_viewport_width(0), m_image_cache_manager(nullptr), m_current_history_it(m_history_list.begin())
 {
+    // Drives transitions and animations while any are running
+    m_frame_timer = new QTimer(this);
+    m_frame_timer->setInterval(16);
+    connect(m_frame_timer, &QTimer::timeout, this, &Renderer::animation_frame);
+    m_clock.start();
 }
 
-float calculate_content_width(const LAYOUT_BOX &box);
+/**
+ * \brief Waits for the tiles still being rendered, which read the renderer's layout.
+ */
+Renderer::~Renderer()
+{
+    wait_for_tiles();
+}
 
 /**
  * \brief Sets a new HTML document for rendering and updates history.
@@ -106,25 +117,158 @@ void Renderer::render(std::shared_ptr<NODE> root, const QString &base_url)
 
         std::string combined_css = user_agent_css + "\n" + author_css;
         m_cssom = create_cssom(combined_css);
+        update_viewport_size();
+        m_cssom.update_media(m_viewport_width, m_viewport_height);
 
         apply_style(m_root, m_cssom);
 
+        // Nothing laid out for the previous document or stylesheet can be reused
+        wait_for_tiles();
+        m_layout_cache.clear();
+        m_block_heights.clear();
+        m_tile_cache.clear();
+        m_timeline.clear();
+        m_animated_nodes.clear();
+        if (m_image_cache_manager)
+        {
+            m_image_cache_manager->forget_failed();
+        }
+        m_layout_has_estimates = false;
         recalculate_layout();
     }
     update();
 }
 
+/**
+ * \brief Brings the rendering up to date after DOM mutations.
+ *
+ * Unlike set_document, this neither touches history nor reparses CSS.
+ * Only style-dirty subtrees are restyled. If some node is layout-dirty the
+ * layout is recalculated and the whole widget repainted; if the style
+ * changes were paint-only, the existing layout boxes (which point at the
+ * nodes' styles) are kept and only the area they cover is repainted. Call it after using the NODE
+ * mutation API (set_attribute, insert_child, set_text_content, ...), before
+ * returning to the event loop: layout boxes hold raw NODE pointers, which
+ * dangle after remove_child until the layout is recalculated. Event
+ * handlers that read nodes through the boxes call it first as a safeguard.
+ */
+void Renderer::update_document()
+{
+    if (!m_root)
+    {
+        return;
+    }
+
+    if (m_root->needs_style_update())
+    {
+        update_style(m_root, m_cssom);
+    }
+
+    if (!m_has_layout || m_root->is_layout_dirty() || m_root->has_layout_dirty_descendant())
+    {
+        recalculate_layout();
+        update();
+        return;
+    }
+
+    if (m_root->is_paint_dirty() || m_root->has_paint_dirty_descendant())
+    {
+        QRectF dirty_rect;
+        bool fixed_dirty = false;
+        if (!m_layout_tree.empty())
+        {
+            refresh_paint_styles(dirty_rect, fixed_dirty);
+            wait_for_tiles();
+            build_display_list(m_layout_tree, m_display_list, &m_animated_nodes);
+            m_layer_images.clear();
+            update_animations();
+        }
+
+        if (!dirty_rect.isEmpty())
+        {
+            m_tile_cache.invalidate(dirty_rect);
+            update(dirty_rect.toAlignedRect());
+        }
+
+        // Fixed layers are redrawn on top of the tiles wherever they are now
+        if (fixed_dirty)
+        {
+            QRect visible = visible_rect();
+            update(visible.isEmpty() ? rect() : visible);
+        }
+    }
+}
+
+/**
+ * \brief Shows images that finished downloading without rendering the document again.
+ *
+ * Unlike set_document, this neither touches history nor reparses CSS or
+ * restyles. An image whose box reserved its size (width and height both
+ * set) is put into the empty slot layout left for it, and only the area it
+ * covers is repainted. Any other image changes the size of its box, so the
+ * element is marked layout-dirty and only the blocks containing it are laid
+ * out again. Images outside the laid-out part of a virtualized layout are
+ * picked up from the cache when they are laid out.
+ *
+ * \param urls The absolute URLs of the images now in the image cache.
+ */
+void Renderer::resources_loaded(const std::unordered_set<QString> &urls)
+{
+    if (!m_root || !m_image_cache_manager || urls.empty())
+    {
+        return;
+    }
+
+    // The boxes' nodes are read below; none may have been removed since layout
+    update_document();
+
+    // Tiles being rendered read the layout tree's images
+    std::vector<size_t> repaint_items;
+    bool needs_layout = fill_loaded_images(m_layout_tree, m_display_list, *m_image_cache_manager, m_base_url, urls,
+                                           repaint_items, [this]() { wait_for_tiles(); });
+
+    for (size_t index : repaint_items)
+    {
+        const DISPLAY_ITEM &item = m_display_list.items[index];
+        if (item.composited_layer >= 0)
+        {
+            if (static_cast<size_t>(item.composited_layer) < m_layer_images.size())
+            {
+                m_layer_images[item.composited_layer] = QImage();
+                update(m_layer_rects[item.composited_layer].toAlignedRect());
+            }
+        }
+        else
+        {
+            m_tile_cache.invalidate(item.bounds);
+            update(item.bounds.toAlignedRect());
+        }
+    }
+
+    if (needs_layout)
+    {
+        update_document();
+    }
+}
+
 /**
  * \brief Handles window resize events and recalculates layout if needed.
  *
  * Detects width changes and triggers layout recalculation to reflow content.
- * Passes the event to the base class for further processing.
+ * Media queries and height changes are handled by viewport_resized, as the
+ * visible height is the scroll area's and not the renderer's. Passes the
+ * event to the base class for further processing.
  *
  * \param event The resize event information.
  */
 void Renderer::resizeEvent(QResizeEvent *event)
 {
-    if (m_root && event->oldSize().width() != event->size().width())
+    bool width_changed = event->oldSize().width() != event->size().width();
+
+    // Without a scroll area the renderer is the viewport itself
+    bool laid_out = !scroll_area() && viewport_resized();
+
+    if (m_root && width_changed && !laid_out)
     {
         recalculate_layout();
     }
@@ -132,11 +276,32 @@ void Renderer::resizeEvent(QResizeEvent *event)
     QWidget::resizeEvent(event);
 }
 
+/**
+ * \brief Records the size of the visible area, the basis of media queries and vw/vh.
+ *
+ * That is the scroll area's viewport when the renderer sits in one, and the
+ * renderer itself otherwise.
+ */
+void Renderer::update_viewport_size()
+{
+    QScrollArea *area = scroll_area();
+    QWidget *viewport_widget = area ? area->viewport() : static_cast<QWidget *>(this);
+
+    m_viewport_width = viewport_widget->width();
+    m_viewport_height = viewport_widget->height();
+    if (m_viewport_width <= 0)
+    {
+        m_viewport_width = width() > 0 ? width() : 1000;
+    }
+}
+
 /**
  * \brief Recalculates the layout tree based on current viewport dimensions.
  *
- * Creates a fresh layout tree with the current widget width, calculating all
- * box positions and dimensions. Updates the widget's size hint to accommodate
+ * Rebuilds the layout tree with the current widget width, calculating all box
+ * positions and dimensions. Blocks that are layout-clean and keep their width
+ * are copied from the previous pass, so a resize or a local mutation only
+ * lays out what it affects. Updates the widget's size hint to accommodate
  * the rendered content.
  */
 void Renderer::recalculate_layout()
@@ -144,347 +309,923 @@ void Renderer::recalculate_layout()
     if (!m_root)
         return;
 
+    // Tiles being rendered read the layout tree and display list rebuilt here
+    wait_for_tiles();
+
     int current_width = this->width();
     if (current_width <= 0)
     {
-        QWidget *scroll_area = parentWidget(); // Viewport
-        if (scroll_area)
-            current_width = scroll_area->width();
+        QWidget *viewport_widget = parentWidget(); // Viewport
+        if (viewport_widget)
+            current_width = viewport_widget->width();
         if (current_width <= 0)
             current_width = 1000;
     }
 
     LINE_STATE line(current_width);
 
-    m_layout_tree = create_layout_tree(m_root, current_width, line, m_base_url, m_image_cache_manager);
+    QScrollArea *area = scroll_area();
+    update_viewport_size();
+
+    // Virtualized layout covers the visible screen and one screen on either
+    // side. The first block starting in view anchors the scroll position.
+    bool virtualize = m_virtualized_layout && area;
+    LAYOUT_VIEWPORT viewport;
+    int scroll_y = 0;
+    const NODE *anchor = nullptr;
+    float anchor_top = 0;
+
+    if (virtualize)
+    {
+        scroll_y = area->verticalScrollBar()->value();
+        float viewport_height = area->viewport()->height();
+        viewport.top = scroll_y - viewport_height;
+        viewport.bottom = scroll_y + 2 * viewport_height;
+
+        int anchor_index = m_layout_has_estimates ? find_scroll_anchor(scroll_y) : -1;
+        if (anchor_index >= 0)
+        {
+            anchor = m_layout_tree.boxes[anchor_index].node;
+            anchor_top = document_top(anchor_index);
+        }
+    }
+
+    // The last pass becomes the source of reusable blocks, and the storage
+    // of the one before it is refilled instead of allocating a new tree
+    std::swap(m_layout_tree, m_previous_layout_tree);
+    std::swap(m_layout_cache, m_previous_layout_cache);
+    m_layout_tree.clear();
+    m_layout_cache.clear();
+
+    LAYOUT_CONTEXT context{m_layout_tree, m_base_url, m_image_cache_manager,
+                           &m_previous_layout_tree, &m_previous_layout_cache, &m_layout_cache};
+    context.block_heights = &m_block_heights;
+    context.viewport_width = m_viewport_width;
+    context.viewport_height = m_viewport_height;
+
+    // rem lengths refer to the font size of the root element
+    for (const auto &child : m_root->get_children())
+    {
+        if (child->get_type() == NODE_TYPE::ELEMENT && child->is_style_resolved())
+        {
+            context.root_font_size = child->get_computed_style().font_size;
+            break;
+        }
+    }
+
+    if (virtualize)
+    {
+        context.viewport = &viewport;
+    }
+    else
+    {
+        // Measure words on all cores before the sequential line-breaking pass.
+        // Virtualized layout measures only a few screens of text and skips it:
+        // which blocks are in view is only known while breaking lines.
+        measure_text(m_root.get(), current_width, &m_previous_layout_cache, m_text_measurements);
+        context.measurements = &m_text_measurements;
+    }
+
+    create_layout_tree(m_root.get(), current_width, line, context);
     m_has_layout = true;
+    build_display_list(m_layout_tree, m_display_list, &m_animated_nodes);
+    m_layer_images.clear();
+    m_tile_cache.invalidate_all();
+    update_animations();
+    m_layout_has_estimates = context.estimated_boxes > 0;
+    m_layout_uses_viewport = context.viewport_lengths > 0;
+    m_layout_viewport = viewport;
 
-    float content_width = calculate_content_width(m_layout_tree);
-    float final_height = m_layout_tree.height;
+    // The root's overflow rect was accumulated bottom-up during layout
+    QRectF overflow = m_layout_tree.empty() ? QRectF() : m_layout_tree.boxes[0].overflow;
 
-    float min_width = std::max(static_cast<float>(current_width), content_width);
+    float min_width = std::max(static_cast<float>(current_width), static_cast<float>(overflow.right()));
+    float final_height = std::max(0.0f, static_cast<float>(overflow.bottom()));
 
     this->setMinimumSize(min_width, final_height);
+
+    // Estimates above the anchor were replaced by exact heights (or the
+    // other way round); keep the anchor where the user saw it.
+    if (anchor)
+    {
+        for (int i = 0; i < static_cast<int>(m_layout_tree.boxes.size()); ++i)
+        {
+            const LAYOUT_BOX &box = m_layout_tree.boxes[i];
+            if (box.node != anchor || box.estimated_count > 0)
+            {
+                continue;
+            }
+
+            int shift = qRound(document_top(i) - anchor_top);
+            if (shift != 0)
+            {
+                m_adjusting_scroll = true;
+                area->verticalScrollBar()->setValue(scroll_y + shift);
+                m_adjusting_scroll = false;
+            }
+            break;
+        }
+    }
 }
 
 /**
- * \brief Paints the rendered layout tree onto the widget surface.
+ * \brief Returns the scroll area showing the renderer, or nullptr.
  *
- * Fills the background with white and recursively paints all layout boxes,
- * including text, images, backgrounds, and borders using QPainter.
+ * Looked up once the renderer has been placed in a QScrollArea
+ * (QScrollArea -> viewport -> renderer). The vertical scroll bar is then
+ * connected to viewport_scrolled and the viewport's resizes are filtered
+ * into viewport_resized, so virtualized layout can follow both.
+ */
+QScrollArea *Renderer::scroll_area()
+{
+    if (!m_scroll_area && parentWidget())
+    {
+        m_scroll_area = qobject_cast<QScrollArea *>(parentWidget()->parentWidget());
+        if (m_scroll_area)
+        {
+            connect(m_scroll_area->verticalScrollBar(), &QScrollBar::valueChanged, this, &Renderer::viewport_scrolled);
+            m_scroll_area->viewport()->installEventFilter(this);
+        }
+    }
+    return m_scroll_area;
+}
+
+/**
+ * \brief Switches between virtualized and exact layout of the whole document.
  *
- * \param event The paint event information (unused, uses full widget rect).
+ * Virtualized layout (the default) lays out only the blocks near the visible
+ * area and estimates the height of the others, so very long documents show
+ * their first screen without being laid out entirely.
+ *
+ * \param enabled True to virtualize layout, false to lay out everything.
  */
-void Renderer::paintEvent(QPaintEvent *event)
+void Renderer::set_virtualized_layout(bool enabled)
 {
-    if (!m_root)
+    if (m_virtualized_layout == enabled)
     {
         return;
     }
 
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing);
+    m_virtualized_layout = enabled;
+    if (m_root)
+    {
+        recalculate_layout();
+        update();
+    }
+}
 
-    painter.fillRect(rect(), Qt::white);
+/**
+ * \brief Recomposites fixed layers, and lays out the newly visible area when scrolling leaves the exact region.
+ *
+ * \param value The new vertical scroll position.
+ */
+void Renderer::viewport_scrolled(int value)
+{
+    // Scrolling moved the fixed layers' pixels with the content; composite them again
+    bool has_fixed_layers = std::any_of(m_display_list.composited_layers.begin(), m_display_list.composited_layers.end(),
+                                        [this](size_t layer) { return m_display_list.layers[layer].fixed_root >= 0; });
+    if (has_fixed_layers)
+    {
+        update(visible_rect());
+    }
 
-    paint_layout(painter, m_layout_tree, 0, 0);
+    if (!m_layout_has_estimates || m_adjusting_scroll || !m_scroll_area)
+    {
+        return;
+    }
+
+    if (!layout_covers_viewport())
+    {
+        recalculate_layout();
+        update();
+    }
 }
 
-// ============================================================================
-// Rendering Helper Functions
-// ============================================================================
+/**
+ * \brief Forwards resizes of the scroll area's viewport to viewport_resized.
+ *
+ * The renderer fills the viewport's width but not its height, so making the
+ * window taller resizes the viewport without resizing the renderer.
+ *
+ * \param watched The object the event was sent to.
+ * \param event The event.
+ * \return False, so the viewport still handles the event.
+ */
+bool Renderer::eventFilter(QObject *watched, QEvent *event)
+{
+    if (m_scroll_area && watched == m_scroll_area->viewport() && event->type() == QEvent::Resize)
+    {
+        viewport_resized();
+    }
+    return QWidget::eventFilter(watched, event);
+}
 
 /**
- * \brief Draws the visual aspects of an element box (background, border, image).
- * 
- * Handles rendering the background color, border, and image content of a layout box.
- * Text nodes are not handled by this function.
- * 
- * \param painter The QPainter to draw with.
- * \param box The layout box to draw.
- * \param abs_x The absolute x coordinate in viewport space.
- * \param abs_y The absolute y coordinate in viewport space.
+ * \brief Updates what depends on the viewport's size after it was resized.
+ *
+ * Re-evaluates the stylesheet's media conditions first; only when one of
+ * them toggles are the elements matched by the affected rules restyled.
+ * The document is laid out again when that restyle needs it, when the last
+ * layout resolved vh or other viewport-relative lengths and the viewport's
+ * height changed, or when the viewport grew past the region a virtualized
+ * layout laid out exactly.
+ *
+ * \return True if the layout was recalculated.
  */
-void Renderer::draw_element_box(QPainter &painter, const LAYOUT_BOX &box, float abs_x, float abs_y)
+bool Renderer::viewport_resized()
 {
-    // Draw image if present
-    if (!box.image.isNull()) {
-        painter.drawPixmap(abs_x, abs_y, box.width, box.height, box.image);
-        return;
+    if (!m_root || !m_has_layout)
+    {
+        return false;
     }
-    
-    // Draw background color
-    if (box.style.background_color != QColor("transparent")) {
-        painter.fillRect(abs_x, abs_y, box.width, box.height, box.style.background_color);
+
+    int old_height = m_viewport_height;
+    update_viewport_size();
+    bool height_changed = m_viewport_height != old_height;
+
+    std::vector<size_t> toggled = m_cssom.update_media(m_viewport_width, m_viewport_height);
+    if (!toggled.empty())
+    {
+        invalidate_media_rules(m_root, m_cssom, toggled);
+        update_style(m_root, m_cssom);
     }
 
-    // Draw border
-    if (box.style.border_width > 0) {
-        QPen pen;
-        pen.setColor(box.style.border_color);
-        pen.setStyle(box.style.border_style);
-        pen.setWidthF(box.style.border_width);
+    bool layout_dirty = m_root->is_layout_dirty() || m_root->has_layout_dirty_descendant();
+    if (layout_dirty || (height_changed && m_layout_uses_viewport) || !layout_covers_viewport())
+    {
+        recalculate_layout();
+        update();
+        return true;
+    }
 
-        painter.setPen(pen);
-        painter.setBrush(Qt::NoBrush);
-        painter.drawRect(abs_x, abs_y, box.width, box.height);
+    if (!toggled.empty())
+    {
+        // Paint-only changes
+        update_document();
     }
+    return false;
 }
 
 /**
- * \brief Draws text content with alignment, decoration, and special handling.
- * 
- * Renders text nodes with proper alignment (left/center/right), text decoration
- * (underline/strikethrough/overline), and special rendering for list items (bullets).
- * 
- * \param painter The QPainter to draw with.
- * \param box The text layout box to render.
- * \param offset_x The x-offset of the parent in viewport coordinates.
- * \param offset_y The y-offset of the parent in viewport coordinates.
- * \param parent_box The parent element box for alignment calculations.
+ * \brief Tells whether the visible area lies inside the region the last layout laid out exactly.
+ *
+ * \return True if nothing in view is an estimate, or the layout estimated nothing.
  */
-void Renderer::draw_text_node(QPainter &painter, const LAYOUT_BOX &box, float offset_x, float offset_y, const LAYOUT_BOX *parent_box)
+bool Renderer::layout_covers_viewport()
 {
-    QFont ft = box.style.to_font();
-    painter.setFont(ft);
-    painter.setPen(box.style.color);
+    if (!m_layout_has_estimates)
+    {
+        return true;
+    }
+
+    QRect visible = visible_rect();
+    return visible.top() >= m_layout_viewport.top && visible.top() + visible.height() <= m_layout_viewport.bottom;
+}
+
+/**
+ * \brief Returns the document y of a box, ignoring relative offsets.
+ *
+ * \param index The index of the box.
+ * \return The distance from the top of the root box.
+ */
+float Renderer::document_top(int index) const
+{
+    float top = 0;
+    for (; index >= 0; index = m_layout_tree.boxes[index].parent)
+    {
+        top += m_layout_tree.boxes[index].y;
+    }
+    return top;
+}
+
+/**
+ * \brief Picks the box that keeps its place on screen across a virtualized relayout.
+ *
+ * \param scroll_y The current vertical scroll position.
+ * \return The index of the exactly laid-out, in-flow box starting closest
+ *         below the top of the viewport, or -1 if there is none.
+ */
+int Renderer::find_scroll_anchor(float scroll_y) const
+{
+    int anchor = -1;
+    float anchor_top = 0;
+
+    for (int i = 0; i < static_cast<int>(m_layout_tree.boxes.size()); ++i)
+    {
+        const LAYOUT_BOX &box = m_layout_tree.boxes[i];
+        if (box.estimated_count > 0 || box.is_positioned)
+        {
+            continue;
+        }
+
+        float top = document_top(i);
+        if (top >= scroll_y && (anchor < 0 || top < anchor_top))
+        {
+            anchor = i;
+            anchor_top = top;
+        }
+    }
+    return anchor;
+}
+
+/**
+ * \brief Collects the area that paint-only style changes have to repaint.
+ *
+ * Follows the paint-dirty bits down the layout tree. Boxes point at their
+ * node's computed style, so they already see the new values; a paint-dirty
+ * box and everything drawn inside it (opacity applies to the whole subtree)
+ * is added to the dirty rect. Text is widened to its parent's width because
+ * alignment and list bullets shift it at paint time. Fixed-position boxes
+ * are composited from layers of their own, so a change inside one is only
+ * reported. Paint-dirty bits are cleared along the way. The tree is walked
+ * with an explicit stack, so nesting depth is not limited by the call stack.
+ * Only called when nothing is layout-dirty: a removal marks its parent
+ * layout-dirty, so no box can refer to a removed node here.
+ *
+ * \param dirty_rect Receives the union of the document areas to repaint.
+ * \param fixed_dirty Set when a fixed-position box has to be repainted.
+ */
+void Renderer::refresh_paint_styles(QRectF &dirty_rect, bool &fixed_dirty)
+{
+    struct REFRESH_STEP
+    {
+        int index;
+        float offset_x;
+        float offset_y;
+        bool repaint; // an ancestor is repainted, so this box is too
+        bool fixed;   // inside a fixed-position box
+    };
+
+    fixed_dirty = false;
+    std::vector<REFRESH_STEP> stack{{0, 0, 0, false, false}};
+
+    while (!stack.empty())
+    {
+        REFRESH_STEP step = stack.back();
+        stack.pop_back();
+
+        const LAYOUT_BOX &box = m_layout_tree.boxes[step.index];
+        NODE &node = *box.node;
+        if (box.estimated_count > 0)
+        {
+            continue;
+        }
+
+        if (!step.repaint && !node.is_paint_dirty() && !node.has_paint_dirty_descendant())
+        {
+            continue;
+        }
+
+        bool repaint = step.repaint || node.is_paint_dirty();
+        node.clear_paint_dirty();
+
+        if (node.get_type() == NODE_TYPE::TEXT)
+        {
+            if (!repaint)
+            {
+                continue;
+            }
+
+            QRectF text_rect;
+            for (size_t i = 0; i < box.fragment_count; ++i)
+            {
+                const TEXT_FRAGMENT &fragment = m_layout_tree.fragments[box.first_fragment + i];
+                text_rect |= QRectF(step.offset_x + fragment.x, step.offset_y + fragment.y, fragment.width, fragment.height);
+            }
+
+            if (box.parent >= 0)
+            {
+                text_rect |= QRectF(step.offset_x, text_rect.top(), m_layout_tree.boxes[box.parent].width, text_rect.height());
+            }
 
-    QFontMetrics metrics(ft);
+            fixed_dirty = fixed_dirty || (step.fixed && !text_rect.isEmpty());
+            if (!step.fixed)
+            {
+                dirty_rect |= text_rect;
+            }
+            continue;
+        }
+
+        const COMPUTED_STYLE &style = *box.style;
+        float abs_x = step.offset_x + box.x;
+        float abs_y = step.offset_y + box.y;
 
-    // Calculate text alignment offset
-    float offset_adjust = 0;
-    if (parent_box) {
-        float total_width = 0;
-        for (const auto &word_box : box.children) {
-            total_width += word_box.width;
+        if (style.position == POSITION_TYPE::Relative)
+        {
+            abs_x += style.left - style.right;
+            abs_y += style.top - style.bottom;
         }
 
-        if (parent_box->style.text_align == TEXT_ALIGN::Center) {
-            offset_adjust = (parent_box->width - total_width) / 2;
+        if (repaint)
+        {
+            float border_margin = style.border_width / 2 + 1;
+            QRectF box_rect = QRectF(abs_x, abs_y, box.width, box.height)
+                                  .adjusted(-border_margin, -border_margin, border_margin, border_margin);
+            fixed_dirty = fixed_dirty || (step.fixed && !box_rect.isEmpty());
+            if (!step.fixed)
+            {
+                dirty_rect |= box_rect;
+            }
         }
-        else if (parent_box->style.text_align == TEXT_ALIGN::Right) {
-            offset_adjust = parent_box->width - total_width;
+
+        for (int child = box.first_child; child >= 0; child = m_layout_tree.boxes[child].next_sibling)
+        {
+            stack.push_back({child, abs_x, abs_y, repaint, step.fixed});
+        }
+
+        for (int abs_child = box.first_absolute_child; abs_child >= 0; abs_child = m_layout_tree.boxes[abs_child].next_sibling)
+        {
+            if (m_layout_tree.boxes[abs_child].style->position == POSITION_TYPE::Fixed)
+            {
+                stack.push_back({abs_child, 0, 0, repaint, true});
+            }
+            else
+            {
+                stack.push_back({abs_child, abs_x, abs_y, repaint, step.fixed});
+            }
         }
     }
+}
 
-    // Draw bullet for list items
-    if (parent_box && parent_box->node->get_tag_name() == "li") {
-        painter.drawText(offset_x + box.x + offset_adjust, offset_y + box.y + metrics.ascent(), "•");
-        offset_adjust += 15;
-    }
-
-    // Draw each word with decoration
-    for (const auto &word_box : box.children) {
-        float word_abs_x = offset_x + word_box.x + offset_adjust;
-        float word_abs_y = offset_y + word_box.y;
-        float baseline_y = word_abs_y + metrics.ascent();
-
-        // Draw text
-        painter.drawText(word_abs_x, baseline_y, QString::fromStdString(word_box.text));
-
-        // Draw text decoration (underline, strikethrough, overline)
-        if (word_box.style.text_decoration != TEXT_DECORATION::None) {
-            QPen decoration_pen(box.style.color);
-            decoration_pen.setWidth(1);
-            painter.setPen(decoration_pen);
-
-            float decoration_y = 0;
-            switch (box.style.text_decoration) {
-            case TEXT_DECORATION::UnderLine:
-                decoration_y = baseline_y + 1;
-                break;
-            case TEXT_DECORATION::LineThrough:
-                decoration_y = word_abs_y + metrics.ascent() / 2;
-                break;
-            default:
-                decoration_y = word_abs_y;
-                break;
+/**
+ * \brief Paints the part of the document that needs repainting.
+ *
+ * The scrolling content is rasterized into TILE_SIZE tiles on the worker
+ * pool, so this only blits tiles and never waits for the document to be
+ * painted: a tile not rendered yet shows a checkerboard, and a damaged tile
+ * shows its previous image until the new one arrives. Missing tiles in and
+ * around the visible area are scheduled from here. Fixed-position boxes and
+ * elements whose opacity or transform animates are composited over the
+ * tiles from cached layer images, placed for the current scroll offset and
+ * drawn with the current frame's transform and opacity.
+ *
+ * \param event The paint event holding the area to repaint.
+ */
+void Renderer::paintEvent(QPaintEvent *event)
+{
+    if (!m_root)
+    {
+        return;
+    }
+
+    QPainter painter(this);
+    QRect dirty_rect = event->rect();
+    painter.setClipRect(dirty_rect);
+
+    int first_column = std::max(0, dirty_rect.left() / TILE_SIZE);
+    int last_column = std::max(0, dirty_rect.right() / TILE_SIZE);
+    int first_row = std::max(0, dirty_rect.top() / TILE_SIZE);
+    int last_row = std::max(0, dirty_rect.bottom() / TILE_SIZE);
+
+    for (int row = first_row; row <= last_row; ++row)
+    {
+        for (int column = first_column; column <= last_column; ++column)
+        {
+            QPoint tile_origin = TILE_CACHE::tile_rect(column, row).topLeft();
+            TILE *tile = m_tile_cache.find(column, row);
+
+            if (tile && !tile->image.isNull())
+            {
+                painter.drawImage(tile_origin, tile->image);
+            }
+            else
+            {
+                painter.drawImage(tile_origin, checkerboard());
             }
 
-            painter.drawLine(word_abs_x, decoration_y, word_abs_x + word_box.width, decoration_y);
+            if (!tile || (!tile->is_ready() && !tile->pending))
+            {
+                schedule_tile(column, row);
+            }
         }
     }
 
-    painter.setPen(box.style.color);
+    // Render one more row of tiles above and below the screen, so scrolling
+    // by less than a tile finds them ready
+    QRect prefetch_rect = visible_rect();
+    if (!prefetch_rect.isEmpty())
+    {
+        prefetch_rect = prefetch_rect.adjusted(0, -TILE_SIZE, 0, TILE_SIZE);
+        for (int row = std::max(0, prefetch_rect.top() / TILE_SIZE); row <= std::max(0, prefetch_rect.bottom() / TILE_SIZE); ++row)
+        {
+            for (int column = std::max(0, prefetch_rect.left() / TILE_SIZE); column <= std::max(0, prefetch_rect.right() / TILE_SIZE); ++column)
+            {
+                TILE *tile = m_tile_cache.find(column, row);
+                if (!tile || (!tile->is_ready() && !tile->pending))
+                {
+                    schedule_tile(column, row);
+                }
+            }
+        }
+    }
+
+    // Composited layers are rasterized once; scrolling and animation only
+    // change where and how they are drawn. Layers too large for one image
+    // are rasterized around the visible area, and again once it leaves that.
+    m_layer_images.resize(m_display_list.layers.size());
+    m_layer_image_rects.resize(m_display_list.layers.size());
+    m_layer_rects.resize(m_display_list.layers.size());
+    QRect visible = visible_rect();
+    if (visible.isEmpty())
+    {
+        visible = rect();
+    }
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    for (size_t layer : m_display_list.composited_layers)
+    {
+        const DISPLAY_LAYER &target = m_display_list.layers[layer];
+        QTransform transform = layer_transform(layer);
+        m_layer_rects[layer] = transform.mapRect(QRectF(target.bounds.toAlignedRect()));
+
+        float opacity = layer_opacity(layer);
+        if (opacity <= 0 || !m_layer_rects[layer].intersects(QRectF(dirty_rect)))
+        {
+            continue;
+        }
+
+        QTransform to_layer = transform.inverted();
+        QRect needed = layer_image_rect(target, to_layer.mapRect(QRectF(visible)).toAlignedRect());
+        if (needed.isEmpty())
+        {
+            continue;
+        }
+
+        if (m_layer_images[layer].isNull() || !m_layer_image_rects[layer].contains(needed))
+        {
+            QRect around = visible.adjusted(-TILE_SIZE, -TILE_SIZE, TILE_SIZE, TILE_SIZE);
+            QRect clip = to_layer.mapRect(QRectF(around)).toAlignedRect();
+            m_layer_images[layer] = render_layer(m_display_list, m_layout_tree, layer, clip);
+            m_layer_image_rects[layer] = layer_image_rect(target, clip);
+        }
+
+        painter.setTransform(transform);
+        painter.setOpacity(opacity);
+        painter.drawImage(m_layer_image_rects[layer].topLeft(), m_layer_images[layer]);
+    }
+    painter.setTransform(QTransform());
 }
 
 // ============================================================================
-// Main Paint Layout
+// Rendering Helper Functions
 // ============================================================================
 
 /**
- * \brief Recursively paints a layout box and its children.
+ * \brief Renders a tile of the document on the worker pool.
  *
- * Draws background colors, borders, images, text, and text decorations.
- * Handles relative positioning adjustments and opacity changes. Recursively
- * paints child boxes and absolutely/fixed positioned children.
+ * The worker reads only the display list and the layout tree, which are not
+ * changed before wait_for_tiles() returns, and draws text with fonts it
+ * opens itself. The image is handed back to the GUI thread, which owns the
+ * tile cache.
  *
- * \param painter The QPainter to draw with.
- * \param box The layout box to paint.
- * \param offset_x The x-offset of the parent in viewport coordinates.
- * \param offset_y The y-offset of the parent in viewport coordinates.
- * \param parent_box Optional parent box for text alignment calculations.
+ * \param column The tile's column.
+ * \param row The tile's row.
  */
-void Renderer::paint_layout(QPainter &painter, const LAYOUT_BOX &box, float offset_x, float offset_y, const LAYOUT_BOX *parent_box)
+void Renderer::schedule_tile(int column, int row)
 {
-    float abs_x = offset_x + box.x;
-    float abs_y = offset_y + box.y;
+    uint64_t version = m_tile_cache.schedule(column, row);
+    QRect tile_rect = TILE_CACHE::tile_rect(column, row);
 
-    float previous_opacity = painter.opacity();
-    painter.setOpacity(previous_opacity * box.style.opacity);
+    WORK_STEALING_POOL::shared().submit([this, column, row, version, tile_rect]()
+    {
+        QImage image = render_tile(m_display_list, m_layout_tree, tile_rect);
+        QMetaObject::invokeMethod(this, [this, column, row, version, image]()
+        {
+            tile_rendered(column, row, version, image);
+        }, Qt::QueuedConnection);
+    }, &m_tile_group);
+}
 
-    // Apply relative positioning offset
-    if (box.style.position == POSITION_TYPE::Relative) {
-        abs_x += box.style.left - box.style.right;
-        abs_y += box.style.top - box.style.bottom;
-    }
+/**
+ * \brief Stores a tile rendered by a worker and repaints the area it covers.
+ *
+ * A tile damaged while it was rendered is repainted too, which schedules it
+ * again.
+ *
+ * \param column The tile's column.
+ * \param row The tile's row.
+ * \param version The tile's version when it was scheduled.
+ * \param image The rendered tile.
+ */
+void Renderer::tile_rendered(int column, int row, uint64_t version, const QImage &image)
+{
+    m_tile_cache.store(column, row, version, image);
+    update(TILE_CACHE::tile_rect(column, row));
+}
 
-    // Draw element-specific content (background, border, image)
-    if (box.node->get_type() == NODE_TYPE::ELEMENT) {
-        draw_element_box(painter, box, abs_x, abs_y);
-    }
+/**
+ * \brief Returns how a composited layer's image is mapped onto the document.
+ *
+ * The layer's transform, animated or from its style, applies around the
+ * center of its element, inside the transform of the composited layer it is
+ * nested in. A fixed layer is placed for the current scroll offset instead.
+ *
+ * \param layer The index of a composited layer.
+ */
+QTransform Renderer::layer_transform(size_t layer)
+{
+    const DISPLAY_LAYER &target = m_display_list.layers[layer];
 
-    // Draw text node content (with alignment, decoration, bullets)
-    if (box.node->get_type() == NODE_TYPE::TEXT) {
-        draw_text_node(painter, box, offset_x, offset_y, parent_box);
-        painter.setOpacity(previous_opacity);
-        return;
+    TRANSFORM transform = target.transform;
+    auto animated = m_animated_values.find(m_layout_tree.boxes[target.box].node);
+    if (animated != m_animated_values.end() && animated->second.has_transform)
+    {
+        transform = animated->second.transform;
     }
 
-    // Recursively paint children
-    for (const auto &child : box.children) {
-        paint_layout(painter, child, abs_x, abs_y, &box);
+    QTransform local;
+    if (!transform.is_identity())
+    {
+        QPointF center = target.box_rect.center();
+        local.translate(center.x() + transform.translate_x, center.y() + transform.translate_y);
+        local.rotate(transform.rotate);
+        local.scale(transform.scale_x, transform.scale_y);
+        local.translate(-center.x(), -center.y());
     }
 
-    // Paint positioned children (absolute/fixed)
-    for (const auto &abs_child : box.absolute_children) {
-        if (abs_child.style.position == POSITION_TYPE::Fixed) {
-            paint_fixed(painter, abs_child);
-        } else {
-            paint_layout(painter, abs_child, abs_x, abs_y, &box);
-        }
+    int parent = target.composite_parent;
+    if (parent >= 0 && m_display_list.layers[parent].fixed_root == target.fixed_root)
+    {
+        return local * layer_transform(parent);
     }
 
-    painter.setOpacity(previous_opacity);
+    QPointF origin = target.fixed_root >= 0 ? fixed_origin(target.fixed_root) : QPointF();
+    return local * QTransform::fromTranslate(origin.x(), origin.y());
 }
 
 /**
- * \brief Paints a fixed-position layout box adjusted for scroll position.
+ * \brief Returns the opacity a composited layer's image is drawn with.
  *
- * Calculates the screen position of a fixed element, accounting for scroll
- * offset and CSS positioning properties (top, right, bottom, left).
+ * That is the element's animated or own opacity, times that of every layer
+ * around it.
  *
- * \param painter The QPainter to draw with.
- * \param box The fixed-position layout box to paint.
+ * \param layer The index of a composited layer.
  */
-void Renderer::paint_fixed(QPainter &painter, const LAYOUT_BOX &box)
+float Renderer::layer_opacity(size_t layer)
 {
-    // QScrollArea -> ViewPort(hidden) -> renderer
-    QScrollArea *scroll_area = qobject_cast<QScrollArea *>(parentWidget()->parentWidget());
-    int scroll_x = 0;
-    int scroll_y = 0;
+    const DISPLAY_LAYER &target = m_display_list.layers[layer];
 
-    if (scroll_area)
+    float opacity = target.opacity;
+    auto animated = m_animated_values.find(m_layout_tree.boxes[target.box].node);
+    if (animated != m_animated_values.end() && animated->second.has_opacity)
     {
-        scroll_x = scroll_area->horizontalScrollBar()->value();
-        scroll_y = scroll_area->verticalScrollBar()->value();
+        opacity = animated->second.opacity;
     }
 
-    float draw_x = 0, draw_y = 0;
+    opacity *= target.outer_opacity;
+    if (target.composite_parent >= 0)
+    {
+        opacity *= layer_opacity(target.composite_parent);
+    }
+    return opacity;
+}
 
-    if (box.style.is_left_set)
+/**
+ * \brief Returns the area a composited layer currently covers, in widget coordinates.
+ */
+QRectF Renderer::layer_rect(size_t layer)
+{
+    return layer_transform(layer).mapRect(QRectF(m_display_list.layers[layer].bounds.toAlignedRect()));
+}
+
+/**
+ * \brief Starts the transitions and animations the last restyle calls for.
+ *
+ * Called whenever the display list is rebuilt. Composited layers are
+ * repainted where they were drawn and where they are now, since they may
+ * have changed or moved.
+ */
+void Renderer::update_animations()
+{
+    for (const QRectF &rect : m_layer_rects)
     {
-        draw_x = scroll_x + box.style.left;
+        update(rect.toAlignedRect());
     }
 
-    else if (box.style.is_right_set)
+    m_timeline.update(m_layout_tree, m_cssom, static_cast<double>(m_clock.elapsed()));
+    m_layer_rects.assign(m_display_list.layers.size(), QRectF());
+    animation_frame();
+
+    for (size_t layer : m_display_list.composited_layers)
     {
-        draw_x = scroll_x + m_viewport_width - box.width - box.style.right;
+        m_layer_rects[layer] = layer_rect(layer);
+        update(m_layer_rects[layer].toAlignedRect());
     }
-    else
+}
+
+/**
+ * \brief Advances transitions and animations by one frame.
+ *
+ * Animated values are applied only when compositing: the layers of the
+ * elements they belong to are repainted where they were and where they are
+ * now, from their cached images. Nothing is restyled, laid out or
+ * rasterized again, so a frame costs a few image draws. The frame timer
+ * runs only while animations do.
+ */
+void Renderer::animation_frame()
+{
+    std::unordered_map<const NODE *, ANIMATED_VALUES> previous;
+    std::swap(previous, m_animated_values);
+    bool running = m_timeline.sample(static_cast<double>(m_clock.elapsed()), m_animated_values);
+    composite_animated_nodes();
+
+    m_layer_rects.resize(m_display_list.layers.size());
+    for (size_t layer : m_display_list.composited_layers)
     {
-        draw_x = scroll_x;
+        // A layer moves with the animated layers it is nested in
+        bool animated = false;
+        for (int outer = static_cast<int>(layer); outer >= 0 && !animated; outer = m_display_list.layers[outer].composite_parent)
+        {
+            const NODE *node = m_layout_tree.boxes[m_display_list.layers[outer].box].node;
+            animated = m_animated_values.count(node) > 0 || previous.count(node) > 0;
+        }
+        if (!animated)
+        {
+            continue;
+        }
+
+        update(m_layer_rects[layer].toAlignedRect());
+        m_layer_rects[layer] = layer_rect(layer);
+        update(m_layer_rects[layer].toAlignedRect());
     }
 
-    if (box.style.is_top_set)
+    if (!running)
     {
-        draw_y = scroll_y + box.style.top;
+        m_frame_timer->stop();
     }
+    else if (!m_frame_timer->isActive())
+    {
+        m_frame_timer->start();
+    }
+}
 
-    else if (box.style.is_bottom_set)
+/**
+ * \brief Composites the elements that started animating, and stops compositing those that stopped.
+ *
+ * The display list is rebuilt only when the set of animated elements
+ * changes, at the first and last frame of an animation. Tiles drew the
+ * elements that get a layer now and left out those that lose one, so they
+ * are rendered again where those layers are.
+ */
+void Renderer::composite_animated_nodes()
+{
+    bool changed = m_animated_values.size() != m_animated_nodes.size();
+    for (auto it = m_animated_values.begin(); !changed && it != m_animated_values.end(); ++it)
     {
-        draw_y = scroll_y + m_viewport_height - box.height - box.style.top;
+        changed = m_animated_nodes.count(it->first) == 0;
     }
-    else
+    if (!changed)
     {
-        draw_y = scroll_y;
+        return;
     }
 
-    float previous_opacity = painter.opacity();
-    painter.setOpacity(previous_opacity * box.style.opacity);
+    std::unordered_set<const NODE *> nodes;
+    for (const auto &[node, values] : m_animated_values)
+    {
+        nodes.insert(node);
+    }
 
-    if (box.style.background_color != QColor("transparent"))
+    // The tiles under layers that start or stop being composited
+    auto damage_layers = [this, &nodes]()
     {
-        painter.fillRect(draw_x, draw_y, box.width, box.height, box.style.background_color);
+        for (const DISPLAY_LAYER &layer : m_display_list.layers)
+        {
+            const NODE *node = m_layout_tree.boxes[layer.box].node;
+            if (layer.fixed_root < 0 && nodes.count(node) != m_animated_nodes.count(node))
+            {
+                m_tile_cache.invalidate(layer.bounds);
+                update(layer.bounds.toAlignedRect());
+            }
+        }
+    };
+
+    for (const QRectF &rect : m_layer_rects)
+    {
+        update(rect.toAlignedRect());
     }
 
-    if (box.style.border_width > 0)
+    damage_layers();
+    wait_for_tiles();
+    std::swap(m_animated_nodes, nodes);
+    build_display_list(m_layout_tree, m_display_list, &m_animated_nodes);
+    m_layer_images.clear();
+    damage_layers();
+
+    m_layer_rects.assign(m_display_list.layers.size(), QRectF());
+    for (size_t layer : m_display_list.composited_layers)
     {
-        QPen pen;
-        pen.setColor(box.style.border_color);
-        pen.setStyle(box.style.border_style);
-        pen.setWidthF(box.style.border_width);
+        m_layer_rects[layer] = layer_rect(layer);
+        update(m_layer_rects[layer].toAlignedRect());
+    }
+}
+
+/**
+ * \brief Blocks until no worker is rendering a tile.
+ *
+ * Called before the layout tree or display list is changed. The waiting
+ * thread renders queued tiles itself, so this lasts at most a few tiles.
+ */
+void Renderer::wait_for_tiles()
+{
+    WORK_STEALING_POOL::shared().wait(m_tile_group);
+}
 
-        painter.setPen(pen);
-        painter.setBrush(Qt::NoBrush);
+/**
+ * \brief Returns the placeholder drawn for tiles that are not rendered yet.
+ */
+const QImage &Renderer::checkerboard()
+{
+    if (m_checkerboard.isNull())
+    {
+        const int square = 16;
+        m_checkerboard = QImage(TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32_Premultiplied);
+        m_checkerboard.fill(QColor(255, 255, 255));
 
-        painter.drawRect(draw_x, draw_y, box.width, box.height);
+        QPainter painter(&m_checkerboard);
+        for (int y = 0; y < TILE_SIZE; y += square)
+        {
+            for (int x = (y / square) % 2 * square; x < TILE_SIZE; x += 2 * square)
+            {
+                painter.fillRect(QRect(x, y, square, square), QColor(235, 235, 235));
+            }
+        }
     }
+    return m_checkerboard;
+}
 
-    for (const auto &child : box.children)
+/**
+ * \brief Returns the part of the document shown on screen.
+ *
+ * \return The scroll area's viewport in document coordinates, or an empty
+ *         rect when the renderer is not in a scroll area.
+ */
+QRect Renderer::visible_rect()
+{
+    QScrollArea *area = scroll_area();
+    if (!area)
     {
-        paint_layout(painter, child, draw_x, draw_y, &box);
+        return QRect();
     }
 
-    painter.setOpacity(previous_opacity);
+    return QRect(area->horizontalScrollBar()->value(), area->verticalScrollBar()->value(),
+                 area->viewport()->width(), area->viewport()->height());
 }
 
 /**
- * \brief Calculates the total horizontal content width of a layout tree.
+ * \brief Computes where a fixed-position box is drawn for the current scroll position.
  *
- * Traverses the layout tree to find the rightmost extent of all boxes,
- * accounting for their absolute positions. Returns the maximum right edge.
+ * Accounts for the scroll offset and the CSS positioning properties (top,
+ * right, bottom, left). The box's display items are relative to this point.
  *
- * \param root The root layout box to measure.
- * \return The total content width in pixels.
+ * \param index The index of the fixed-position layout box.
+ * \return The box's top-left corner, in widget coordinates.
  */
-float calculate_content_width(const LAYOUT_BOX &root)
+QPointF Renderer::fixed_origin(int index)
 {
-    float max_right = root.x + root.width;
+    const LAYOUT_BOX &box = m_layout_tree.boxes[index];
+    const COMPUTED_STYLE &style = *box.style;
 
-    std::queue<std::pair<LAYOUT_BOX, float>> q;
-    q.push({root, 0.0f});
+    QScrollArea *area = scroll_area();
+    int scroll_x = 0;
+    int scroll_y = 0;
 
-    while (!q.empty())
+    if (area)
     {
-        auto [current_box, parent_abs_x] = q.front();
-        q.pop();
+        scroll_x = area->horizontalScrollBar()->value();
+        scroll_y = area->verticalScrollBar()->value();
+    }
 
-        float current_abs_x = parent_abs_x + current_box.x;
-        float current_right = current_abs_x + current_box.width;
+    float draw_x = 0, draw_y = 0;
 
-        if (current_right > max_right)
-        {
-            max_right = current_right;
-        }
+    if (style.is_left_set)
+    {
+        draw_x = scroll_x + style.left;
+    }
 
-        for (const auto &child : current_box.children)
-        {
-            q.push({child, current_abs_x});
-        }
+    else if (style.is_right_set)
+    {
+        draw_x = scroll_x + m_viewport_width - box.width - style.right;
+    }
+    else
+    {
+        draw_x = scroll_x;
     }
 
-    return max_right - root.x;
+    if (style.is_top_set)
+    {
+        draw_y = scroll_y + style.top;
+    }
+
+    else if (style.is_bottom_set)
+    {
+        draw_y = scroll_y + m_viewport_height - box.height - style.bottom;
+    }
+    else
+    {
+        draw_y = scroll_y;
+    }
+
+    return QPointF(draw_x, draw_y);
 }
 
 /**
@@ -517,7 +1258,10 @@ void Renderer::mousePressEvent(QMouseEvent *event)
 /**
  * \brief Finds the DOM node at a given viewport coordinate.
  *
- * Delegates to find_node_in_box with the root layout box and (0,0) offset.
+ * Queries the hit-test grid built with the display list, so only the boxes
+ * sharing a grid cell with the point are checked. Positioned and fixed boxes
+ * win over what they are drawn on top of. Pending DOM mutations are applied
+ * first, so the boxes never refer to removed nodes.
  *
  * \param x The x-coordinate in viewport space.
  * \param y The y-coordinate in viewport space.
@@ -525,74 +1269,20 @@ void Renderer::mousePressEvent(QMouseEvent *event)
  */
 std::shared_ptr<NODE> Renderer::find_node_at(float x, float y)
 {
-    return find_node_in_box(m_layout_tree, x, y, 0, 0);
-}
-
-/**
- * \brief Recursively searches layout boxes to find the node at a coordinate.
- *
- * Performs a depth-first search of layout boxes, checking children first
- * (to handle overlapping elements correctly), then checking if the coordinate
- * is within the current box's bounds.
- *
- * \param box The layout box to search within.
- * \param x The target x-coordinate.
- * \param y The target y-coordinate.
- * \param offset_x The parent's x-offset in viewport space.
- * \param offset_y The parent's y-offset in viewport space.
- * \return A shared pointer to the DOM node at the position, or nullptr.
- */
-std::shared_ptr<NODE> Renderer::find_node_in_box(const LAYOUT_BOX &box, float x, float y, float offset_x, float offset_y)
-{
-    float abs_x = offset_x + box.x;
-    float abs_y = offset_y + box.y;
-
-    if (box.style.position == POSITION_TYPE::Relative)
-    {
-        abs_x += box.style.left - box.style.right;
-        abs_y += box.style.top - box.style.bottom;
-    }
-
-    // FIRST: Always check children, regardless of this box's bounds
-    // Why: For inline elements, parent box might be (0,0) but children have real positions
-    for (const auto &child : box.children)
-    {
-        auto result = find_node_in_box(child, x, y, abs_x, abs_y);
-        if (result)
-        {
-            return result;
-        }
-    }
+    // A node removed since the last layout would still be hit through its box
+    update_document();
 
-    for (const auto &abs_child : box.absolute_children)
-    {
-        if (abs_child.style.position == POSITION_TYPE::Fixed)
-        {
-            continue;
-        }
-        auto result = find_node_in_box(abs_child, x, y, abs_x, abs_y);
-        if (result)
-        {
-            return result;
-        }
-    }
-
-    // THEN: Check if click is inside this box's bounds
-    bool inside = (x >= abs_x && x <= abs_x + box.width &&
-                   y >= abs_y && y <= abs_y + box.height);
-
-    if (!inside)
+    if (m_layout_tree.empty())
     {
         return nullptr;
     }
 
-    // If no children matched and we're inside, return this node
-    if (box.node)
+    int index = m_display_list.hit_test(QPointF(x, y), [this](int fixed_root) { return fixed_origin(fixed_root); });
+    if (index < 0)
     {
-        return box.node;
+        return nullptr;
     }
-
-    return nullptr;
+    return m_layout_tree.boxes[index].node->shared_from_this();
 }
 
 /**
@@ -1,10 +1,12 @@
 #include "html/node.h"
+#include <algorithm>
 
 /**
  * \brief Constructs a DOM Node with type and content.
  *
  * Creates either an ELEMENT node with a tag name or a TEXT node with text content.
  * The constructor determines the node type and stores the appropriate value.
+ * Text is decoded from UTF-8 to UTF-16 here, once, for layout and paint.
  *
  * \param t The node type (ELEMENT or TEXT).
  * \param content The tag name (if ELEMENT) or text content (if TEXT).
@@ -14,12 +16,39 @@ NODE::NODE(NODE_TYPE t, const std::string &content) : m_type(t)
     if (t == NODE_TYPE::ELEMENT)
     {
         m_tag_name = content;
-        m_text = "";
     }
     else
     {
-        m_text = content;
-        m_tag_name = "";
+        m_text = QString::fromStdString(content);
+    }
+}
+
+/**
+ * \brief Destroys the node and the subtree it owns without recursing.
+ *
+ * The default destructor would release children through nested shared_ptr
+ * destructors, one stack frame per level, which overflows on deeply nested
+ * documents. Instead, subtrees owned by nothing else are unlinked onto a
+ * local list and released one node at a time, each with no children left.
+ */
+NODE::~NODE()
+{
+    std::vector<std::shared_ptr<NODE>> pending = std::move(m_children);
+    m_children.clear();
+
+    while (!pending.empty())
+    {
+        std::shared_ptr<NODE> node = std::move(pending.back());
+        pending.pop_back();
+
+        if (node.use_count() == 1)
+        {
+            for (auto &child : node->m_children)
+            {
+                pending.push_back(std::move(child));
+            }
+            node->m_children.clear();
+        }
     }
 }
 
@@ -33,9 +62,60 @@ NODE::NODE(NODE_TYPE t, const std::string &content) : m_type(t)
  */
 void NODE::add_child(std::shared_ptr<NODE> child)
 {
-    m_children.push_back(child);
+    insert_child(child, m_children.size());
+}
+
+/**
+ * \brief Inserts a child node at a position and schedules it for styling.
+ *
+ * The new child (and therefore its whole subtree) is marked style-dirty,
+ * which propagates up the ancestor chain so the next incremental update
+ * finds it without walking the rest of the document.
+ *
+ * \param child The child Node to insert.
+ * \param index The position among the existing children; clamped to the end.
+ */
+void NODE::insert_child(std::shared_ptr<NODE> child, size_t index)
+{
+    if (!child)
+    {
+        return;
+    }
+
+    index = std::min(index, m_children.size());
+    m_children.insert(m_children.begin() + index, child);
 
     child->set_parent(shared_from_this());
+    child->mark_style_dirty();
+    child->mark_layout_dirty();
+
+    m_children_changed = true;
+    flag_ancestors_style_dirty();
+}
+
+/**
+ * \brief Detaches a child node from this node.
+ *
+ * Removing a child changes the flow of this node, so this node is marked
+ * layout-dirty. Siblings are only restyled if some selector uses a sibling
+ * combinator, which the cascade decides from the recorded structure change.
+ *
+ * \param child The child Node to remove.
+ */
+void NODE::remove_child(std::shared_ptr<NODE> child)
+{
+    auto it = std::find(m_children.begin(), m_children.end(), child);
+    if (it == m_children.end())
+    {
+        return;
+    }
+
+    m_children.erase(it);
+    child->set_parent(std::weak_ptr<NODE>());
+    mark_layout_dirty();
+
+    m_children_changed = true;
+    flag_ancestors_style_dirty();
 }
 
 /**
@@ -51,13 +131,53 @@ const std::string NODE::get_tag_name() const
 /**
  * \brief Returns the text content of a TEXT node.
  *
+ * Converts from the stored UTF-16 text; layout and paint use
+ * get_text_utf16() instead.
+ *
  * \return The text string for TEXT nodes. Empty string for ELEMENT nodes.
  */
 const std::string NODE::get_text_content() const
+{
+    return m_text.toStdString();
+}
+
+/**
+ * \brief Returns the text content of a TEXT node as decoded once at construction.
+ *
+ * Text fragments index into this string, so layout and paint never decode
+ * UTF-8 again.
+ *
+ * \return The UTF-16 text for TEXT nodes. Empty string for ELEMENT nodes.
+ */
+const QString &NODE::get_text_utf16() const
 {
     return m_text;
 }
 
+/**
+ * \brief Replaces the text content of a TEXT node.
+ *
+ * Text never affects selector matching, so only layout is invalidated.
+ *
+ * \param text The new text content.
+ */
+void NODE::set_text_content(const std::string &text)
+{
+    if (m_type != NODE_TYPE::TEXT)
+    {
+        return;
+    }
+
+    QString new_text = QString::fromStdString(text);
+    if (m_text == new_text)
+    {
+        return;
+    }
+
+    m_text = new_text;
+    mark_layout_dirty();
+}
+
 /**
  * \brief Returns the type of this node.
  *
@@ -114,7 +234,8 @@ const std::vector<std::shared_ptr<NODE>> &NODE::get_children() const
  * \brief Sets an HTML attribute on this node.
  *
  * Stores a name-value pair in the attributes map if both are non-empty.
- * Used for attributes like class, id, href, src, etc.
+ * Used for attributes like class, id, href, src, etc. A changed value is
+ * queued for selector-based style invalidation.
  *
  * \param name The attribute name.
  * \param value The attribute value.
@@ -123,10 +244,61 @@ void NODE::set_attribute(const std::string &name, const std::string &value)
 {
     if (!name.empty() && !value.empty())
     {
+        auto it = m_attributes.find(name);
+        std::string old_value = it != m_attributes.end() ? it->second : "";
+        if (it != m_attributes.end() && old_value == value)
+        {
+            return;
+        }
+
         m_attributes[name] = value;
+        schedule_attribute_invalidation(name, old_value, value);
     }
 }
 
+/**
+ * \brief Removes an HTML attribute from this node.
+ *
+ * Marks the node style-dirty if the attribute was present.
+ *
+ * \param name The attribute name to remove.
+ */
+void NODE::remove_attribute(const std::string &name)
+{
+    auto it = m_attributes.find(name);
+    if (it == m_attributes.end())
+    {
+        return;
+    }
+
+    std::string old_value = it->second;
+    m_attributes.erase(it);
+    schedule_attribute_invalidation(name, old_value, "");
+}
+
+/**
+ * \brief Records an attribute change for selector-based invalidation.
+ *
+ * The node does not know which selectors exist, so the change is queued and
+ * ancestors are flagged; the cascade later looks the attribute up in the
+ * CSSOM's invalidation sets and marks only the elements that can change.
+ * Nothing is recorded while the whole subtree is pending a restyle anyway.
+ *
+ * \param name The attribute name.
+ * \param old_value The previous value (empty if absent).
+ * \param new_value The new value (empty if removed).
+ */
+void NODE::schedule_attribute_invalidation(const std::string &name, const std::string &old_value, const std::string &new_value)
+{
+    if (m_style_dirty)
+    {
+        return;
+    }
+
+    m_pending_attribute_changes.push_back({name, old_value, new_value});
+    flag_ancestors_style_dirty();
+}
+
 /**
  * \brief Retrieves an HTML attribute value by name.
  *
@@ -138,14 +310,23 @@ void NODE::set_attribute(const std::string &name, const std::string &value)
  */
 std::string NODE::get_attribute(const std::string &name) const
 {
-    try
-    {
-        return m_attributes.at(name);
-    }
-    catch (...)
+    auto it = m_attributes.find(name);
+    if (it == m_attributes.end())
     {
         return "";
     }
+    return it->second;
+}
+
+/**
+ * \brief Reports whether an HTML attribute is present on this node.
+ *
+ * \param name The attribute name to look up.
+ * \return True if the attribute exists.
+ */
+bool NODE::has_attribute(const std::string &name) const
+{
+    return m_attributes.find(name) != m_attributes.end();
 }
 
 /**
@@ -159,9 +340,10 @@ std::string NODE::get_attribute(const std::string &name) const
  */
 void NODE::set_style(const std::string &name, const std::string &value)
 {
-    if (m_computed_style.setters.count(name))
+    auto setter = COMPUTED_STYLE::setters.find(name);
+    if (setter != COMPUTED_STYLE::setters.end())
     {
-        m_computed_style.setters[name](m_computed_style, value);
+        setter->second(m_computed_style, value);
     }
 }
 
@@ -175,6 +357,290 @@ COMPUTED_STYLE NODE::get_all_styles() const
     return m_computed_style;
 }
 
+/**
+ * \brief Returns a reference to the computed style without copying it.
+ *
+ * The reference stays valid for the lifetime of the node. Used by the cascade
+ * to inherit from a parent that has already been styled.
+ *
+ * \return A const reference to this node's COMPUTED_STYLE.
+ */
+const COMPUTED_STYLE &NODE::get_computed_style() const
+{
+    return m_computed_style;
+}
+
+/**
+ * \brief Reports whether this node's computed style is current.
+ *
+ * Nodes inside a display:none subtree are never styled, so their
+ * COMPUTED_STYLE holds defaults (or values from an earlier pass) and
+ * must not be used for layout or paint.
+ *
+ * \return True if the cascade has computed a style for this node.
+ */
+bool NODE::is_style_resolved() const
+{
+    return m_style_resolved;
+}
+
+/**
+ * \brief Marks this node's computed style as current or stale.
+ *
+ * \param resolved True after the cascade has styled the node.
+ */
+void NODE::set_style_resolved(bool resolved)
+{
+    m_style_resolved = resolved;
+}
+
+/**
+ * \brief Resets the computed style to its initial values before a recascade.
+ */
+void NODE::reset_style()
+{
+    m_computed_style = COMPUTED_STYLE();
+}
+
+/**
+ * \brief Binds the computed style to its entry in the shared font cache.
+ */
+void NODE::resolve_font()
+{
+    m_computed_style.resolve_font();
+}
+
+/**
+ * \brief Converts the style's relative box lengths to pixels for this layout pass.
+ *
+ * \param basis The containing block, root font size and viewport.
+ * \return True if a length depended on the viewport or the root font size.
+ */
+bool NODE::resolve_lengths(const LENGTH_BASIS &basis)
+{
+    return m_computed_style.resolve_lengths(basis);
+}
+
+/**
+ * \brief Keeps the lengths layout resolved for the old style when no relayout follows.
+ *
+ * \param old_style The style the node was last laid out with.
+ */
+void NODE::keep_resolved_lengths(const COMPUTED_STYLE &old_style)
+{
+    m_computed_style.keep_resolved_lengths(old_style);
+}
+
+/**
+ * \brief Marks this node's subtree as needing a restyle.
+ *
+ * Sets the node's own bit and flags every ancestor as having a style-dirty
+ * descendant. Propagation stops at the first ancestor that is already
+ * flagged, since everything above it is flagged too.
+ */
+void NODE::mark_style_dirty()
+{
+    m_style_dirty = true;
+    flag_ancestors_style_dirty();
+}
+
+/**
+ * \brief Marks only this node as needing a restyle.
+ *
+ * Children are re-cascaded only if the node's inherited properties turn out
+ * to have changed, so a class that affects just this element costs one node.
+ */
+void NODE::mark_self_style_dirty()
+{
+    m_self_style_dirty = true;
+    flag_ancestors_style_dirty();
+}
+
+/**
+ * \brief Marks every child subtree as needing a restyle during a cascade.
+ *
+ * Only this node is flagged as having dirty descendants; ancestors are not
+ * touched because the cascade calling this is already walking through them.
+ */
+void NODE::mark_children_style_dirty()
+{
+    for (const auto &child : m_children)
+    {
+        child->m_style_dirty = true;
+    }
+
+    if (!m_children.empty())
+    {
+        m_descendant_style_dirty = true;
+    }
+}
+
+/**
+ * \brief Flags every ancestor as having a descendant that needs style work.
+ *
+ * Propagation stops at the first ancestor that is already flagged, since
+ * everything above it is flagged too.
+ */
+void NODE::flag_ancestors_style_dirty()
+{
+    for (auto parent = get_parent(); parent && !parent->m_descendant_style_dirty; parent = parent->get_parent())
+    {
+        parent->m_descendant_style_dirty = true;
+    }
+}
+
+/**
+ * \brief Marks this node's subtree as needing a relayout.
+ *
+ * Ancestors are flagged as having a layout-dirty descendant; they must be
+ * laid out again, but their other children are unaffected.
+ */
+void NODE::mark_layout_dirty()
+{
+    m_layout_dirty = true;
+
+    for (auto parent = get_parent(); parent && !parent->m_descendant_layout_dirty; parent = parent->get_parent())
+    {
+        parent->m_descendant_layout_dirty = true;
+    }
+}
+
+/**
+ * \brief Marks this node as needing a repaint with its new style.
+ *
+ * Used for style changes that leave every box where it is, so the renderer
+ * can refresh the box's style and repaint its rect without a relayout.
+ */
+void NODE::mark_paint_dirty()
+{
+    m_paint_dirty = true;
+
+    for (auto parent = get_parent(); parent && !parent->m_descendant_paint_dirty; parent = parent->get_parent())
+    {
+        parent->m_descendant_paint_dirty = true;
+    }
+}
+
+/**
+ * \brief Clears this node's own and descendant style-dirty bits and any
+ * queued invalidations.
+ */
+void NODE::clear_style_dirty()
+{
+    m_style_dirty = false;
+    m_self_style_dirty = false;
+    m_descendant_style_dirty = false;
+    clear_pending_invalidations();
+}
+
+/**
+ * \brief Clears this node's own and descendant layout-dirty bits.
+ */
+void NODE::clear_layout_dirty()
+{
+    m_layout_dirty = false;
+    m_descendant_layout_dirty = false;
+}
+
+/**
+ * \brief Clears this node's own and descendant paint-dirty bits.
+ */
+void NODE::clear_paint_dirty()
+{
+    m_paint_dirty = false;
+    m_descendant_paint_dirty = false;
+}
+
+/**
+ * \brief Reports whether this node's subtree must be restyled.
+ */
+bool NODE::is_style_dirty() const
+{
+    return m_style_dirty;
+}
+
+/**
+ * \brief Reports whether this node alone must be restyled.
+ */
+bool NODE::is_self_style_dirty() const
+{
+    return m_self_style_dirty;
+}
+
+/**
+ * \brief Reports whether the cascade has any work to do at or below this node.
+ */
+bool NODE::needs_style_update() const
+{
+    return m_style_dirty || m_self_style_dirty || m_descendant_style_dirty ||
+           m_children_changed || !m_pending_attribute_changes.empty();
+}
+
+/**
+ * \brief Reports whether children were inserted or removed since the last restyle.
+ */
+bool NODE::have_children_changed() const
+{
+    return m_children_changed;
+}
+
+/**
+ * \brief Returns the attribute changes queued since the last restyle.
+ */
+const std::vector<ATTRIBUTE_CHANGE> &NODE::get_pending_attribute_changes() const
+{
+    return m_pending_attribute_changes;
+}
+
+/**
+ * \brief Drops queued attribute changes and the children-changed flag.
+ */
+void NODE::clear_pending_invalidations()
+{
+    m_pending_attribute_changes.clear();
+    m_children_changed = false;
+}
+
+/**
+ * \brief Reports whether some descendant of this node must be restyled.
+ */
+bool NODE::has_style_dirty_descendant() const
+{
+    return m_descendant_style_dirty;
+}
+
+/**
+ * \brief Reports whether this node's subtree must be laid out again.
+ */
+bool NODE::is_layout_dirty() const
+{
+    return m_layout_dirty;
+}
+
+/**
+ * \brief Reports whether some descendant of this node must be laid out again.
+ */
+bool NODE::has_layout_dirty_descendant() const
+{
+    return m_descendant_layout_dirty;
+}
+
+/**
+ * \brief Reports whether this node must be repainted with a new style.
+ */
+bool NODE::is_paint_dirty() const
+{
+    return m_paint_dirty;
+}
+
+/**
+ * \brief Reports whether some descendant of this node must be repainted.
+ */
+bool NODE::has_paint_dirty_descendant() const
+{
+    return m_descendant_paint_dirty;
+}
+
 /**
  * \brief Sets the parent node reference.
  *
@@ -0,0 +1,219 @@
+#include "work_stealing_pool.h"
+#include <chrono>
+
+namespace
+{
+    thread_local const WORK_STEALING_POOL *current_pool = nullptr;
+    thread_local size_t current_worker_index = 0;
+}
+
+/**
+ * \brief Starts a pool of worker threads, each owning its own task deque.
+ *
+ * Workers pop from the back of their own deque (depth-first, cache friendly)
+ * and steal from the front of other workers' deques when they run dry, so the
+ * oldest and usually largest pieces of work migrate to idle threads.
+ *
+ * \param thread_count Number of worker threads. The thread calling wait()
+ *                     also executes tasks, so one fewer thread is spawned.
+ */
+WORK_STEALING_POOL::WORK_STEALING_POOL(size_t thread_count)
+{
+    size_t worker_count = thread_count > 1 ? thread_count - 1 : 1;
+
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        m_queues.push_back(std::make_unique<WORKER_QUEUE>());
+    }
+
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        m_threads.emplace_back([this, i]()
+                               { worker_loop(i); });
+    }
+}
+
+/**
+ * \brief Stops the workers after the queued tasks have drained and joins them.
+ */
+WORK_STEALING_POOL::~WORK_STEALING_POOL()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_stopping = true;
+    }
+    m_work_available.notify_all();
+
+    for (auto &thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+/**
+ * \brief Returns the process-wide pool shared by the style, layout and paint stages.
+ *
+ * \return A pool sized to the number of hardware threads.
+ */
+WORK_STEALING_POOL &WORK_STEALING_POOL::shared()
+{
+    static WORK_STEALING_POOL pool;
+    return pool;
+}
+
+/**
+ * \brief Queues a task for execution.
+ *
+ * Tasks submitted from a worker go to that worker's own deque; tasks submitted
+ * from any other thread are spread round-robin over the worker deques.
+ *
+ * \param task The work to run.
+ * \param group Optional group whose wait() will block until this task has run.
+ */
+void WORK_STEALING_POOL::submit(std::function<void()> task, TASK_GROUP *group)
+{
+    if (group)
+    {
+        group->pending.fetch_add(1);
+    }
+
+    size_t index = current_pool == this
+                       ? current_worker_index
+                       : m_next_queue.fetch_add(1) % m_queues.size();
+
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back({std::move(task), group});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_queued.fetch_add(1);
+    }
+    m_work_available.notify_one();
+}
+
+/**
+ * \brief Blocks until every task of a group has finished.
+ *
+ * The waiting thread does not sleep while work is queued: it steals and runs
+ * tasks itself, so nested waits from inside a task cannot deadlock the pool.
+ *
+ * \param group The group to wait for.
+ */
+void WORK_STEALING_POOL::wait(TASK_GROUP &group)
+{
+    size_t thief_index = current_pool == this ? current_worker_index : m_queues.size();
+
+    while (group.pending.load() > 0)
+    {
+        TASK task;
+        if ((thief_index < m_queues.size() && try_pop(thief_index, task)) || try_steal(thief_index, task))
+        {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_state_mutex);
+        m_group_done.wait_for(lock, std::chrono::milliseconds(1), [&]()
+                              { return group.pending.load() == 0 || m_queued.load() > 0; });
+    }
+}
+
+/**
+ * \brief Reports whether handing out more work would keep an idle worker busy.
+ *
+ * Used by producers that split work lazily: they keep processing locally
+ * and only spawn a task when some worker would otherwise sleep.
+ *
+ * \return True if idle workers outnumber queued tasks.
+ */
+bool WORK_STEALING_POOL::wants_work() const
+{
+    return m_idle.load() > m_queued.load();
+}
+
+/**
+ * \brief Returns the number of threads that execute tasks, including the waiter.
+ */
+size_t WORK_STEALING_POOL::thread_count() const
+{
+    return m_threads.size() + 1;
+}
+
+bool WORK_STEALING_POOL::try_pop(size_t index, TASK &task)
+{
+    std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+    auto &tasks = m_queues[index]->tasks;
+    if (tasks.empty())
+    {
+        return false;
+    }
+
+    task = std::move(tasks.back());
+    tasks.pop_back();
+    m_queued.fetch_sub(1);
+    return true;
+}
+
+bool WORK_STEALING_POOL::try_steal(size_t thief_index, TASK &task)
+{
+    size_t count = m_queues.size();
+    for (size_t offset = 1; offset <= count; ++offset)
+    {
+        size_t victim = (thief_index + offset) % count;
+        if (victim == thief_index)
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(m_queues[victim]->mutex);
+        auto &tasks = m_queues[victim]->tasks;
+        if (!tasks.empty())
+        {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WORK_STEALING_POOL::execute(TASK &task)
+{
+    task.run();
+
+    if (task.group && task.group->pending.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_group_done.notify_all();
+    }
+}
+
+void WORK_STEALING_POOL::worker_loop(size_t index)
+{
+    current_pool = this;
+    current_worker_index = index;
+
+    while (true)
+    {
+        TASK task;
+        if (try_pop(index, task) || try_steal(index, task))
+        {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_state_mutex);
+        m_idle.fetch_add(1);
+        m_work_available.wait(lock, [this]()
+                              { return m_stopping || m_queued.load() > 0; });
+        m_idle.fetch_sub(1);
+
+        if (m_stopping && m_queued.load() == 0)
+        {
+            return;
+        }
+    }
+}
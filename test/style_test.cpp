@@ -0,0 +1,1214 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include "html/html_parser.h"
+#include "html/html_tokenizer.h"
+#include "css/css_parser.h"
+#include "css/apply_style.h"
+#include "css/layout_tree.h"
+#include "css/display_list.h"
+#include "css/tile_cache.h"
+#include "css/animation.h"
+#include <QGuiApplication>
+
+int main(int argc, char *argv[])
+{
+    // Fonts need a GUI application; no display is required
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+
+    // Test 1: inheritance and class rules hold across a large, wide tree
+    // that is styled concurrently.
+    std::string html = "<div class=\"root\">";
+    for (int i = 0; i < 2000; ++i)
+    {
+        html += "<p><span class=\"hot\">hot</span><span>plain</span></p>";
+    }
+    html += "</div>";
+
+    auto tree = parse(tokenize(html));
+    CSSOM cssom = create_cssom(".root { color: red; font-style: italic; } .hot { color: blue; }");
+    apply_style(tree, cssom);
+
+    for (const auto &p : tree->get_children())
+    {
+        const auto &spans = p->get_children();
+        if (spans.size() != 2)
+        {
+            std::cerr << "Test 1 FAILED: unexpected tree shape" << std::endl;
+            return 1;
+        }
+
+        const COMPUTED_STYLE &hot = spans[0]->get_computed_style();
+        const COMPUTED_STYLE &plain = spans[1]->get_computed_style();
+
+        if (hot.color != QColor("blue") || plain.color != QColor("red"))
+        {
+            std::cerr << "Test 1 FAILED: color was not cascaded correctly" << std::endl;
+            return 1;
+        }
+
+        const COMPUTED_STYLE &text = spans[0]->get_children()[0]->get_computed_style();
+        if (hot.font_style != "italic" || plain.font_style != "italic" || text.color != QColor("blue"))
+        {
+            std::cerr << "Test 1 FAILED: inherited values did not reach descendants" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Test 1 PASSED" << std::endl;
+
+    // Test 2: display:none subtrees are not styled
+    auto tree2 = parse(tokenize("<div><head><style>p { color: red; }</style></head>"
+                                "<section class=\"hidden\"><p>secret</p></section><p>shown</p></div>"));
+    CSSOM cssom2 = create_cssom("head, style { display: none; } .hidden { display: none; } p { color: red; }");
+    apply_style(tree2, cssom2);
+
+    auto head = tree2->get_children()[0];
+    auto hidden = tree2->get_children()[1];
+    auto shown = tree2->get_children()[2];
+
+    if (!head->is_style_resolved() || !hidden->is_style_resolved() || !shown->is_style_resolved())
+    {
+        std::cerr << "Test 2 FAILED: visible nodes and hidden roots must be styled" << std::endl;
+        return 1;
+    }
+
+    if (head->get_children()[0]->is_style_resolved() || hidden->get_children()[0]->is_style_resolved() ||
+        hidden->get_children()[0]->get_children()[0]->is_style_resolved())
+    {
+        std::cerr << "Test 2 FAILED: descendants of display:none were styled" << std::endl;
+        return 1;
+    }
+
+    if (shown->get_computed_style().color != QColor("red"))
+    {
+        std::cerr << "Test 2 FAILED: visible sibling lost its style" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 2 PASSED" << std::endl;
+
+    // Test 3: mutations restyle only the dirty subtree
+    auto tree3 = parse(tokenize("<div><p class=\"a\">one</p><p>two</p></div>"));
+    CSSOM cssom3 = create_cssom(".a { color: red; } .b { color: blue; }");
+    apply_style(tree3, cssom3);
+
+    auto first = tree3->get_children()[0];
+    auto second = tree3->get_children()[1];
+
+    if (tree3->has_style_dirty_descendant() || first->is_style_dirty())
+    {
+        std::cerr << "Test 3 FAILED: full style pass left dirty bits" << std::endl;
+        return 1;
+    }
+
+    // A marker the cascade would overwrite if the clean node were restyled.
+    second->set_style("color", "green");
+    first->set_attribute("class", "b");
+
+    if (!first->needs_style_update() || !tree3->has_style_dirty_descendant())
+    {
+        std::cerr << "Test 3 FAILED: set_attribute did not propagate dirty bits" << std::endl;
+        return 1;
+    }
+
+    update_style(tree3, cssom3);
+
+    if (first->get_computed_style().color != QColor("blue") ||
+        first->get_children()[0]->get_computed_style().color != QColor("blue"))
+    {
+        std::cerr << "Test 3 FAILED: dirty subtree was not restyled" << std::endl;
+        return 1;
+    }
+
+    if (second->get_computed_style().color != QColor("green"))
+    {
+        std::cerr << "Test 3 FAILED: clean sibling was restyled" << std::endl;
+        return 1;
+    }
+
+    if (!first->is_layout_dirty() || !tree3->has_layout_dirty_descendant() || tree3->has_style_dirty_descendant())
+    {
+        std::cerr << "Test 3 FAILED: dirty bits not updated after restyle" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 3 PASSED" << std::endl;
+
+    // Test 4: invalidation sets limit which elements a change dirties
+    auto tree4 = parse(tokenize("<div><ul class=\"menu\"><li>a</li><li>b</li></ul><p>x</p><p>y</p></div>"));
+    CSSOM cssom4 = create_cssom(".menu li { color: red; } .on { color: blue; } .lead + p { color: green; } [hidden] { display: none; }");
+    apply_style(tree4, cssom4);
+
+    auto menu = tree4->get_children()[0];
+    auto lead = tree4->get_children()[1];
+    auto follower = tree4->get_children()[2];
+
+    if (menu->get_children()[0]->get_computed_style().color != QColor("red"))
+    {
+        std::cerr << "Test 4 FAILED: descendant combinator did not match" << std::endl;
+        return 1;
+    }
+
+    // A marker the cascade would overwrite if the node were restyled.
+    follower->set_style("font-style", "italic");
+
+    // Unused class: nothing is restyled.
+    lead->set_attribute("class", "unused");
+    update_style(tree4, cssom4);
+    if (follower->get_computed_style().font_style != "italic")
+    {
+        std::cerr << "Test 4 FAILED: unused class change restyled a sibling" << std::endl;
+        return 1;
+    }
+
+    // Subject-only class: the element is restyled, its sibling is not.
+    lead->set_attribute("class", "on");
+    update_style(tree4, cssom4);
+    if (lead->get_computed_style().color != QColor("blue") || follower->get_computed_style().font_style != "italic")
+    {
+        std::cerr << "Test 4 FAILED: subject class should restyle only the element" << std::endl;
+        return 1;
+    }
+
+    // Class before '+': the following sibling is restyled.
+    lead->set_attribute("class", "lead");
+    update_style(tree4, cssom4);
+    if (follower->get_computed_style().color != QColor("green"))
+    {
+        std::cerr << "Test 4 FAILED: sibling invalidation missed" << std::endl;
+        return 1;
+    }
+
+    // Class before ' ': descendants are restyled.
+    menu->remove_attribute("class");
+    update_style(tree4, cssom4);
+    if (menu->get_children()[0]->get_computed_style().color == QColor("red"))
+    {
+        std::cerr << "Test 4 FAILED: descendant invalidation missed" << std::endl;
+        return 1;
+    }
+
+    // Attribute selector toggles display.
+    menu->set_attribute("hidden", "hidden");
+    update_style(tree4, cssom4);
+    if (menu->get_computed_style().display != DISPLAY_TYPE::NONE || menu->get_children()[0]->is_style_resolved())
+    {
+        std::cerr << "Test 4 FAILED: attribute invalidation missed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 4 PASSED" << std::endl;
+
+    // Test 5: style changes are classified as paint-only, layout or none
+    auto tree5 = parse(tokenize("<div><p>one</p><p>two</p></div>"));
+    CSSOM cssom5 = create_cssom("div, p { display: block; } .hot { color: red; } .big { font-weight: bold; } .same { }");
+    apply_style(tree5, cssom5);
+    LAYOUT_TREE layout5;
+    LAYOUT_CONTEXT context5{layout5};
+    LINE_STATE line5(800);
+    create_layout_tree(tree5.get(), 800, line5, context5);
+
+    auto para = tree5->get_children()[0];
+    auto text = para->get_children()[0];
+
+    para->set_attribute("class", "same");
+    update_style(tree5, cssom5);
+    if (para->is_paint_dirty() || tree5->has_layout_dirty_descendant())
+    {
+        std::cerr << "Test 5 FAILED: unchanged style was marked dirty" << std::endl;
+        return 1;
+    }
+
+    para->set_attribute("class", "hot");
+    update_style(tree5, cssom5);
+    if (!para->is_paint_dirty() || !text->is_paint_dirty() || !tree5->has_paint_dirty_descendant() ||
+        tree5->has_layout_dirty_descendant() || para->is_layout_dirty())
+    {
+        std::cerr << "Test 5 FAILED: color change should only need a repaint" << std::endl;
+        return 1;
+    }
+
+    para->set_attribute("class", "big");
+    update_style(tree5, cssom5);
+    if (!para->is_layout_dirty() || !text->is_layout_dirty() || !tree5->has_layout_dirty_descendant())
+    {
+        std::cerr << "Test 5 FAILED: font-weight change should need a relayout" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 5 PASSED" << std::endl;
+
+    // Test 6: styles with the same font description share one cache entry
+    auto tree6 = parse(tokenize("<div><p>a</p><p>b</p><h1>c</h1></div>"));
+    CSSOM cssom6 = create_cssom("h1 { font-size: 32px; }");
+    apply_style(tree6, cssom6);
+
+    const COMPUTED_STYLE &style_a = tree6->get_children()[0]->get_computed_style();
+    const COMPUTED_STYLE &style_b = tree6->get_children()[1]->get_computed_style();
+    const COMPUTED_STYLE &style_h1 = tree6->get_children()[2]->get_computed_style();
+
+    if (style_a.font_id < 0 || style_a.font_id != style_b.font_id || style_a.font_id == style_h1.font_id ||
+        &style_a.font() != &style_b.font() || style_h1.font().font.pixelSize() != 32)
+    {
+        std::cerr << "Test 6 FAILED: font cache entries were not shared" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 6 PASSED" << std::endl;
+
+    // Test 7: repeated words are measured once per font
+    auto tree7 = parse(tokenize("<div><p>the cat and the dog and the bird</p></div>"));
+    CSSOM cssom7 = create_cssom("div, p { display: block; } p { font-weight: bold; font-style: italic; }");
+    apply_style(tree7, cssom7);
+
+    const FONT_ENTRY &font7 = tree7->get_children()[0]->get_children()[0]->get_computed_style().font();
+    font7.word_widths.clear();
+
+    LAYOUT_TREE layout7;
+    LAYOUT_CONTEXT context7{layout7};
+    LINE_STATE line7(800);
+    create_layout_tree(tree7.get(), 800, line7, context7);
+    WORD_WIDTH_STATS first_pass = font7.word_widths.stats();
+
+    layout7.clear();
+    LINE_STATE relayout7(400);
+    create_layout_tree(tree7.get(), 400, relayout7, context7);
+    WORD_WIDTH_STATS second_pass = font7.word_widths.stats();
+
+    // 6 distinct tokens: the, cat, and, dog, bird, " "
+    if (first_pass.misses != 6 || first_pass.hits != 9 || second_pass.misses != 6 || second_pass.hits != 24 ||
+        font7.word_width(QString("cat")) != measure_word(QString("cat"), font7.thread_font()))
+    {
+        std::cerr << "Test 7 FAILED: word widths were not cached" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 7 PASSED" << std::endl;
+
+    // Test 8: text is laid out as one fragment per line, in reusable storage
+    auto tree8 = parse(tokenize("<div><p>aaaa bbbb cccc</p></div>"));
+    CSSOM cssom8 = create_cssom("div, p { display: block; }");
+    apply_style(tree8, cssom8);
+
+    // Text boxes own a contiguous range of the tree's fragments
+    auto text_fragments = [](const LAYOUT_TREE &layout) {
+        std::vector<TEXT_FRAGMENT> fragments;
+        for (const auto &box : layout.boxes)
+        {
+            for (size_t i = 0; i < box.fragment_count; ++i)
+            {
+                fragments.push_back(layout.fragments[box.first_fragment + i]);
+            }
+        }
+        return fragments;
+    };
+
+    LAYOUT_TREE layout8;
+    LAYOUT_CONTEXT context8{layout8};
+
+    LINE_STATE wide_line(800);
+    create_layout_tree(tree8.get(), 800, wide_line, context8);
+    std::vector<TEXT_FRAGMENT> wide = text_fragments(layout8);
+    size_t box_capacity = layout8.boxes.capacity();
+    size_t box_count = layout8.boxes.size();
+
+    layout8.clear();
+    LINE_STATE narrow_line(1);
+    create_layout_tree(tree8.get(), 1, narrow_line, context8);
+    std::vector<TEXT_FRAGMENT> narrow = text_fragments(layout8);
+
+    if (wide.size() != 1 || wide[0].offset != 0 || wide[0].length != 14)
+    {
+        std::cerr << "Test 8 FAILED: a single line should be a single fragment" << std::endl;
+        return 1;
+    }
+
+    if (layout8.boxes.size() != box_count || layout8.boxes.capacity() != box_capacity)
+    {
+        std::cerr << "Test 8 FAILED: relayout did not reuse the tree's storage" << std::endl;
+        return 1;
+    }
+
+    size_t covered = 0;
+    for (size_t i = 0; i < narrow.size(); ++i)
+    {
+        const TEXT_FRAGMENT &fragment = narrow[i];
+        if (fragment.offset != covered || (i > 0 && fragment.y <= narrow[i - 1].y))
+        {
+            std::cerr << "Test 8 FAILED: wrapped fragments are out of order" << std::endl;
+            return 1;
+        }
+        covered += fragment.length;
+    }
+
+    if (narrow.size() != 5 || covered != 14)
+    {
+        std::cerr << "Test 8 FAILED: every wrapped word should start a new fragment" << std::endl;
+        return 1;
+    }
+
+    // Each line is shaped at layout into one glyph per character. Lines
+    // holding only a space are left out, as trailing whitespace may not be
+    // shaped; the text is ASCII, so its UTF-16 offsets are byte offsets
+    std::vector<const TEXT_FRAGMENT *> lines8{&wide[0]};
+    for (const TEXT_FRAGMENT &fragment : narrow)
+    {
+        if (std::string("aaaa bbbb cccc").substr(fragment.offset, fragment.length) != " ")
+        {
+            lines8.push_back(&fragment);
+        }
+    }
+
+    for (const TEXT_FRAGMENT *fragment : lines8)
+    {
+        qsizetype glyphs = 0;
+        for (const QGlyphRun &run : fragment->glyph_runs)
+        {
+            glyphs += run.glyphIndexes().size();
+        }
+        if (fragment->glyph_runs.isEmpty() || glyphs != static_cast<qsizetype>(fragment->length) ||
+            fragment->glyph_run_fonts.size() != static_cast<size_t>(fragment->glyph_runs.size()))
+        {
+            std::cerr << "Test 8 FAILED: a line was not shaped into glyph runs" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Test 8 PASSED" << std::endl;
+
+    // Test 9: overflow is accumulated bottom-up during layout
+    auto tree9 = parse(tokenize("<div><p>text</p><p class=\"wide\">x</p></div>"));
+    CSSOM cssom9 = create_cssom("div, p { display: block; } "
+                                ".wide { position: absolute; width: 2000px; height: 10px; left: 50px; top: 300px; }");
+    apply_style(tree9, cssom9);
+
+    LAYOUT_TREE layout9;
+    LAYOUT_CONTEXT context9{layout9};
+    LINE_STATE line9(800);
+    create_layout_tree(tree9.get(), 800, line9, context9);
+
+    const LAYOUT_BOX &root9 = layout9.boxes[0];
+    if (root9.overflow.right() < 2050 || root9.overflow.bottom() < 310 || root9.height >= 300)
+    {
+        std::cerr << "Test 9 FAILED: root overflow does not cover positioned content" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 9 PASSED" << std::endl;
+
+    // Test 10: clean blocks are copied from the previous layout pass
+    auto tree10 = parse(tokenize("<div><p>first block</p><p>second block</p></div>"));
+    CSSOM cssom10 = create_cssom("div, p { display: block; padding: 4px; }");
+    apply_style(tree10, cssom10);
+
+    LAYOUT_TREE first10, second10, third10, fresh10;
+    LAYOUT_CACHE first_cache10, second_cache10, third_cache10;
+
+    LAYOUT_CONTEXT context10a{first10};
+    context10a.cache = &first_cache10;
+    LINE_STATE line10a(800);
+    create_layout_tree(tree10.get(), 800, line10a, context10a);
+
+    LAYOUT_CONTEXT context10b{second10};
+    context10b.previous_tree = &first10;
+    context10b.previous_cache = &first_cache10;
+    context10b.cache = &second_cache10;
+    LINE_STATE line10b(800);
+    create_layout_tree(tree10.get(), 800, line10b, context10b);
+
+    if (context10b.reused_boxes == 0 || second10.boxes.size() != first10.boxes.size())
+    {
+        std::cerr << "Test 10 FAILED: clean relayout did not reuse the previous pass" << std::endl;
+        return 1;
+    }
+
+    // Reused fragments keep the glyph runs shaped by the previous pass
+    bool kept10 = second10.fragments.size() == first10.fragments.size();
+    for (size_t i = 0; kept10 && i < second10.fragments.size(); ++i)
+    {
+        const QList<QGlyphRun> &before = first10.fragments[i].glyph_runs;
+        const QList<QGlyphRun> &after = second10.fragments[i].glyph_runs;
+        kept10 = !after.isEmpty() && after.size() == before.size();
+        for (qsizetype run = 0; kept10 && run < after.size(); ++run)
+        {
+            kept10 = after[run].glyphIndexes() == before[run].glyphIndexes() &&
+                     after[run].positions() == before[run].positions();
+        }
+    }
+
+    if (!kept10)
+    {
+        std::cerr << "Test 10 FAILED: reused fragments lost their glyph runs" << std::endl;
+        return 1;
+    }
+
+    std::function<NODE *(NODE *)> find_second10 = [&](NODE *node) -> NODE *
+    {
+        if (node->get_type() == NODE_TYPE::TEXT && node->get_text_content() == "second block")
+        {
+            return node;
+        }
+        for (const auto &child : node->get_children())
+        {
+            if (NODE *found = find_second10(child.get()))
+            {
+                return found;
+            }
+        }
+        return nullptr;
+    };
+    find_second10(tree10.get())->set_text_content("second block, now considerably longer");
+
+    LAYOUT_CONTEXT context10c{third10};
+    context10c.previous_tree = &second10;
+    context10c.previous_cache = &second_cache10;
+    context10c.cache = &third_cache10;
+    LINE_STATE line10c(800);
+    create_layout_tree(tree10.get(), 800, line10c, context10c);
+
+    LAYOUT_CONTEXT context10d{fresh10};
+    LINE_STATE line10d(800);
+    create_layout_tree(tree10.get(), 800, line10d, context10d);
+
+    bool same10 = third10.boxes.size() == fresh10.boxes.size() && third10.fragments.size() == fresh10.fragments.size();
+    for (size_t i = 0; same10 && i < third10.boxes.size(); ++i)
+    {
+        const LAYOUT_BOX &a = third10.boxes[i];
+        const LAYOUT_BOX &b = fresh10.boxes[i];
+        same10 = a.node == b.node && a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height &&
+                 a.parent == b.parent && a.next_sibling == b.next_sibling && a.first_fragment == b.first_fragment;
+    }
+
+    if (context10c.reused_boxes == 0 || context10c.reused_boxes >= third10.boxes.size() || !same10)
+    {
+        std::cerr << "Test 10 FAILED: partial relayout differs from a full layout" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 10 PASSED" << std::endl;
+
+    // Test 11: words measured by the parallel prepass break lines exactly
+    // like words measured during layout
+    std::string html11 = "<div>";
+    for (int i = 0; i < 500; ++i)
+    {
+        html11 += "<p>paragraph " + std::to_string(i) + " with a few words <em>wrapped</em> at narrow widths</p>";
+    }
+    html11 += "</div>";
+
+    auto tree11 = parse(tokenize(html11));
+    CSSOM cssom11 = create_cssom("div, p { display: block; } em { font-style: italic; }");
+    apply_style(tree11, cssom11);
+
+    TEXT_MEASUREMENTS measurements11;
+    measure_text(tree11.get(), 120, nullptr, measurements11);
+
+    LAYOUT_TREE measured11, direct11;
+    LAYOUT_CACHE cache11;
+    LAYOUT_CONTEXT context11a{measured11};
+    context11a.measurements = &measurements11;
+    context11a.cache = &cache11;
+    LINE_STATE line11a(120);
+    create_layout_tree(tree11.get(), 120, line11a, context11a);
+
+    LAYOUT_CONTEXT context11b{direct11};
+    LINE_STATE line11b(120);
+    create_layout_tree(tree11.get(), 120, line11b, context11b);
+
+    bool same11 = measurements11.word_widths.size() >= 1000 && measured11.fragments.size() == direct11.fragments.size();
+    for (size_t i = 0; same11 && i < measured11.fragments.size(); ++i)
+    {
+        const TEXT_FRAGMENT &a = measured11.fragments[i];
+        const TEXT_FRAGMENT &b = direct11.fragments[i];
+        same11 = a.offset == b.offset && a.length == b.length && a.x == b.x && a.y == b.y && a.width == b.width;
+    }
+
+    // Cached blocks are skipped at the same width, but not after a resize,
+    // since they would be laid out again
+    measure_text(tree11.get(), 120, &cache11, measurements11);
+    same11 = same11 && measurements11.word_widths.empty();
+    measure_text(tree11.get(), 200, &cache11, measurements11);
+    same11 = same11 && measurements11.word_widths.size() >= 1000;
+
+    if (!same11)
+    {
+        std::cerr << "Test 11 FAILED: prepass widths change line breaking" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 11 PASSED" << std::endl;
+
+    // Test 12: virtualized layout builds boxes for the viewport only and
+    // lays out what it covers exactly like a full layout
+    LAYOUT_TREE full12, virtual12;
+    LAYOUT_CONTEXT context12a{full12};
+    LINE_STATE line12a(400);
+    create_layout_tree(tree11.get(), 400, line12a, context12a);
+
+    LAYOUT_VIEWPORT viewport12{0, 300};
+    BLOCK_HEIGHTS heights12;
+    LAYOUT_CONTEXT context12b{virtual12};
+    context12b.viewport = &viewport12;
+    context12b.block_heights = &heights12;
+    LINE_STATE line12b(400);
+    create_layout_tree(tree11.get(), 400, line12b, context12b);
+
+    bool prefix12 = context12b.estimated_boxes > 0 && virtual12.boxes.size() * 10 < full12.boxes.size();
+    for (size_t i = 0; prefix12 && i < virtual12.fragments.size(); ++i)
+    {
+        const TEXT_FRAGMENT &a = virtual12.fragments[i];
+        const TEXT_FRAGMENT &b = full12.fragments[i];
+        prefix12 = a.offset == b.offset && a.x == b.x && a.y == b.y && a.width == b.width;
+    }
+
+    float full_height12 = full12.boxes[0].height;
+    float virtual_height12 = virtual12.boxes[0].height;
+    if (!prefix12 || virtual_height12 < full_height12 * 0.5f || virtual_height12 > full_height12 * 2.0f)
+    {
+        std::cerr << "Test 12 FAILED: virtualized layout differs in the viewport or misestimates the rest" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 12 PASSED" << std::endl;
+
+    // Test 13: a million levels of nesting are parsed, styled, laid out and
+    // destroyed without exhausting the call stack
+    {
+        const int depth13 = 1000000;
+        std::string html13;
+        html13.reserve(depth13 * 5 + 16);
+        for (int i = 0; i < depth13; ++i)
+        {
+            html13 += "<div>";
+        }
+        html13 += "deep";
+
+        auto tree13 = parse(tokenize(html13));
+        html13.clear();
+        apply_style(tree13, create_cssom("div { display: block; padding-left: 1px; }"));
+
+        LAYOUT_TREE layout13;
+        LAYOUT_CONTEXT context13{layout13};
+        LINE_STATE line13(800);
+        create_layout_tree(tree13.get(), 800, line13, context13);
+
+        if (layout13.boxes.size() != depth13 + 1 || layout13.fragments.size() != 1 ||
+            layout13.boxes.back().node->get_text_content() != "deep")
+        {
+            std::cerr << "Test 13 FAILED: deep nesting was not laid out" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Test 13 PASSED" << std::endl;
+
+    // Test 14: relative lengths survive the cascade and are resolved at layout
+    auto tree14 = parse(tokenize("<div class=\"outer\"><div class=\"inner\">text</div></div>"));
+    apply_style(tree14, create_cssom(
+                            ".outer { display: block; font-size: 20px; width: 50%; padding: 1em 0; }"
+                            ".inner { display: block; font-size: 150%; width: 10vw; margin-left: 2rem; }"));
+
+    LAYOUT_TREE first14, second14, third14;
+    LAYOUT_CACHE first_cache14, second_cache14, third_cache14;
+    auto layout14 = [&](LAYOUT_TREE &tree, LAYOUT_CACHE &cache, const LAYOUT_TREE *previous_tree,
+                        const LAYOUT_CACHE *previous_cache, float width, float viewport_width)
+    {
+        LAYOUT_CONTEXT context{tree};
+        context.previous_tree = previous_tree;
+        context.previous_cache = previous_cache;
+        context.cache = &cache;
+        context.viewport_width = viewport_width;
+        context.viewport_height = 600;
+        LINE_STATE line(width);
+        create_layout_tree(tree14.get(), width, line, context);
+    };
+    auto find_box14 = [](const LAYOUT_TREE &tree, int font_size) -> const LAYOUT_BOX *
+    {
+        for (const LAYOUT_BOX &box : tree.boxes)
+        {
+            if (box.node->get_type() == NODE_TYPE::ELEMENT && box.style->font_size == font_size)
+            {
+                return &box;
+            }
+        }
+        return nullptr;
+    };
+
+    layout14(first14, first_cache14, nullptr, nullptr, 800, 1000);
+    const LAYOUT_BOX *outer14 = find_box14(first14, 20);
+    const LAYOUT_BOX *inner14 = find_box14(first14, 30);
+    bool first_ok14 = outer14 && inner14 && outer14->width == 400 && outer14->style->padding_top == 20 &&
+                      inner14->width == 100 && inner14->x == 32;
+
+    // Same width, other viewport: the vw length must not come from the cache
+    layout14(second14, second_cache14, &first14, &first_cache14, 800, 500);
+    const LAYOUT_BOX *inner14b = find_box14(second14, 30);
+
+    // A resize re-resolves the percentage without a new cascade
+    layout14(third14, third_cache14, &second14, &second_cache14, 600, 500);
+    const LAYOUT_BOX *outer14c = find_box14(third14, 20);
+
+    COMPUTED_STYLE unresolved14 = *outer14c->style;
+    unresolved14.width = -1;
+    unresolved14.padding_top = 0;
+
+    if (!first_ok14 || !inner14b || inner14b->width != 50 || !outer14c || outer14c->width != 300 ||
+        COMPUTED_STYLE::diff(*outer14c->style, unresolved14) != STYLE_CHANGE::None)
+    {
+        std::cerr << "Test 14 FAILED: relative lengths were not resolved at layout" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 14 PASSED" << std::endl;
+
+    // Test 15: @media rules toggle with the viewport, and only elements
+    // matched by toggled rules are restyled
+    auto tree15 = parse(tokenize("<body><div class=\"box\">box</div><p>paragraph</p></body>"));
+    CSSOM cssom15 = create_cssom(
+        "@import url(print.css);"
+        ".box { display: block; color: red; }"
+        "@media screen and (max-width: 600px) { .box { color: blue; } }"
+        "@font-face { font-family: x; src: url(x.woff); }"
+        "p { display: block; color: green; }");
+    cssom15.update_media(1000, 800);
+    apply_style(tree15, cssom15);
+
+    std::function<NODE *(NODE *, const std::string &)> find_tag15 = [&](NODE *node, const std::string &tag) -> NODE *
+    {
+        if (node->get_tag_name() == tag)
+        {
+            return node;
+        }
+        for (const auto &child : node->get_children())
+        {
+            if (NODE *found = find_tag15(child.get(), tag))
+            {
+                return found;
+            }
+        }
+        return nullptr;
+    };
+    NODE *box15 = find_tag15(tree15.get(), "div");
+    NODE *p15 = find_tag15(tree15.get(), "p");
+    bool wide15 = cssom15.get_rules().size() == 3 && box15->get_computed_style().color == QColor("red") &&
+                  p15->get_computed_style().color == QColor("green");
+
+    bool no_breakpoint15 = cssom15.update_media(1200, 900).empty();
+
+    std::vector<size_t> toggled15 = cssom15.update_media(500, 900);
+    invalidate_media_rules(tree15, cssom15, toggled15);
+    update_style(tree15, cssom15);
+    bool narrow15 = toggled15.size() == 1 && box15->get_computed_style().color == QColor("blue") &&
+                    box15->is_paint_dirty() && !p15->is_paint_dirty();
+
+    MEDIA_CONDITION portrait15 = parse_media_condition("print, screen and (orientation: portrait) and (min-width: 20em)");
+    bool conditions15 = media_condition_matches(portrait15, 400, 800) && !media_condition_matches(portrait15, 800, 400) &&
+                        !media_condition_matches(portrait15, 300, 800) &&
+                        media_condition_matches(parse_media_condition("not print"), 800, 400);
+
+    if (!wide15 || !no_breakpoint15 || !narrow15 || !conditions15)
+    {
+        std::cerr << "Test 15 FAILED: media queries did not follow the viewport" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 15 PASSED" << std::endl;
+
+    // Test 16: the display list holds the painted items in paint order, and
+    // a query returns only those crossing the repainted area
+    std::string html16 = "<div>";
+    for (int i = 0; i < 2000; ++i)
+    {
+        html16 += "<p>line " + std::to_string(i) + "</p>";
+    }
+    html16 += "<span class=\"pinned\">pinned</span></div>";
+    auto tree16 = parse(tokenize(html16));
+    apply_style(tree16, create_cssom("div, p { display: block; } p { background-color: #eeeeee; }"
+                                     ".pinned { position: fixed; top: 0; border-width: 1px; }"));
+
+    LAYOUT_TREE layout16;
+    LAYOUT_CONTEXT context16{layout16};
+    LINE_STATE line16(800);
+    create_layout_tree(tree16.get(), 800, line16, context16);
+
+    DISPLAY_LIST list16;
+    build_display_list(layout16, list16);
+
+    size_t backgrounds16 = 0, texts16 = 0;
+    for (const DISPLAY_ITEM &item : list16.items)
+    {
+        backgrounds16 += item.type == DISPLAY_ITEM_TYPE::Background;
+        texts16 += item.type == DISPLAY_ITEM_TYPE::Text;
+    }
+
+    // Each paragraph's background is painted right before its text
+    bool order16 = list16.items.size() > 4000 && list16.items[0].type == DISPLAY_ITEM_TYPE::Background &&
+                   list16.items[1].type == DISPLAY_ITEM_TYPE::Text && list16.items[0].box < list16.items[1].box;
+
+    QRectF screen16(0, 10000, 800, 600);
+    std::vector<size_t> visible16;
+    list16.query(screen16, visible16);
+
+    bool culled16 = !visible16.empty() && visible16.size() < 200 &&
+                    std::is_sorted(visible16.begin(), visible16.end());
+    for (size_t index : visible16)
+    {
+        culled16 = culled16 && list16.items[index].bounds.intersects(screen16) && list16.items[index].fixed_root < 0;
+    }
+
+    bool fixed16 = list16.fixed_items.size() == 2 && list16.items[list16.fixed_items[0]].bounds.top() < 5;
+
+    if (backgrounds16 != 2000 || texts16 != 2001 || !order16 || !culled16 || !fixed16)
+    {
+        std::cerr << "Test 16 FAILED: display list is incomplete or not culled" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 16 PASSED" << std::endl;
+
+    // Test 17: tiles are rendered from the display list, evicted least
+    // recently used first, and out-of-date renders are dropped after damage
+    QImage tile17 = render_tile(list16, layout16, TILE_CACHE::tile_rect(0, 40));
+    bool rendered17 = tile17.width() == TILE_SIZE && tile17.height() == TILE_SIZE;
+    size_t tile_bytes17 = static_cast<size_t>(tile17.sizeInBytes());
+
+    TILE_CACHE cache17(tile_bytes17 * 3);
+    for (int row = 0; row < 3; ++row)
+    {
+        cache17.store(0, row, cache17.schedule(0, row), tile17);
+    }
+    cache17.find(0, 0); // row 1 becomes the least recently used
+    cache17.store(0, 3, cache17.schedule(0, 3), tile17);
+    bool evicted17 = cache17.size() == 3 && cache17.bytes() == tile_bytes17 * 3 && !cache17.find(0, 1) &&
+                     cache17.find(0, 0) && cache17.find(0, 3);
+
+    // A pending tile survives eviction even over budget
+    uint64_t pending_version17 = cache17.schedule(0, 4);
+    cache17.store(0, 5, cache17.schedule(0, 5), tile17);
+    bool pinned17 = cache17.find(0, 4) && cache17.find(0, 4)->pending;
+
+    // Damage during the render makes its result stale; the old image stays shown
+    cache17.invalidate(QRectF(0, 4 * TILE_SIZE + 10, 50, 50));
+    bool stale17 = !cache17.store(0, 4, pending_version17, tile17) && !cache17.find(0, 4)->pending;
+
+    uint64_t redo_version17 = cache17.schedule(0, 5);
+    cache17.invalidate(QRectF(0, 5 * TILE_SIZE, 10, 10));
+    TILE *kept17 = cache17.find(0, 5);
+    bool kept_image17 = kept17 && !kept17->is_ready() && !kept17->image.isNull() &&
+                        !cache17.store(0, 5, redo_version17, tile17);
+    bool redone17 = cache17.store(0, 5, cache17.schedule(0, 5), tile17) && cache17.find(0, 5)->is_ready();
+
+    if (!rendered17 || !evicted17 || !pinned17 || !stale17 || !kept_image17 || !redone17)
+    {
+        std::cerr << "Test 17 FAILED: tile cache eviction or invalidation is wrong" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 17 PASSED" << std::endl;
+
+    // Test 18: hit testing finds the topmost box through the grid, with
+    // positioned boxes over in-flow ones and fixed boxes over everything
+    auto tree18 = parse(tokenize("<div class=\"page\"><p>link text</p><div class=\"over\">over</div>"
+                                 "<span class=\"pinned\">pinned</span></div>"));
+    apply_style(tree18, create_cssom(".page, p, .over { display: block; } .page { height: 3000px; }"
+                                     "p { height: 200px; margin: 0; }"
+                                     ".over { position: absolute; top: 100px; left: 0; width: 300px; height: 50px; }"
+                                     ".pinned { display: block; position: fixed; top: 0; left: 0; width: 100px; height: 30px; }"));
+
+    LAYOUT_TREE layout18;
+    LAYOUT_CONTEXT context18{layout18};
+    LINE_STATE line18(800);
+    create_layout_tree(tree18.get(), 800, line18, context18);
+
+    DISPLAY_LIST list18;
+    build_display_list(layout18, list18);
+
+    auto fixed_origin18 = [](int) { return QPointF(500, 2000); };
+    auto hit_node18 = [&](float x, float y) -> NODE * {
+        int index = list18.hit_test(QPointF(x, y), fixed_origin18);
+        return index >= 0 ? layout18.boxes[index].node : nullptr;
+    };
+    auto inside18 = [](NODE *node, const std::string &tag, const std::string &class_name) {
+        for (; node; node = node->get_parent().get())
+        {
+            if (node->get_tag_name() == tag && (class_name.empty() || node->get_attribute("class") == class_name))
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    NODE *text18 = hit_node18(5, 5);
+    NODE *paragraph18 = hit_node18(400, 50);
+    NODE *over18 = hit_node18(5, 120);
+    NODE *pinned18 = hit_node18(505, 2005);
+    NODE *page18 = hit_node18(5, 2500);
+
+    bool hits18 = text18 && text18->get_type() == NODE_TYPE::TEXT && inside18(text18, "p", "") &&
+                  paragraph18 && paragraph18->get_tag_name() == "p" &&
+                  inside18(over18, "div", "over") && inside18(pinned18, "span", "pinned") &&
+                  page18 && page18->get_attribute("class") == "page" && !hit_node18(5, 5000);
+
+    if (!hits18)
+    {
+        std::cerr << "Test 18 FAILED: hit testing missed the topmost box" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 18 PASSED" << std::endl;
+
+    // Test 19: fixed boxes and translucent subtrees become layers holding a
+    // contiguous range of items; fixed layers are composited with the outer opacity
+    auto tree19 = parse(tokenize("<div class=\"faded\"><p>first</p><div class=\"inner\"><p>second</p></div>"
+                                 "<div class=\"bar\">bar</div></div>"));
+    apply_style(tree19, create_cssom("div, p { display: block; } .faded { opacity: 0.5; }"
+                                     ".inner { opacity: 0.5; background-color: #ff0000; }"
+                                     ".bar { position: fixed; top: 0; left: 0; width: 200px; height: 40px;"
+                                     " background-color: #0000ff; opacity: 0.5; }"));
+
+    LAYOUT_TREE layout19;
+    LAYOUT_CONTEXT context19{layout19};
+    LINE_STATE line19(800);
+    create_layout_tree(tree19.get(), 800, line19, context19);
+
+    DISPLAY_LIST list19;
+    build_display_list(layout19, list19);
+
+    bool layers19 = list19.layers.size() == 3 && list19.composited_layers.size() == 1;
+    if (layers19)
+    {
+        const DISPLAY_LAYER &faded19 = list19.layers[0];
+        const DISPLAY_LAYER &inner19 = list19.layers[1];
+        const DISPLAY_LAYER &bar19 = list19.layers[2];
+
+        layers19 = faded19.parent == -1 && inner19.parent == 0 && bar19.parent == -1 &&
+                   list19.composited_layers[0] == 2 && bar19.opacity * bar19.outer_opacity == 0.25f &&
+                   faded19.first_item <= inner19.first_item && inner19.end_item <= faded19.end_item &&
+                   inner19.end_item > inner19.first_item && bar19.end_item - bar19.first_item == 2 &&
+                   faded19.bounds.contains(inner19.bounds.topLeft());
+
+        for (size_t i = inner19.first_item; i < inner19.end_item; ++i)
+        {
+            layers19 = layers19 && list19.items[i].layer == 1;
+        }
+
+        QImage bar_image19 = render_layer(list19, layout19, 2);
+        QImage tile19 = render_tile(list19, layout19, TILE_CACHE::tile_rect(0, 0));
+        layers19 = layers19 && bar_image19.width() >= 200 && bar_image19.height() >= 40 &&
+                   tile19.width() == TILE_SIZE;
+
+        // A layer too large for one image is rasterized only where it is needed
+        DISPLAY_LAYER huge19 = bar19;
+        huge19.bounds = QRectF(0, 0, 4000, 100000);
+        QRect clip19(0, 50000, 800, 600);
+        layers19 = layers19 && layer_image_rect(huge19, clip19) == clip19 &&
+                   layer_image_rect(bar19, clip19) == bar19.bounds.toAlignedRect();
+    }
+
+    if (!layers19)
+    {
+        std::cerr << "Test 19 FAILED: compositing layers are wrong" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 19 PASSED" << std::endl;
+
+    // Test 20: transitions and @keyframes animations of opacity and transform
+    // run on composited layers, sampled without restyling
+    std::vector<TRANSITION> transitions20 = COMPUTED_STYLE::parse_transitions("opacity 200ms ease-in, transform 1s 50ms");
+    TRANSFORM transform20 = COMPUTED_STYLE::parse_transform("translate(10px, 20px) rotate(90deg)");
+    bool parsed20 = transitions20.size() == 2 && transitions20[0].property == "opacity" &&
+                    transitions20[0].duration == 200 && transitions20[1].delay == 50 &&
+                    transform20.translate_x == 10 && transform20.translate_y == 20 && transform20.rotate == 90;
+
+    auto tree20 = parse(tokenize("<div><div class=\"box\">fade</div><div class=\"spin\">spin</div><div>still</div>"
+                                 "<div class=\"any\">any</div></div>"));
+    CSSOM cssom20 = create_cssom("div { display: block; height: 50px; }"
+                                 ".box { transition: opacity 100ms linear; }"
+                                 ".any { transition: all 100ms; }"
+                                 ".spin { animation: spin 1s linear infinite; }"
+                                 "@keyframes spin { from { transform: rotate(0deg); } to { transform: rotate(360deg); } }");
+    apply_style(tree20, cssom20);
+
+    LAYOUT_TREE layout20;
+    LAYOUT_CONTEXT context20{layout20};
+    LINE_STATE line20(800);
+    create_layout_tree(tree20.get(), 800, line20, context20);
+
+    DISPLAY_LIST list20;
+    build_display_list(layout20, list20);
+
+    NODE *box20 = nullptr;
+    NODE *spin20 = nullptr;
+    for (const LAYOUT_BOX &box : layout20.boxes)
+    {
+        if (box.node->get_attribute("class") == "box")
+            box20 = box.node;
+        else if (box.node->get_attribute("class") == "spin")
+            spin20 = box.node;
+    }
+
+    const KEYFRAMES *keyframes20 = cssom20.keyframes("spin");
+    // Only the explicit opacity transition is composited up front
+    bool animated20 = parsed20 && box20 && spin20 && keyframes20 && keyframes20->frames.size() == 2 &&
+                      list20.composited_layers.size() == 1 &&
+                      layout20.boxes[list20.layers[list20.composited_layers[0]].box].node == box20;
+
+    ANIMATION_TIMELINE timeline20;
+    std::unordered_map<const NODE *, ANIMATED_VALUES> values20;
+    timeline20.update(layout20, cssom20, 0);
+    animated20 = animated20 && timeline20.sample(250, values20) && values20.count(box20) == 0 &&
+                 values20[spin20].has_transform && std::abs(values20[spin20].transform.rotate - 90) < 0.01f;
+
+    // A running animation composites its element
+    std::unordered_set<const NODE *> running20{spin20};
+    build_display_list(layout20, list20, &running20);
+    animated20 = animated20 && list20.composited_layers.size() == 2 &&
+                 layout20.boxes[list20.layers[list20.composited_layers[1]].box].node == spin20;
+
+    // Changing opacity starts a transition from the value shown
+    if (animated20)
+    {
+        box20->set_style("opacity", "0");
+        timeline20.update(layout20, cssom20, 1000);
+        timeline20.sample(1050, values20);
+        animated20 = values20[box20].has_opacity && std::abs(values20[box20].opacity - 0.5f) < 0.01f;
+
+        timeline20.sample(1200, values20);
+        animated20 = animated20 && values20.count(box20) == 0 && timeline20.running();
+    }
+
+    // An element left out of a virtualized layout keeps its animation running
+    // rather than restarting it when it comes back into view
+    if (animated20)
+    {
+        LAYOUT_TREE partial20 = layout20;
+        for (LAYOUT_BOX &box : partial20.boxes)
+        {
+            if (box.node == spin20)
+                box.estimated_count = 1;
+        }
+        timeline20.update(partial20, cssom20, 2000);
+        timeline20.update(layout20, cssom20, 2100);
+        timeline20.sample(2350, values20);
+        animated20 = values20[spin20].has_transform && std::abs(values20[spin20].transform.rotate - 126) < 0.01f;
+    }
+
+    if (!animated20)
+    {
+        std::cerr << "Test 20 FAILED: animations were not sampled as expected" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 20 PASSED" << std::endl;
+
+    // Test 21: an image not loaded yet keeps the size its style reserves and
+    // an empty slot to be filled in, while one without a size takes no space
+    auto tree21 = parse(tokenize("<div><img class=\"sized\" src=\"file:///missing/a.png\">"
+                                 "<img src=\"file:///missing/b.png\"><p>after</p></div>"));
+    apply_style(tree21, create_cssom("div, p, img { display: block; } .sized { width: 120px; height: 80px; }"));
+
+    LAYOUT_TREE layout21;
+    IMAGE_CACHE_MANAGER images21{};
+    LAYOUT_CONTEXT context21{layout21};
+    context21.image_cache_manager = &images21;
+    LINE_STATE line21(800);
+    create_layout_tree(tree21.get(), 800, line21, context21);
+
+    int sized21 = -1;
+    int unsized21 = -1;
+    for (int i = 0; i < static_cast<int>(layout21.boxes.size()); ++i)
+    {
+        if (layout21.boxes[i].node->get_tag_name() == "img")
+            (sized21 < 0 ? sized21 : unsized21) = i;
+    }
+
+    bool reserved21 = sized21 >= 0 && unsized21 >= 0 && layout21.boxes[sized21].width == 120 &&
+                      layout21.boxes[sized21].height == 80 && layout21.boxes[sized21].image >= 0 &&
+                      layout21.images[layout21.boxes[sized21].image].isNull() &&
+                      layout21.boxes[unsized21].image < 0 && layout21.boxes[unsized21].height == 0;
+
+    if (!reserved21)
+    {
+        std::cerr << "Test 21 FAILED: image box did not reserve its size" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 21 PASSED" << std::endl;
+
+    // Test 22: the image cache keeps decoded images by URL within its byte
+    // budget, evicting the least recently used
+    IMAGE_CACHE_MANAGER cache22(3 * 100 * 100 * 4);
+    cache22.store("http://a/1.png", QImage(100, 100, QImage::Format_ARGB32_Premultiplied));
+    cache22.store("http://a/2.png", QImage(100, 100, QImage::Format_ARGB32_Premultiplied));
+    cache22.store("http://a/3.png", QImage(100, 100, QImage::Format_ARGB32_Premultiplied));
+    bool touched22 = cache22.find("http://a/1.png") != nullptr;
+    cache22.store("http://a/4.png", QImage(100, 100, QImage::Format_ARGB32_Premultiplied));
+
+    bool cached22 = touched22 && cache22.find("http://a/1.png") && !cache22.find("http://a/2.png") &&
+                    cache22.find("http://a/4.png") && cache22.bytes() == 3 * 100 * 100 * 4;
+
+    // A failed download is remembered, so it is not requested again
+    cached22 = cached22 && !cache22.store("http://a/broken.png", QImage()) &&
+               !cache22.find("http://a/broken.png") && !cache22.is_pending("http://a/broken.png");
+
+    // ...until the next document is rendered
+    cache22.forget_failed();
+    cached22 = cached22 && cache22.size() == 3;
+
+    // An image a layout still holds is not evicted
+    QImage shown22 = *cache22.find("http://a/3.png");
+    cache22.find("http://a/4.png");
+    cache22.set_budget(100 * 100 * 4);
+    cached22 = cached22 && cache22.bytes() == 2 * 100 * 100 * 4 && cache22.find("http://a/3.png") &&
+               cache22.find("http://a/1.png") == nullptr;
+
+    shown22 = QImage();
+    cache22.find("http://a/4.png");
+    cache22.set_budget(100 * 100 * 4);
+    cached22 = cached22 && cache22.bytes() == 100 * 100 * 4 && cache22.find("http://a/3.png") == nullptr;
+
+    if (!cached22)
+    {
+        std::cerr << "Test 22 FAILED: image cache did not keep the recently used images" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 22 PASSED" << std::endl;
+
+    // Test 23: a restyle that only needs a repaint keeps the offsets layout
+    // resolved, so the display list is rebuilt without a relayout
+    auto tree23 = parse(tokenize("<div><span class=\"moved\">moved</span></div>"));
+    CSSOM cssom23 = create_cssom("div { display: block; }"
+                                 ".moved { display: block; position: relative; left: 2em; top: 10vh; "
+                                 "background-color: #eeeeee; }"
+                                 ".hot { background-color: #ff0000; }");
+    apply_style(tree23, cssom23);
+
+    LAYOUT_TREE layout23;
+    LAYOUT_CONTEXT context23{layout23};
+    context23.viewport_width = 800;
+    context23.viewport_height = 600;
+    LINE_STATE line23(800);
+    create_layout_tree(tree23.get(), 800, line23, context23);
+
+    auto background23 = [&layout23](DISPLAY_LIST &list) -> const DISPLAY_ITEM *
+    {
+        build_display_list(layout23, list);
+        for (const DISPLAY_ITEM &item : list.items)
+        {
+            if (item.type == DISPLAY_ITEM_TYPE::Background)
+            {
+                return &item;
+            }
+        }
+        return nullptr;
+    };
+
+    DISPLAY_LIST before_list23, after_list23;
+    const DISPLAY_ITEM *before23 = background23(before_list23);
+    bool laid_out23 = before23 && before23->x == 32 && before23->y == 60;
+
+    auto moved23 = tree23->get_children()[0];
+    moved23->set_attribute("class", "moved hot");
+    update_style(tree23, cssom23);
+
+    // The same layout tree is painted again; its boxes read the new styles
+    const DISPLAY_ITEM *after23 = background23(after_list23);
+    bool kept23 = moved23->is_paint_dirty() && !tree23->has_layout_dirty_descendant() && after23 &&
+                  after23->x == 32 && after23->y == 60 && after23->color == QColor(255, 0, 0);
+
+    if (!laid_out23 || !kept23)
+    {
+        std::cerr << "Test 23 FAILED: a paint-only restyle lost the resolved offsets" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 23 PASSED" << std::endl;
+
+    // Test 24: a downloaded image fills the slot its box reserved without a
+    // relayout, while one without a reserved size relayouts only its img
+    auto tree24 = parse(tokenize("<div><p>before</p><img class=\"sized\" src=\"http://images.test/a.png\">"
+                                 "<img src=\"http://images.test/b.png\"><p>after</p></div>"));
+    apply_style(tree24, create_cssom("div, p, img { display: block; } .sized { width: 120px; height: 80px; }"));
+
+    IMAGE_CACHE_MANAGER images24{};
+    LAYOUT_TREE first24, second24;
+    LAYOUT_CACHE first_cache24, second_cache24;
+    LAYOUT_CONTEXT context24a{first24};
+    context24a.image_cache_manager = &images24;
+    context24a.cache = &first_cache24;
+    LINE_STATE line24a(800);
+    create_layout_tree(tree24.get(), 800, line24a, context24a);
+
+    DISPLAY_LIST list24;
+    build_display_list(first24, list24);
+
+    int sized24 = -1;
+    int unsized24 = -1;
+    for (int i = 0; i < static_cast<int>(first24.boxes.size()); ++i)
+    {
+        if (first24.boxes[i].node->get_tag_name() == "img")
+            (sized24 < 0 ? sized24 : unsized24) = i;
+    }
+    NODE *sized_node24 = first24.boxes[sized24].node;
+    NODE *unsized_node24 = first24.boxes[unsized24].node;
+
+    images24.store("http://images.test/a.png", QImage(120, 80, QImage::Format_ARGB32_Premultiplied));
+    std::vector<size_t> repaint24;
+    int waits24 = 0;
+    bool relayout24 = fill_loaded_images(first24, list24, images24, "", {"http://images.test/a.png"}, repaint24,
+                                         [&waits24]() { ++waits24; });
+
+    const LAYOUT_BOX &sized_box24 = first24.boxes[sized24];
+    bool filled24 = !relayout24 && waits24 == 1 && !first24.images[sized_box24.image].isNull() &&
+                    !tree24->has_layout_dirty_descendant() && repaint24.size() == 1 &&
+                    list24.items[repaint24[0]].type == DISPLAY_ITEM_TYPE::Image &&
+                    list24.items[repaint24[0]].box == sized24 &&
+                    list24.items[repaint24[0]].bounds.contains(QRectF(0, sized_box24.y, 120, 80).center());
+
+    // The unsized image marks only its own img layout-dirty
+    images24.store("http://images.test/b.png", QImage(60, 30, QImage::Format_ARGB32_Premultiplied));
+    relayout24 = fill_loaded_images(first24, list24, images24, "", {"http://images.test/b.png"}, repaint24);
+    bool dirty24 = relayout24 && repaint24.empty() && unsized_node24->is_layout_dirty() &&
+                   !sized_node24->is_layout_dirty() && tree24->has_layout_dirty_descendant();
+    for (const LAYOUT_BOX &box : first24.boxes)
+    {
+        if (box.node->get_tag_name() == "p")
+            dirty24 = dirty24 && !box.node->is_layout_dirty();
+    }
+
+    // ...and the relayout that follows copies the clean blocks
+    LAYOUT_CONTEXT context24b{second24};
+    context24b.image_cache_manager = &images24;
+    context24b.previous_tree = &first24;
+    context24b.previous_cache = &first_cache24;
+    context24b.cache = &second_cache24;
+    LINE_STATE line24b(800);
+    create_layout_tree(tree24.get(), 800, line24b, context24b);
+
+    const LAYOUT_BOX *unsized_box24 = nullptr;
+    for (const LAYOUT_BOX &box : second24.boxes)
+    {
+        if (box.node == unsized_node24)
+            unsized_box24 = &box;
+    }
+    bool partial24 = context24b.reused_boxes > 0 && context24b.reused_boxes < second24.boxes.size() &&
+                     unsized_box24 && unsized_box24->image >= 0 && unsized_box24->height == 30;
+
+    if (!filled24 || !dirty24 || !partial24)
+    {
+        std::cerr << "Test 24 FAILED: downloaded images were not shown as expected" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Test 24 PASSED" << std::endl;
+
+    std::cout << "All tests PASSED!" << std::endl;
+    return 0;
+}